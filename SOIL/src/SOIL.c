@@ -23,6 +23,7 @@
 #elif defined(__APPLE__) || defined(__APPLE_CC__)
 	/*	I can't test this Apple stuff!	*/
 	#include <OpenGL/gl.h>
+	#include <OpenGL/OpenGL.h>
 	#include <Carbon/Carbon.h>
 	#define APIENTRY
 #else
@@ -41,6 +42,21 @@
 /*	error reporting	*/
 char *result_string_pointer = "SOIL initialized";
 
+/*	for querying extensions (core profiles have no GL_EXTENSIONS string)	*/
+#define SOIL_NUM_EXTENSIONS					0x821D
+typedef const GLubyte *(APIENTRY * P_SOIL_GLGETSTRINGIPROC) (GLenum name, GLuint index);
+int SOIL_internal_has_OGL_extension( const char *name );
+void *SOIL_internal_get_OGL_proc_address( const char *name );
+/*	capabilities are queried once per OpenGL context; a different
+	current context throws the cached answers away	*/
+static void *capability_context = NULL;
+void *SOIL_internal_get_OGL_context( void );
+void SOIL_internal_check_OGL_context( void );
+static int OGL_version = -1;
+int SOIL_internal_OGL_version( void );
+static int max_texture_size = 0;
+static int max_cubemap_texture_size = 0;
+int query_max_texture_size( unsigned int texture_check_size_enum );
 /*	for loading cube maps	*/
 enum{
 	SOIL_CAPABILITY_UNKNOWN = -1,
@@ -80,11 +96,24 @@ int query_DXT_capability( void );
 #define SOIL_RGBA_S3TC_DXT5		0x83F3
 typedef void (APIENTRY * P_SOIL_GLCOMPRESSEDTEXIMAGE2DPROC) (GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const GLvoid * data);
 P_SOIL_GLCOMPRESSEDTEXIMAGE2DPROC soilGlCompressedTexImage2D = NULL;
-unsigned int SOIL_direct_load_DDS(
-		const char *filename,
-		unsigned int reuse_texture_ID,
-		int flags,
-		int loading_as_cubemap );
+/*	for MIPmaps made by the GPU, in immutable storage	*/
+static int has_GPU_mipmap_capability = SOIL_CAPABILITY_UNKNOWN;
+int query_GPU_mipmap_capability( void );
+static int has_tex_storage_capability = SOIL_CAPABILITY_UNKNOWN;
+int query_tex_storage_capability( void );
+static int has_tex_swizzle_capability = SOIL_CAPABILITY_UNKNOWN;
+int query_tex_swizzle_capability( void );
+#define SOIL_RG							0x8227
+#define SOIL_R8							0x8229
+#define SOIL_RG8						0x822B
+#define SOIL_RGB8						0x8051
+#define SOIL_RGBA8						0x8058
+#define SOIL_TEXTURE_SWIZZLE_RGBA		0x8E46
+#define SOIL_TEXTURE_IMMUTABLE_FORMAT	0x912F
+typedef void (APIENTRY * P_SOIL_GLGENERATEMIPMAPPROC) (GLenum target);
+typedef void (APIENTRY * P_SOIL_GLTEXSTORAGE2DPROC) (GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
+P_SOIL_GLGENERATEMIPMAPPROC soilGlGenerateMipmap = NULL;
+P_SOIL_GLTEXSTORAGE2DPROC soilGlTexStorage2D = NULL;
 unsigned int SOIL_direct_load_DDS_from_memory(
 		const unsigned char *const buffer,
 		int buffer_length,
@@ -92,6 +121,14 @@ unsigned int SOIL_direct_load_DDS_from_memory(
 		int flags,
 		int loading_as_cubemap );
 /*	other functions	*/
+int
+	SOIL_internal_upload_immutable
+	(
+		const unsigned char *const data,
+		int width, int height, int channels,
+		unsigned int reuse_texture_ID,
+		unsigned int opengl_texture_type
+	);
 unsigned int
 	SOIL_internal_create_OGL_texture
 	(
@@ -995,6 +1032,7 @@ unsigned int
 	unsigned int internal_texture_format = 0, original_texture_format = 0;
 	int DXT_mode = SOIL_CAPABILITY_UNKNOWN;
 	int max_supported_size;
+	int use_GPU_mipmaps = 0;
 	/*	If the user wants to use the texture rectangle I kill a few flags	*/
 	if( flags & SOIL_FLAG_TEXTURE_RECTANGLE )
 	{
@@ -1007,7 +1045,7 @@ unsigned int
 				/*	clean out the flags that cannot be used with texture rectangles	*/
 				flags &= ~(
 						SOIL_FLAG_POWER_OF_TWO | SOIL_FLAG_MIPMAPS |
-						SOIL_FLAG_TEXTURE_REPEATS
+						SOIL_FLAG_GPU_MIPMAPS | SOIL_FLAG_TEXTURE_REPEATS
 					);
 				/*	and change my target	*/
 				opengl_texture_target = SOIL_TEXTURE_RECTANGLE_ARB;
@@ -1025,6 +1063,19 @@ unsigned int
 			return 0;
 		}
 	}
+	/*	can the GPU make the MIPmaps?  Only for plain 2D textures: cube map
+		faces come in one at a time, and glGenerateMipmap can't write DXT	*/
+	if( flags & SOIL_FLAG_GPU_MIPMAPS )
+	{
+		flags |= SOIL_FLAG_MIPMAPS;
+		if( (opengl_texture_type == GL_TEXTURE_2D) &&
+			!((flags & SOIL_FLAG_COMPRESS_TO_DXT) &&
+				(query_DXT_capability() == SOIL_CAPABILITY_PRESENT)) &&
+			(query_GPU_mipmap_capability() == SOIL_CAPABILITY_PRESENT) )
+		{
+			use_GPU_mipmaps = 1;
+		}
+	}
 	/*	create a copy the image data	*/
 	img = (unsigned char*)malloc( width*height*channels );
 	memcpy( img, data, width*height*channels );
@@ -1086,11 +1137,12 @@ unsigned int
 	}
 	/*	how large of a texture can this OpenGL implementation handle?	*/
 	/*	texture_check_size_enum will be GL_MAX_TEXTURE_SIZE or SOIL_MAX_CUBE_MAP_TEXTURE_SIZE	*/
-	glGetIntegerv( texture_check_size_enum, &max_supported_size );
+	max_supported_size = query_max_texture_size( texture_check_size_enum );
 	/*	do I need to make it a power of 2?	*/
 	if(
 		(flags & SOIL_FLAG_POWER_OF_TWO) ||	/*	user asked for it	*/
-		(flags & SOIL_FLAG_MIPMAPS) ||		/*	need it for the MIP-maps	*/
+		((flags & SOIL_FLAG_MIPMAPS) &&		/*	need it for my MIP-maps	*/
+			!use_GPU_mipmaps) ||
 		(width > max_supported_size) ||		/*	it's too big, (make sure it's	*/
 		(height > max_supported_size) )		/*	2^n for later down-sampling)	*/
 	{
@@ -1247,16 +1299,41 @@ unsigned int
 			}
 		} else
 		{
-			/*	user want OpenGL to do all the work!	*/
-			glTexImage2D(
-				opengl_texture_target, 0,
-				internal_texture_format, width, height, 0,
-				original_texture_format, GL_UNSIGNED_BYTE, img );
-			check_for_GL_errors( "glTexImage2D" );
-			/*printf( "OpenGL DXT compressor\n" );	*/
+			/*	GPU MIPmaps go in immutable storage if possible	*/
+			int uploaded = 0;
+			if( use_GPU_mipmaps )
+			{
+				uploaded = SOIL_internal_upload_immutable(
+						img, width, height, channels,
+						reuse_texture_ID, opengl_texture_type );
+			}
+			if( uploaded < 0 )
+			{
+				/*	can't reload into that texture (the reason is set)	*/
+				SOIL_free_image_data( img );
+				return 0;
+			} else if( !uploaded )
+			{
+				/*	user want OpenGL to do all the work!	*/
+				glTexImage2D(
+					opengl_texture_target, 0,
+					internal_texture_format, width, height, 0,
+					original_texture_format, GL_UNSIGNED_BYTE, img );
+				check_for_GL_errors( "glTexImage2D" );
+				/*printf( "OpenGL DXT compressor\n" );	*/
+			}
 		}
 		/*	are any MIPmaps desired?	*/
-		if( flags & SOIL_FLAG_MIPMAPS )
+		if( use_GPU_mipmaps )
+		{
+			/*	the GPU builds them from the first level	*/
+			soilGlGenerateMipmap( opengl_texture_type );
+			check_for_GL_errors( "glGenerateMipmap" );
+			/*	instruct OpenGL to use the MIPmaps	*/
+			glTexParameteri( opengl_texture_type, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+			glTexParameteri( opengl_texture_type, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+			check_for_GL_errors( "GL_TEXTURE_MIN/MAG_FILTER" );
+		} else if( flags & SOIL_FLAG_MIPMAPS )
 		{
 			int MIPlevel = 1;
 			int MIPwidth = (width+1) / 2;
@@ -1364,6 +1441,92 @@ unsigned int
 	return tex_id;
 }
 
+int
+	SOIL_internal_upload_immutable
+	(
+		const unsigned char *const data,
+		int width, int height, int channels,
+		unsigned int reuse_texture_ID,
+		unsigned int opengl_texture_type
+	)
+{
+	/*	single and dual channel textures read as luminance (and alpha)	*/
+	static const GLint luminance_swizzle[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+	static const GLint luminance_alpha_swizzle[4] = { GL_RED, GL_RED, GL_RED, GL_GREEN };
+	unsigned int sized_format, upload_format;
+	int levels = 1;
+	/*	returns 1 if the image went into immutable storage, 0 if it should
+		go the glTexImage2D way, -1 if it can't go anywhere	*/
+	if( query_tex_storage_capability() != SOIL_CAPABILITY_PRESENT )
+	{
+		return 0;
+	}
+	switch( channels )
+	{
+	case 1:
+		sized_format = SOIL_R8;
+		upload_format = GL_RED;
+		break;
+	case 2:
+		sized_format = SOIL_RG8;
+		upload_format = SOIL_RG;
+		break;
+	case 3:
+		sized_format = SOIL_RGB8;
+		upload_format = GL_RGB;
+		break;
+	default:
+		sized_format = SOIL_RGBA8;
+		upload_format = GL_RGBA;
+		break;
+	}
+	if( (channels < 3) &&
+		(query_tex_swizzle_capability() != SOIL_CAPABILITY_PRESENT) )
+	{
+		return 0;
+	}
+	if( reuse_texture_ID != 0 )
+	{
+		/*	a reloaded texture keeps the kind of storage it had, and immutable
+			storage can only take the same size and format again	*/
+		GLint immutable = 0, old_width = 0, old_height = 0, old_format = 0;
+		glGetTexParameteriv( opengl_texture_type, SOIL_TEXTURE_IMMUTABLE_FORMAT, &immutable );
+		if( !immutable )
+		{
+			return 0;
+		}
+		glGetTexLevelParameteriv( opengl_texture_type, 0, GL_TEXTURE_WIDTH, &old_width );
+		glGetTexLevelParameteriv( opengl_texture_type, 0, GL_TEXTURE_HEIGHT, &old_height );
+		glGetTexLevelParameteriv( opengl_texture_type, 0, GL_TEXTURE_INTERNAL_FORMAT, &old_format );
+		if( (old_width != width) || (old_height != height) ||
+			(old_format != (GLint)sized_format) )
+		{
+			result_string_pointer = "Can't reload an immutable texture with a different size or format";
+			return -1;
+		}
+	} else
+	{
+		/*	room for the whole MIPmap chain	*/
+		while( ((1<<levels) <= width) || ((1<<levels) <= height) )
+		{
+			++levels;
+		}
+		soilGlTexStorage2D( opengl_texture_type, levels, sized_format, width, height );
+		check_for_GL_errors( "glTexStorage2D" );
+	}
+	if( channels < 3 )
+	{
+		glTexParameteriv( opengl_texture_type, SOIL_TEXTURE_SWIZZLE_RGBA,
+				(channels == 1) ? luminance_swizzle : luminance_alpha_swizzle );
+	}
+	glTexSubImage2D(
+		opengl_texture_type, 0,
+		0, 0, width, height,
+		upload_format, GL_UNSIGNED_BYTE, data );
+	check_for_GL_errors( "glTexSubImage2D" );
+	return 1;
+}
+
 int
 	SOIL_save_screenshot
 	(
@@ -1464,6 +1627,93 @@ unsigned char*
 	return result;
 }
 
+int
+	SOIL_image_info
+	(
+		const char *filename,
+		int *width, int *height, int *channels
+	)
+{
+	int result = stbi_info( filename, width, height, channels );
+	if( !result )
+	{
+		result_string_pointer = stbi_failure_reason();
+	} else
+	{
+		result_string_pointer = "Image info read";
+	}
+	return result;
+}
+
+int
+	SOIL_image_info_from_memory
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		int *width, int *height, int *channels
+	)
+{
+	int result = stbi_info_from_memory(
+				buffer, buffer_length,
+				width, height, channels );
+	if( !result )
+	{
+		result_string_pointer = stbi_failure_reason();
+	} else
+	{
+		result_string_pointer = "Image info read from memory";
+	}
+	return result;
+}
+
+int
+	SOIL_load_image_into
+	(
+		const char *filename,
+		unsigned char *buffer,
+		int buffer_size,
+		int *width, int *height, int *channels,
+		int force_channels
+	)
+{
+	int result = stbi_load_into( filename, buffer, buffer_size,
+			width, height, channels, force_channels );
+	if( !result )
+	{
+		result_string_pointer = stbi_failure_reason();
+	} else
+	{
+		result_string_pointer = "Image loaded";
+	}
+	return result;
+}
+
+int
+	SOIL_load_image_from_memory_into
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		unsigned char *image,
+		int image_size,
+		int *width, int *height, int *channels,
+		int force_channels
+	)
+{
+	int result = stbi_load_from_memory_into(
+				buffer, buffer_length,
+				image, image_size,
+				width, height, channels,
+				force_channels );
+	if( !result )
+	{
+		result_string_pointer = stbi_failure_reason();
+	} else
+	{
+		result_string_pointer = "Image loaded from memory";
+	}
+	return result;
+}
+
 int
 	SOIL_save_image
 	(
@@ -1672,23 +1922,13 @@ unsigned int SOIL_direct_load_DDS_from_memory(
 	}
 	if( (header.sCaps.dwCaps1 & DDSCAPS_MIPMAP) && (header.dwMipMapCount > 1) )
 	{
-		int shift_offset;
 		mipmaps = header.dwMipMapCount - 1;
 		DDS_full_size = DDS_main_size;
-		if( uncompressed )
-		{
-			/*	uncompressed DDS, simple MIPmap size calculation	*/
-			shift_offset = 0;
-		} else
-		{
-			/*	compressed DDS, MIPmap size calculation is block based	*/
-			shift_offset = 2;
-		}
 		for( i = 1; i <= mipmaps; ++ i )
 		{
 			int w, h;
-			w = width >> (shift_offset + i);
-			h = height >> (shift_offset + i);
+			w = width >> i;
+			h = height >> i;
 			if( w < 1 )
 			{
 				w = 1;
@@ -1697,7 +1937,17 @@ unsigned int SOIL_direct_load_DDS_from_memory(
 			{
 				h = 1;
 			}
-			DDS_full_size += w*h*block_size;
+			if( uncompressed )
+			{
+				/*	uncompressed DDS, simple MIPmap size calculation	*/
+				DDS_full_size += w*h*block_size;
+			} else
+			{
+				/*	compressed DDS, MIPmap size calculation is block based
+					(partial blocks still take up a whole block, which
+					matters for non-power-of-two images)	*/
+				DDS_full_size += ((w+3)>>2)*((h+3)>>2)*block_size;
+			}
 		}
 	} else
 	{
@@ -1872,13 +2122,15 @@ unsigned int SOIL_direct_load_DDS(
 
 int query_NPOT_capability( void )
 {
+	/*	forget what another context could do	*/
+	SOIL_internal_check_OGL_context();
 	/*	check for the capability	*/
 	if( has_NPOT_capability == SOIL_CAPABILITY_UNKNOWN )
 	{
-		/*	we haven't yet checked for the capability, do so	*/
+		/*	we haven't yet checked for the capability, do so (core since 2.0)	*/
 		if(
-			(NULL == strstr( (char const*)glGetString( GL_EXTENSIONS ),
-				"GL_ARB_texture_non_power_of_two" ) )
+			(SOIL_internal_OGL_version() < 20) &&
+			!SOIL_internal_has_OGL_extension( "GL_ARB_texture_non_power_of_two" )
 			)
 		{
 			/*	not there, flag the failure	*/
@@ -1895,19 +2147,16 @@ int query_NPOT_capability( void )
 
 int query_tex_rectangle_capability( void )
 {
+	/*	forget what another context could do	*/
+	SOIL_internal_check_OGL_context();
 	/*	check for the capability	*/
 	if( has_tex_rectangle_capability == SOIL_CAPABILITY_UNKNOWN )
 	{
 		/*	we haven't yet checked for the capability, do so	*/
 		if(
-			(NULL == strstr( (char const*)glGetString( GL_EXTENSIONS ),
-				"GL_ARB_texture_rectangle" ) )
-		&&
-			(NULL == strstr( (char const*)glGetString( GL_EXTENSIONS ),
-				"GL_EXT_texture_rectangle" ) )
-		&&
-			(NULL == strstr( (char const*)glGetString( GL_EXTENSIONS ),
-				"GL_NV_texture_rectangle" ) )
+			!SOIL_internal_has_OGL_extension( "GL_ARB_texture_rectangle" ) &&
+			!SOIL_internal_has_OGL_extension( "GL_EXT_texture_rectangle" ) &&
+			!SOIL_internal_has_OGL_extension( "GL_NV_texture_rectangle" )
 			)
 		{
 			/*	not there, flag the failure	*/
@@ -1924,16 +2173,16 @@ int query_tex_rectangle_capability( void )
 
 int query_cubemap_capability( void )
 {
+	/*	forget what another context could do	*/
+	SOIL_internal_check_OGL_context();
 	/*	check for the capability	*/
 	if( has_cubemap_capability == SOIL_CAPABILITY_UNKNOWN )
 	{
-		/*	we haven't yet checked for the capability, do so	*/
+		/*	we haven't yet checked for the capability, do so (core since 1.3)	*/
 		if(
-			(NULL == strstr( (char const*)glGetString( GL_EXTENSIONS ),
-				"GL_ARB_texture_cube_map" ) )
-		&&
-			(NULL == strstr( (char const*)glGetString( GL_EXTENSIONS ),
-				"GL_EXT_texture_cube_map" ) )
+			(SOIL_internal_OGL_version() < 13) &&
+			!SOIL_internal_has_OGL_extension( "GL_ARB_texture_cube_map" ) &&
+			!SOIL_internal_has_OGL_extension( "GL_EXT_texture_cube_map" )
 			)
 		{
 			/*	not there, flag the failure	*/
@@ -1950,57 +2199,22 @@ int query_cubemap_capability( void )
 
 int query_DXT_capability( void )
 {
+	/*	forget what another context could do	*/
+	SOIL_internal_check_OGL_context();
 	/*	check for the capability	*/
 	if( has_DXT_capability == SOIL_CAPABILITY_UNKNOWN )
 	{
 		/*	we haven't yet checked for the capability, do so	*/
-		if( NULL == strstr(
-				(char const*)glGetString( GL_EXTENSIONS ),
-				"GL_EXT_texture_compression_s3tc" ) )
+		if( !SOIL_internal_has_OGL_extension( "GL_EXT_texture_compression_s3tc" ) )
 		{
 			/*	not there, flag the failure	*/
 			has_DXT_capability = SOIL_CAPABILITY_NONE;
 		} else
 		{
 			/*	and find the address of the extension function	*/
-			P_SOIL_GLCOMPRESSEDTEXIMAGE2DPROC ext_addr = NULL;
-			#ifdef WIN32
-				ext_addr = (P_SOIL_GLCOMPRESSEDTEXIMAGE2DPROC)
-						wglGetProcAddress
-						(
-							"glCompressedTexImage2DARB"
-						);
-			#elif defined(__APPLE__) || defined(__APPLE_CC__)
-				/*	I can't test this Apple stuff!	*/
-				CFBundleRef bundle;
-				CFURLRef bundleURL =
-					CFURLCreateWithFileSystemPath(
-						kCFAllocatorDefault,
-						CFSTR("/System/Library/Frameworks/OpenGL.framework"),
-						kCFURLPOSIXPathStyle,
-						true );
-				CFStringRef extensionName =
-					CFStringCreateWithCString(
-						kCFAllocatorDefault,
-						"glCompressedTexImage2DARB",
-						kCFStringEncodingASCII );
-				bundle = CFBundleCreate( kCFAllocatorDefault, bundleURL );
-				assert( bundle != NULL );
-				ext_addr = (P_SOIL_GLCOMPRESSEDTEXIMAGE2DPROC)
-						CFBundleGetFunctionPointerForName
-						(
-							bundle, extensionName
-						);
-				CFRelease( bundleURL );
-				CFRelease( extensionName );
-				CFRelease( bundle );
-			#else
-				ext_addr = (P_SOIL_GLCOMPRESSEDTEXIMAGE2DPROC)
-						glXGetProcAddressARB
-						(
-							(const GLubyte *)"glCompressedTexImage2DARB"
-						);
-			#endif
+			P_SOIL_GLCOMPRESSEDTEXIMAGE2DPROC ext_addr =
+					(P_SOIL_GLCOMPRESSEDTEXIMAGE2DPROC)
+					SOIL_internal_get_OGL_proc_address( "glCompressedTexImage2DARB" );
 			/*	Flag it so no checks needed later	*/
 			if( NULL == ext_addr )
 			{
@@ -2022,3 +2236,252 @@ int query_DXT_capability( void )
 	/*	let the user know if we can do DXT or not	*/
 	return has_DXT_capability;
 }
+
+int query_GPU_mipmap_capability( void )
+{
+	/*	forget what another context could do	*/
+	SOIL_internal_check_OGL_context();
+	/*	check for the capability	*/
+	if( has_GPU_mipmap_capability == SOIL_CAPABILITY_UNKNOWN )
+	{
+		/*	core since OpenGL 3.0, before that it came with the FBO extensions	*/
+		P_SOIL_GLGENERATEMIPMAPPROC ext_addr = NULL;
+		if(
+			(SOIL_internal_OGL_version() >= 30) ||
+			SOIL_internal_has_OGL_extension( "GL_ARB_framebuffer_object" )
+			)
+		{
+			ext_addr = (P_SOIL_GLGENERATEMIPMAPPROC)
+					SOIL_internal_get_OGL_proc_address( "glGenerateMipmap" );
+		} else if( SOIL_internal_has_OGL_extension( "GL_EXT_framebuffer_object" ) )
+		{
+			ext_addr = (P_SOIL_GLGENERATEMIPMAPPROC)
+					SOIL_internal_get_OGL_proc_address( "glGenerateMipmapEXT" );
+		}
+		if( NULL == ext_addr )
+		{
+			/*	not there, flag the failure	*/
+			has_GPU_mipmap_capability = SOIL_CAPABILITY_NONE;
+		} else
+		{
+			/*	it's there!	*/
+			soilGlGenerateMipmap = ext_addr;
+			has_GPU_mipmap_capability = SOIL_CAPABILITY_PRESENT;
+		}
+	}
+	/*	let the user know if the GPU can make MIPmaps or not	*/
+	return has_GPU_mipmap_capability;
+}
+
+int query_tex_storage_capability( void )
+{
+	/*	forget what another context could do	*/
+	SOIL_internal_check_OGL_context();
+	/*	check for the capability	*/
+	if( has_tex_storage_capability == SOIL_CAPABILITY_UNKNOWN )
+	{
+		/*	core since OpenGL 4.2	*/
+		P_SOIL_GLTEXSTORAGE2DPROC ext_addr = NULL;
+		if(
+			(SOIL_internal_OGL_version() >= 42) ||
+			SOIL_internal_has_OGL_extension( "GL_ARB_texture_storage" )
+			)
+		{
+			ext_addr = (P_SOIL_GLTEXSTORAGE2DPROC)
+					SOIL_internal_get_OGL_proc_address( "glTexStorage2D" );
+		}
+		if( NULL == ext_addr )
+		{
+			/*	not there, flag the failure	*/
+			has_tex_storage_capability = SOIL_CAPABILITY_NONE;
+		} else
+		{
+			/*	it's there!	*/
+			soilGlTexStorage2D = ext_addr;
+			has_tex_storage_capability = SOIL_CAPABILITY_PRESENT;
+		}
+	}
+	/*	let the user know if we can make immutable textures or not	*/
+	return has_tex_storage_capability;
+}
+
+int query_tex_swizzle_capability( void )
+{
+	/*	forget what another context could do	*/
+	SOIL_internal_check_OGL_context();
+	/*	check for the capability	*/
+	if( has_tex_swizzle_capability == SOIL_CAPABILITY_UNKNOWN )
+	{
+		/*	core since OpenGL 3.3	*/
+		if(
+			(SOIL_internal_OGL_version() < 33) &&
+			!SOIL_internal_has_OGL_extension( "GL_ARB_texture_swizzle" ) &&
+			!SOIL_internal_has_OGL_extension( "GL_EXT_texture_swizzle" )
+			)
+		{
+			/*	not there, flag the failure	*/
+			has_tex_swizzle_capability = SOIL_CAPABILITY_NONE;
+		} else
+		{
+			/*	it's there!	*/
+			has_tex_swizzle_capability = SOIL_CAPABILITY_PRESENT;
+		}
+	}
+	/*	let the user know if we can swizzle texture channels or not	*/
+	return has_tex_swizzle_capability;
+}
+
+int query_max_texture_size( unsigned int texture_check_size_enum )
+{
+	/*	forget what another context could do	*/
+	SOIL_internal_check_OGL_context();
+	/*	GL_MAX_TEXTURE_SIZE or SOIL_MAX_CUBE_MAP_TEXTURE_SIZE, each asked once	*/
+	if( texture_check_size_enum == SOIL_MAX_CUBE_MAP_TEXTURE_SIZE )
+	{
+		if( max_cubemap_texture_size == 0 )
+		{
+			glGetIntegerv( texture_check_size_enum, &max_cubemap_texture_size );
+		}
+		return max_cubemap_texture_size;
+	} else
+	{
+		if( max_texture_size == 0 )
+		{
+			glGetIntegerv( texture_check_size_enum, &max_texture_size );
+		}
+		return max_texture_size;
+	}
+}
+
+void *SOIL_internal_get_OGL_context( void )
+{
+	#ifdef WIN32
+		return (void*)wglGetCurrentContext();
+	#elif defined(__APPLE__) || defined(__APPLE_CC__)
+		return (void*)CGLGetCurrentContext();
+	#else
+		return (void*)glXGetCurrentContext();
+	#endif
+}
+
+void SOIL_internal_check_OGL_context( void )
+{
+	void *context = SOIL_internal_get_OGL_context();
+	if( context != capability_context )
+	{
+		/*	a different context, which may well be a different driver	*/
+		capability_context = context;
+		OGL_version = -1;
+		max_texture_size = 0;
+		max_cubemap_texture_size = 0;
+		has_cubemap_capability = SOIL_CAPABILITY_UNKNOWN;
+		has_NPOT_capability = SOIL_CAPABILITY_UNKNOWN;
+		has_tex_rectangle_capability = SOIL_CAPABILITY_UNKNOWN;
+		has_DXT_capability = SOIL_CAPABILITY_UNKNOWN;
+		has_GPU_mipmap_capability = SOIL_CAPABILITY_UNKNOWN;
+		has_tex_storage_capability = SOIL_CAPABILITY_UNKNOWN;
+		has_tex_swizzle_capability = SOIL_CAPABILITY_UNKNOWN;
+		soilGlCompressedTexImage2D = NULL;
+		soilGlGenerateMipmap = NULL;
+		soilGlTexStorage2D = NULL;
+	}
+}
+
+int SOIL_internal_OGL_version( void )
+{
+	/*	major * 10 + minor, from e.g. "4.6.0 NVIDIA" or "OpenGL ES 3.2"	*/
+	if( OGL_version < 0 )
+	{
+		const char *version = (char const*)glGetString( GL_VERSION );
+		OGL_version = 0;
+		if( NULL != version )
+		{
+			while( (*version != '\0') && ((*version < '0') || (*version > '9')) )
+			{
+				++version;
+			}
+			if( (version[0] != '\0') && (version[1] == '.') &&
+				(version[2] >= '0') && (version[2] <= '9') )
+			{
+				OGL_version = (version[0] - '0') * 10 + (version[2] - '0');
+			}
+		}
+	}
+	return OGL_version;
+}
+
+void *SOIL_internal_get_OGL_proc_address( const char *name )
+{
+	void *ext_addr = NULL;
+	#ifdef WIN32
+		ext_addr = (void*)
+				wglGetProcAddress
+				(
+					name
+				);
+	#elif defined(__APPLE__) || defined(__APPLE_CC__)
+		/*	I can't test this Apple stuff!	*/
+		CFBundleRef bundle;
+		CFURLRef bundleURL =
+			CFURLCreateWithFileSystemPath(
+				kCFAllocatorDefault,
+				CFSTR("/System/Library/Frameworks/OpenGL.framework"),
+				kCFURLPOSIXPathStyle,
+				true );
+		CFStringRef extensionName =
+			CFStringCreateWithCString(
+				kCFAllocatorDefault,
+				name,
+				kCFStringEncodingASCII );
+		bundle = CFBundleCreate( kCFAllocatorDefault, bundleURL );
+		assert( bundle != NULL );
+		ext_addr = (void*)
+				CFBundleGetFunctionPointerForName
+				(
+					bundle, extensionName
+				);
+		CFRelease( bundleURL );
+		CFRelease( extensionName );
+		CFRelease( bundle );
+	#else
+		ext_addr = (void*)
+				glXGetProcAddressARB
+				(
+					(const GLubyte *)name
+				);
+	#endif
+	return ext_addr;
+}
+
+int SOIL_internal_has_OGL_extension( const char *name )
+{
+	const char *extensions = (char const*)glGetString( GL_EXTENSIONS );
+	if( NULL != extensions )
+	{
+		/*	legacy (and compatibility) contexts, one big string	*/
+		return NULL != strstr( extensions, name );
+	} else
+	{
+		/*	core profile contexts only hand out one extension at a time	*/
+		GLint i, count = 0;
+		P_SOIL_GLGETSTRINGIPROC soilGlGetStringi =
+				(P_SOIL_GLGETSTRINGIPROC)
+				SOIL_internal_get_OGL_proc_address( "glGetStringi" );
+		/*	don't leave the GL_INVALID_ENUM from asking for the string behind	*/
+		glGetError();
+		if( NULL == soilGlGetStringi )
+		{
+			return 0;
+		}
+		glGetIntegerv( SOIL_NUM_EXTENSIONS, &count );
+		for( i = 0; i < count; ++i )
+		{
+			const char *extension = (char const*)soilGlGetStringi( GL_EXTENSIONS, i );
+			if( (NULL != extension) && (0 == strcmp( extension, name )) )
+			{
+				return 1;
+			}
+		}
+		return 0;
+	}
+}
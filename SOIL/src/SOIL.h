@@ -91,6 +91,10 @@ enum
 	SOIL_FLAG_NTSC_SAFE_RGB: clamps RGB components to the range [16,235]
 	SOIL_FLAG_CoCg_Y: Google YCoCg; RGB=>CoYCg, RGBA=>CoCgAY
 	SOIL_FLAG_TEXTURE_RECTANGE: uses ARB_texture_rectangle ; pixel indexed & no repeat or MIPmaps or cubemaps
+	SOIL_FLAG_GPU_MIPMAPS: like SOIL_FLAG_MIPMAPS, but allocates immutable storage (glTexStorage2D), uploads only
+		the full size image and has glGenerateMipmap build the rest, with no resizing to POT if NPOT is supported;
+		falls back to SOIL_FLAG_MIPMAPS for cubemaps, DXT compression or if the driver can't.  A reused texture
+		ID keeps the kind of storage it had; immutable ones only take the same size and format again
 **/
 enum
 {
@@ -103,7 +107,8 @@ enum
 	SOIL_FLAG_DDS_LOAD_DIRECT = 64,
 	SOIL_FLAG_NTSC_SAFE_RGB = 128,
 	SOIL_FLAG_CoCg_Y = 256,
-	SOIL_FLAG_TEXTURE_RECTANGLE = 512
+	SOIL_FLAG_TEXTURE_RECTANGLE = 512,
+	SOIL_FLAG_GPU_MIPMAPS = 1024
 };
 
 /**
@@ -241,6 +246,27 @@ unsigned int
 		unsigned int flags
 	);
 
+/**
+	Uploads a pre-compressed (DXT1/3/5) or uncompressed DDS file straight
+	into an OpenGL texture, along with any MIPmaps stored in the file.
+	Nothing is decoded on the CPU, so this fails (instead of falling back)
+	when the driver can't take S3TC data; check SOIL_last_result() and
+	load a regular image instead.
+	\param filename the name of the DDS file to upload as a texture
+	\param reuse_texture_ID 0-generate a new texture ID, otherwise reuse the texture ID (overwriting the old texture)
+	\param flags only SOIL_FLAG_TEXTURE_REPEATS is used
+	\param loading_as_cubemap 0-the file must hold a 2D texture, 1-the file must hold a cubemap
+	\return 0-failed, otherwise returns the OpenGL texture handle
+**/
+unsigned int
+	SOIL_direct_load_DDS
+	(
+		const char *filename,
+		unsigned int reuse_texture_ID,
+		int flags,
+		int loading_as_cubemap
+	);
+
 /**
 	Loads 6 images from memory into an OpenGL cubemap texture.
 	\param x_pos_buffer the image data in RAM to upload as the +x cube face
@@ -390,6 +416,67 @@ unsigned char*
 		int force_channels
 	);
 
+/**
+	Gets an image's width, height and channel count without decoding the
+	pixels (JPEG, PNG and TGA only read the header), e.g. to size the
+	buffer for SOIL_load_image_into.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	SOIL_image_info
+	(
+		const char *filename,
+		int *width, int *height, int *channels
+	);
+
+/**
+	Gets an image's width, height and channel count from memory without
+	decoding the pixels (JPEG, PNG and TGA only read the header).
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	SOIL_image_info_from_memory
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		int *width, int *height, int *channels
+	);
+
+/**
+	Loads an image from disk into a buffer you provide (one you reuse
+	between images, a mapped pixel unpack buffer...) instead of allocating
+	one.  It must hold width*height*force_channels bytes, or
+	width*height*channels with SOIL_LOAD_AUTO; SOIL_image_info gives you
+	those.  JPEG, PNG and TGA images are decoded straight into it.
+	\return 0 if failed (including the buffer being too small),
+	otherwise returns 1
+**/
+int
+	SOIL_load_image_into
+	(
+		const char *filename,
+		unsigned char *buffer,
+		int buffer_size,
+		int *width, int *height, int *channels,
+		int force_channels
+	);
+
+/**
+	Loads an image from memory into a buffer you provide, like
+	SOIL_load_image_into.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+	SOIL_load_image_from_memory_into
+	(
+		const unsigned char *const buffer,
+		int buffer_length,
+		unsigned char *image,
+		int image_size,
+		int *width, int *height, int *channels,
+		int force_channels
+	);
+
 /**
 	Saves an image from an array of unsigned chars (RGBA) to disk
 	\return 0 if failed, otherwise returns 1
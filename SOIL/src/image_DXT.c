@@ -8,11 +8,34 @@
 */
 
 #include "image_DXT.h"
+#include "image_helper.h"
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+#ifdef WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <pthread.h>
+	#include <unistd.h>
+#endif
+
+/*	SSE2 / AVX2 block compressors, picked at runtime (GCC and clang only,
+	everybody else just gets the plain C code)	*/
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define DXT_HAS_X86_SIMD	1
+	#include <immintrin.h>
+#else
+	#define DXT_HAS_X86_SIMD	0
+#endif
+
+/*	at most this many threads work on one image	*/
+#define DXT_MAX_THREADS	64
+/*	images with fewer 4x4 blocks than this are not worth a thread	*/
+#define DXT_MIN_BLOCKS_PER_THREAD	1024
+
 /*	set this =1 if you want to use the covarince matrix method...
 	which is better than my method of using standard deviations
 	overall, except on the infintesimal chance that the power
@@ -37,6 +60,38 @@ void compress_DDS_color_block(
 void compress_DDS_alpha_block(
 				const unsigned char *const uncompressed,
 				unsigned char compressed[8] );
+/*
+	Compresses every 4x4 block of an image into DXT1 (or DXT5),
+	spreading the block rows over a few threads for large images.
+*/
+void compress_DXT_image(
+				const unsigned char *const uncompressed,
+				int width, int height, int channels,
+				int DXT5,
+				unsigned char *compressed );
+
+/*	the color block compressor in use	*/
+typedef void (*DXT_color_block_proc)(
+				int channels,
+				const unsigned char *const uncompressed,
+				unsigned char compressed[8] );
+static DXT_color_block_proc compress_color_block = NULL;
+#if DXT_HAS_X86_SIMD
+/*
+	Same as compress_DDS_color_block(), bit for bit, but taking
+	4 (SSE2) or 8 (AVX2) pixels at a time.  4 channels only.
+*/
+void compress_DDS_color_block_SSE2(
+				int channels,
+				const unsigned char *const uncompressed,
+				unsigned char compressed[8] );
+void compress_DDS_color_block_AVX2(
+				int channels,
+				const unsigned char *const uncompressed,
+				unsigned char compressed[8] );
+#endif
+/*	0 means one thread per CPU	*/
+static int DXT_thread_count = 0;
 
 /********* Actual Exposed Functions *********/
 int
@@ -98,17 +153,114 @@ int
 	return 1;
 }
 
+int
+	save_image_as_DDS_with_MIPmaps
+	(
+		const char *filename,
+		int width, int height, int channels,
+		const unsigned char *const data
+	)
+{
+	/*	variables	*/
+	FILE *fout;
+	unsigned char *DDS_data;
+	unsigned char *level, *next_level;
+	DDS_header header;
+	int DDS_size, main_size = 0;
+	int level_width, level_height, level_count;
+	/*	error check	*/
+	if( (NULL == filename) ||
+		(width < 1) || (height < 1) ||
+		(channels < 1) || (channels > 4) ||
+		(data == NULL ) )
+	{
+		return 0;
+	}
+	/*	how many levels until both sides hit 1?	*/
+	level_count = 1;
+	while( ((width >> level_count) > 0) || ((height >> level_count) > 0) )
+	{
+		++level_count;
+	}
+	fout = fopen( filename, "wb");
+	if( NULL == fout )
+	{
+		return 0;
+	}
+	/*	the linear size is only known after compressing level 0,
+		so write a placeholder header now and patch it at the end	*/
+	memset( &header, 0, sizeof( DDS_header ) );
+	fwrite( &header, sizeof( DDS_header ), 1, fout );
+	/*	compress and write out every level,
+		each one is box filtered from the previous one	*/
+	level = (unsigned char*)malloc( width*height*channels );
+	memcpy( level, data, width*height*channels );
+	level_width = width;
+	level_height = height;
+	for( ;; )
+	{
+		if( (channels & 1) == 1 )
+		{
+			DDS_data = convert_image_to_DXT1( level, level_width, level_height, channels, &DDS_size );
+		} else
+		{
+			DDS_data = convert_image_to_DXT5( level, level_width, level_height, channels, &DDS_size );
+		}
+		if( main_size == 0 )
+		{
+			main_size = DDS_size;
+		}
+		fwrite( DDS_data, 1, DDS_size, fout );
+		free( DDS_data );
+		if( (level_width == 1) && (level_height == 1) )
+		{
+			break;
+		}
+		/*	prep for the next level	*/
+		next_level = (unsigned char*)malloc(
+				((level_width+1)/2) * ((level_height+1)/2) * channels );
+		mipmap_image(
+				level, level_width, level_height, channels,
+				next_level,
+				(level_width > 1) ? 2 : 1, (level_height > 1) ? 2 : 1 );
+		free( level );
+		level = next_level;
+		level_width = (level_width > 1) ? level_width / 2 : 1;
+		level_height = (level_height > 1) ? level_height / 2 : 1;
+	}
+	free( level );
+	/*	now fill in the header for real	*/
+	header.dwMagic = ('D' << 0) | ('D' << 8) | ('S' << 16) | (' ' << 24);
+	header.dwSize = 124;
+	header.dwFlags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT |
+			DDSD_LINEARSIZE | DDSD_MIPMAPCOUNT;
+	header.dwWidth = width;
+	header.dwHeight = height;
+	header.dwPitchOrLinearSize = main_size;
+	header.dwMipMapCount = level_count;
+	header.sPixelFormat.dwSize = 32;
+	header.sPixelFormat.dwFlags = DDPF_FOURCC;
+	if( (channels & 1) == 1 )
+	{
+		header.sPixelFormat.dwFourCC = ('D' << 0) | ('X' << 8) | ('T' << 16) | ('1' << 24);
+	} else
+	{
+		header.sPixelFormat.dwFourCC = ('D' << 0) | ('X' << 8) | ('T' << 16) | ('5' << 24);
+	}
+	header.sCaps.dwCaps1 = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+	fseek( fout, 0, SEEK_SET );
+	fwrite( &header, sizeof( DDS_header ), 1, fout );
+	fclose( fout );
+	/*	done	*/
+	return 1;
+}
+
 unsigned char* convert_image_to_DXT1(
 		const unsigned char *const uncompressed,
 		int width, int height, int channels,
 		int *out_size )
 {
 	unsigned char *compressed;
-	int i, j, x, y;
-	unsigned char ublock[16*3];
-	unsigned char cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0;
 	/*	error check	*/
 	*out_size = 0;
 	if( (width < 1) || (height < 1) ||
@@ -117,65 +269,12 @@ unsigned char* convert_image_to_DXT1(
 	{
 		return NULL;
 	}
-	/*	for channels == 1 or 2, I do not step forward for R,G,B values	*/
-	if( channels < 3 )
-	{
-		chan_step = 0;
-	}
 	/*	get the RAM for the compressed image
 		(8 bytes per 4x4 pixel block)	*/
 	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 8;
 	compressed = (unsigned char*)malloc( *out_size );
 	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
-	{
-		for( i = 0; i < width; i += 4 )
-		{
-			/*	copy this block into a new one	*/
-			int idx = 0;
-			int mx = 4, my = 4;
-			if( j+4 >= height )
-			{
-				my = height - j;
-			}
-			if( i+4 >= width )
-			{
-				mx = width - i;
-			}
-			for( y = 0; y < my; ++y )
-			{
-				for( x = 0; x < mx; ++x )
-				{
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step+chan_step];
-				}
-				for( x = mx; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-				}
-			}
-			for( y = my; y < 4; ++y )
-			{
-				for( x = 0; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-				}
-			}
-			/*	compress the block	*/
-			++block_count;
-			compress_DDS_color_block( 3, ublock, cblock );
-			/*	copy the data from the block into the main block	*/
-			for( x = 0; x < 8; ++x )
-			{
-				compressed[index++] = cblock[x];
-			}
-		}
-	}
+	compress_DXT_image( uncompressed, width, height, channels, 0, compressed );
 	return compressed;
 }
 
@@ -185,11 +284,6 @@ unsigned char* convert_image_to_DXT5(
 		int *out_size )
 {
 	unsigned char *compressed;
-	int i, j, x, y;
-	unsigned char ublock[16*4];
-	unsigned char cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0, has_alpha;
 	/*	error check	*/
 	*out_size = 0;
 	if( (width < 1) || (height < 1) ||
@@ -198,23 +292,101 @@ unsigned char* convert_image_to_DXT5(
 	{
 		return NULL;
 	}
-	/*	for channels == 1 or 2, I do not step forward for R,G,B vales	*/
+	/*	get the RAM for the compressed image
+		(16 bytes per 4x4 pixel block)	*/
+	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 16;
+	compressed = (unsigned char*)malloc( *out_size );
+	/*	go through each block	*/
+	compress_DXT_image( uncompressed, width, height, channels, 1, compressed );
+	return compressed;
+}
+
+int set_DXT_SIMD_level( int level )
+{
+	int best = DXT_SIMD_NONE;
+	#if DXT_HAS_X86_SIMD
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports( "sse2" ) )
+	{
+		best = DXT_SIMD_SSE2;
+	}
+	if( __builtin_cpu_supports( "avx2" ) )
+	{
+		best = DXT_SIMD_AVX2;
+	}
+	#endif
+	/*	a block is only 16 pixels, which barely fills two AVX2 registers,
+		and that doesn't beat SSE2 (see bench/dxt.cpp), so only use it when asked	*/
+	if( level == DXT_SIMD_AUTO )
+	{
+		level = DXT_SIMD_SSE2;
+	}
+	/*	can't go any higher than the CPU lets me	*/
+	if( level > best )
+	{
+		level = best;
+	}
+	switch( level )
+	{
+	#if DXT_HAS_X86_SIMD
+	case DXT_SIMD_AVX2:
+		compress_color_block = compress_DDS_color_block_AVX2;
+		break;
+	case DXT_SIMD_SSE2:
+		compress_color_block = compress_DDS_color_block_SSE2;
+		break;
+	#endif
+	default:
+		level = DXT_SIMD_NONE;
+		compress_color_block = compress_DDS_color_block;
+		break;
+	}
+	return level;
+}
+
+void set_DXT_thread_count( int threads )
+{
+	DXT_thread_count = (threads < 0) ? 0 : threads;
+}
+
+/********* Block Row Workers *********/
+typedef struct
+{
+	const unsigned char *uncompressed;
+	int width, height, channels;
+	int DXT5;
+	unsigned char *compressed;
+	/*	the block rows [first, end) this job takes care of	*/
+	int first_block_row, end_block_row;
+}
+DXT_job;
+
+void compress_DXT_block_rows( const DXT_job *job )
+{
+	const unsigned char *const uncompressed = job->uncompressed;
+	const int width = job->width, height = job->height, channels = job->channels;
+	const int block_bytes = job->DXT5 ? 16 : 8;
+	int i, j, x, y;
+	/*	always 4 channels, so every color block compressor can take it	*/
+	unsigned char ublock[16*4];
+	unsigned char *out;
+	int chan_step = 1;
+	int has_alpha;
+	/*	for channels == 1 or 2, I do not step forward for R,G,B values	*/
 	if( channels < 3 )
 	{
 		chan_step = 0;
 	}
 	/*	# channels = 1 or 3 have no alpha, 2 & 4 do have alpha	*/
 	has_alpha = 1 - (channels & 1);
-	/*	get the RAM for the compressed image
-		(16 bytes per 4x4 pixel block)	*/
-	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 16;
-	compressed = (unsigned char*)malloc( *out_size );
-	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
+	/*	each block row is a fixed size, so jobs never overlap	*/
+	out = job->compressed +
+			job->first_block_row * ((width+3) >> 2) * block_bytes;
+	for( j = job->first_block_row*4; j < job->end_block_row*4; j += 4 )
 	{
 		for( i = 0; i < width; i += 4 )
 		{
-			/*	local variables, and my block counter	*/
+			/*	copy this block into a new one	*/
 			int idx = 0;
 			int mx = 4, my = 4;
 			if( j+4 >= height )
@@ -254,24 +426,124 @@ unsigned char* convert_image_to_DXT5(
 					ublock[idx++] = ublock[3];
 				}
 			}
-			/*	now compress the alpha block	*/
-			compress_DDS_alpha_block( ublock, cblock );
-			/*	copy the data from the compressed alpha block into the main buffer	*/
-			for( x = 0; x < 8; ++x )
+			/*	DXT5 starts with the alpha block	*/
+			if( job->DXT5 )
 			{
-				compressed[index++] = cblock[x];
-			}
-			/*	then compress the color block	*/
-			++block_count;
-			compress_DDS_color_block( 4, ublock, cblock );
-			/*	copy the data from the compressed color block into the main buffer	*/
-			for( x = 0; x < 8; ++x )
-			{
-				compressed[index++] = cblock[x];
+				compress_DDS_alpha_block( ublock, out );
+				out += 8;
 			}
+			/*	then the color block	*/
+			compress_color_block( 4, ublock, out );
+			out += 8;
+		}
+	}
+}
+
+#ifdef WIN32
+static DWORD WINAPI DXT_thread_main( LPVOID job )
+#else
+static void *DXT_thread_main( void *job )
+#endif
+{
+	compress_DXT_block_rows( (const DXT_job*)job );
+	return 0;
+}
+
+static int DXT_CPU_count( void )
+{
+	#ifdef WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+	return (int)info.dwNumberOfProcessors;
+	#else
+	long count = sysconf( _SC_NPROCESSORS_ONLN );
+	return (count > 0) ? (int)count : 1;
+	#endif
+}
+
+void compress_DXT_image(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int DXT5,
+		unsigned char *compressed )
+{
+	DXT_job jobs[DXT_MAX_THREADS];
+	#ifdef WIN32
+	HANDLE handles[DXT_MAX_THREADS];
+	#else
+	pthread_t handles[DXT_MAX_THREADS];
+	#endif
+	int started[DXT_MAX_THREADS];
+	int block_rows = (height+3) >> 2;
+	int blocks = block_rows * ((width+3) >> 2);
+	int threads, t;
+	/*	first time through?  pick the best compressor for this CPU	*/
+	if( NULL == compress_color_block )
+	{
+		set_DXT_SIMD_level( DXT_SIMD_AUTO );
+	}
+	/*	how many threads are worth it?	*/
+	threads = DXT_thread_count;
+	if( threads == 0 )
+	{
+		threads = DXT_CPU_count();
+	}
+	if( threads > blocks / DXT_MIN_BLOCKS_PER_THREAD )
+	{
+		threads = blocks / DXT_MIN_BLOCKS_PER_THREAD;
+	}
+	if( threads > block_rows )
+	{
+		threads = block_rows;
+	}
+	if( threads > DXT_MAX_THREADS )
+	{
+		threads = DXT_MAX_THREADS;
+	}
+	if( threads < 1 )
+	{
+		threads = 1;
+	}
+	/*	hand out the block rows as evenly as possible	*/
+	for( t = 0; t < threads; ++t )
+	{
+		jobs[t].uncompressed = uncompressed;
+		jobs[t].width = width;
+		jobs[t].height = height;
+		jobs[t].channels = channels;
+		jobs[t].DXT5 = DXT5;
+		jobs[t].compressed = compressed;
+		jobs[t].first_block_row = block_rows * t / threads;
+		jobs[t].end_block_row = block_rows * (t+1) / threads;
+	}
+	/*	the calling thread does the 1st job itself	*/
+	for( t = 1; t < threads; ++t )
+	{
+		#ifdef WIN32
+		handles[t] = CreateThread( NULL, 0, DXT_thread_main, &jobs[t], 0, NULL );
+		started[t] = (handles[t] != NULL);
+		#else
+		started[t] = (pthread_create( &handles[t], NULL, DXT_thread_main, &jobs[t] ) == 0);
+		#endif
+		if( !started[t] )
+		{
+			/*	no thread for you, do it here then	*/
+			compress_DXT_block_rows( &jobs[t] );
+		}
+	}
+	compress_DXT_block_rows( &jobs[0] );
+	for( t = 1; t < threads; ++t )
+	{
+		if( started[t] )
+		{
+			#ifdef WIN32
+			WaitForSingleObject( handles[t], INFINITE );
+			CloseHandle( handles[t] );
+			#else
+			pthread_join( handles[t], NULL );
+			#endif
 		}
 	}
-	return compressed;
 }
 
 /********* Helper Functions *********/
@@ -296,30 +568,20 @@ void rgb_888_from_565( unsigned int c, int *r, int *g, int *b )
 	*b = convert_bit_range( (c >> 00) & 31, 5, 8 );
 }
 
-void compute_color_line_STDEV(
-		const unsigned char *const uncompressed,
-		int channels,
+/*
+	The sums are all of whole numbers below 2^24, so they come out
+	exactly the same in any order; everything after them is shared
+	by the plain C and SIMD block compressors, so those match too.
+	sums: r, g, b, rr, gg, bb, rg, rb, gb
+*/
+void color_line_from_sums(
+		const float sums[9],
 		float point[3], float direction[3] )
 {
 	const float inv_16 = 1.0f / 16.0f;
-	int i;
-	float sum_r = 0.0f, sum_g = 0.0f, sum_b = 0.0f;
-	float sum_rr = 0.0f, sum_gg = 0.0f, sum_bb = 0.0f;
-	float sum_rg = 0.0f, sum_rb = 0.0f, sum_gb = 0.0f;
-	/*	calculate all data needed for the covariance matrix
-		( to compare with _rygdxt code)	*/
-	for( i = 0; i < 16*channels; i += channels )
-	{
-		sum_r += uncompressed[i+0];
-		sum_rr += uncompressed[i+0] * uncompressed[i+0];
-		sum_g += uncompressed[i+1];
-		sum_gg += uncompressed[i+1] * uncompressed[i+1];
-		sum_b += uncompressed[i+2];
-		sum_bb += uncompressed[i+2] * uncompressed[i+2];
-		sum_rg += uncompressed[i+0] * uncompressed[i+1];
-		sum_rb += uncompressed[i+0] * uncompressed[i+2];
-		sum_gb += uncompressed[i+1] * uncompressed[i+2];
-	}
+	float sum_r = sums[0], sum_g = sums[1], sum_b = sums[2];
+	float sum_rr = sums[3], sum_gg = sums[4], sum_bb = sums[5];
+	float sum_rg = sums[6], sum_rb = sums[7], sum_gb = sums[8];
 	/*	convert the sums to averages	*/
 	sum_r *= inv_16;
 	sum_g *= inv_16;
@@ -408,54 +670,48 @@ void compute_color_line_STDEV(
 	#endif
 }
 
-void LSE_master_colors_max_min(
-		int *cmax, int *cmin,
+void compute_color_line_STDEV(
+		const unsigned char *const uncompressed,
 		int channels,
-		const unsigned char *const uncompressed )
+		float point[3], float direction[3] )
+{
+	int i;
+	float sums[9] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	/*	calculate all data needed for the covariance matrix
+		( to compare with _rygdxt code)	*/
+	for( i = 0; i < 16*channels; i += channels )
+	{
+		sums[0] += uncompressed[i+0];
+		sums[3] += uncompressed[i+0] * uncompressed[i+0];
+		sums[1] += uncompressed[i+1];
+		sums[4] += uncompressed[i+1] * uncompressed[i+1];
+		sums[2] += uncompressed[i+2];
+		sums[5] += uncompressed[i+2] * uncompressed[i+2];
+		sums[6] += uncompressed[i+0] * uncompressed[i+1];
+		sums[7] += uncompressed[i+0] * uncompressed[i+2];
+		sums[8] += uncompressed[i+1] * uncompressed[i+2];
+	}
+	color_line_from_sums( sums, point, direction );
+}
+
+/*
+	Given the color line and the extent of the block's colors along it,
+	builds the 2 master colors (cmax > cmin, both 565)
+*/
+void master_colors_from_line(
+		const float point[3], const float direction[3],
+		float dot_min, float dot_max,
+		int *cmax, int *cmin )
 {
 	int i, j;
 	/*	the master colors	*/
 	int c0[3], c1[3];
-	/*	used for fitting the line	*/
-	float sum_x[] = { 0.0f, 0.0f, 0.0f };
-	float sum_x2[] = { 0.0f, 0.0f, 0.0f };
-	float dot_max = 1.0f, dot_min = -1.0f;
 	float vec_len2 = 0.0f;
 	float dot;
-	/*	error check	*/
-	if( (channels < 3) || (channels > 4) )
-	{
-		return;
-	}
-	compute_color_line_STDEV( uncompressed, channels, sum_x, sum_x2 );
 	vec_len2 = 1.0f / ( 0.00001f +
-			sum_x2[0]*sum_x2[0] + sum_x2[1]*sum_x2[1] + sum_x2[2]*sum_x2[2] );
-	/*	finding the max and min vector values	*/
-	dot_max =
-			(
-				sum_x2[0] * uncompressed[0] +
-				sum_x2[1] * uncompressed[1] +
-				sum_x2[2] * uncompressed[2]
-			);
-	dot_min = dot_max;
-	for( i = 1; i < 16; ++i )
-	{
-		dot =
-			(
-				sum_x2[0] * uncompressed[i*channels+0] +
-				sum_x2[1] * uncompressed[i*channels+1] +
-				sum_x2[2] * uncompressed[i*channels+2]
-			);
-		if( dot < dot_min )
-		{
-			dot_min = dot;
-		} else if( dot > dot_max )
-		{
-			dot_max = dot;
-		}
-	}
+			direction[0]*direction[0] + direction[1]*direction[1] + direction[2]*direction[2] );
 	/*	and the offset (from the average location)	*/
-	dot = sum_x2[0]*sum_x[0] + sum_x2[1]*sum_x[1] + sum_x2[2]*sum_x[2];
+	dot = direction[0]*point[0] + direction[1]*point[1] + direction[2]*point[2];
 	dot_min -= dot;
 	dot_max -= dot;
 	/*	post multiply by the scaling factor	*/
@@ -465,7 +721,7 @@ void LSE_master_colors_max_min(
 	for( i = 0; i < 3; ++i )
 	{
 		/*	color 0	*/
-		c0[i] = (int)(0.5f + sum_x[i] + dot_max * sum_x2[i]);
+		c0[i] = (int)(0.5f + point[i] + dot_max * direction[i]);
 		if( c0[i] < 0 )
 		{
 			c0[i] = 0;
@@ -474,7 +730,7 @@ void LSE_master_colors_max_min(
 			c0[i] = 255;
 		}
 		/*	color 1	*/
-		c1[i] = (int)(0.5f + sum_x[i] + dot_min * sum_x2[i]);
+		c1[i] = (int)(0.5f + point[i] + dot_min * direction[i]);
 		if( c1[i] < 0 )
 		{
 			c1[i] = 0;
@@ -497,25 +753,62 @@ void LSE_master_colors_max_min(
 	}
 }
 
-void
-	compress_DDS_color_block
-	(
+void LSE_master_colors_max_min(
+		int *cmax, int *cmin,
 		int channels,
-		const unsigned char *const uncompressed,
-		unsigned char compressed[8]
-	)
+		const unsigned char *const uncompressed )
+{
+	int i;
+	/*	used for fitting the line	*/
+	float sum_x[] = { 0.0f, 0.0f, 0.0f };
+	float sum_x2[] = { 0.0f, 0.0f, 0.0f };
+	float dot_max = 1.0f, dot_min = -1.0f;
+	float dot;
+	/*	error check	*/
+	if( (channels < 3) || (channels > 4) )
+	{
+		return;
+	}
+	compute_color_line_STDEV( uncompressed, channels, sum_x, sum_x2 );
+	/*	finding the max and min vector values	*/
+	dot_max =
+			(
+				sum_x2[0] * uncompressed[0] +
+				sum_x2[1] * uncompressed[1] +
+				sum_x2[2] * uncompressed[2]
+			);
+	dot_min = dot_max;
+	for( i = 1; i < 16; ++i )
+	{
+		dot =
+			(
+				sum_x2[0] * uncompressed[i*channels+0] +
+				sum_x2[1] * uncompressed[i*channels+1] +
+				sum_x2[2] * uncompressed[i*channels+2]
+			);
+		if( dot < dot_min )
+		{
+			dot_min = dot;
+		} else if( dot > dot_max )
+		{
+			dot_max = dot;
+		}
+	}
+	master_colors_from_line( sum_x, sum_x2, dot_min, dot_max, cmax, cmin );
+}
+
+/*
+	Stores the master colors and sets up the line the
+	pixels get projected on (scaled so it runs [0,1])
+*/
+void DDS_color_line_from_master_colors(
+		int enc_c0, int enc_c1,
+		unsigned char compressed[8],
+		float color_line[3], float *dot_offset )
 {
-	/*	variables	*/
 	int i;
-	int next_bit;
-	int enc_c0, enc_c1;
 	int c0[4], c1[4];
-	float color_line[] = { 0.0f, 0.0f, 0.0f, 0.0f };
-	float vec_len2 = 0.0f, dot_offset = 0.0f;
-	/*	stupid order	*/
-	int swizzle4[] = { 0, 2, 3, 1 };
-	/*	get the master colors	*/
-	LSE_master_colors_max_min( &enc_c0, &enc_c1, channels, uncompressed );
+	float vec_len2 = 0.0f;
 	/*	store the 565 color 0 and color 1	*/
 	compressed[0] = (enc_c0 >> 0) & 255;
 	compressed[1] = (enc_c0 >> 8) & 255;
@@ -545,7 +838,29 @@ void
 	color_line[1] *= vec_len2;
 	color_line[2] *= vec_len2;
 	/*	compute the offset (constant) portion of the dot product	*/
-	dot_offset = color_line[0]*c0[0] + color_line[1]*c0[1] + color_line[2]*c0[2];
+	*dot_offset = color_line[0]*c0[0] + color_line[1]*c0[1] + color_line[2]*c0[2];
+}
+
+void
+	compress_DDS_color_block
+	(
+		int channels,
+		const unsigned char *const uncompressed,
+		unsigned char compressed[8]
+	)
+{
+	/*	variables	*/
+	int i;
+	int next_bit;
+	int enc_c0, enc_c1;
+	float color_line[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float dot_offset = 0.0f;
+	/*	stupid order	*/
+	int swizzle4[] = { 0, 2, 3, 1 };
+	/*	get the master colors	*/
+	LSE_master_colors_max_min( &enc_c0, &enc_c1, channels, uncompressed );
+	/*	store them, and get the line to place the pixels on	*/
+	DDS_color_line_from_master_colors( enc_c0, enc_c1, compressed, color_line, &dot_offset );
 	/*	store the rest of the bits	*/
 	next_bit = 8*4;
 	for( i = 0; i < 16; ++i )
@@ -574,6 +889,255 @@ void
 	/*	done compressing to DXT1	*/
 }
 
+#if DXT_HAS_X86_SIMD
+/*	packs the 16 color indices (already clamped to [0,3])	*/
+static void store_DDS_color_indices( const int values[16], unsigned char compressed[8] )
+{
+	/*	stupid order	*/
+	static const int swizzle4[] = { 0, 2, 3, 1 };
+	int i;
+	for( i = 0; i < 4; ++i )
+	{
+		compressed[4+i] = (unsigned char)(
+				(swizzle4[ values[i*4+0] ] << 0) |
+				(swizzle4[ values[i*4+1] ] << 2) |
+				(swizzle4[ values[i*4+2] ] << 4) |
+				(swizzle4[ values[i*4+3] ] << 6) );
+	}
+}
+
+__attribute__((target("sse2")))
+static float hsum_SSE2( __m128 v )
+{
+	float f[4];
+	_mm_storeu_ps( f, v );
+	return (f[0] + f[1]) + (f[2] + f[3]);
+}
+
+__attribute__((target("sse2")))
+void compress_DDS_color_block_SSE2(
+		int channels,
+		const unsigned char *const uncompressed,
+		unsigned char compressed[8] )
+{
+	const __m128i mask = _mm_set1_epi32( 0xFF );
+	__m128 r[4], g[4], b[4];
+	__m128 acc[9];
+	__m128 dmin, dmax;
+	float sums[9], point[3], direction[3];
+	float color_line[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float dot_offset = 0.0f, f[4], dot_min, dot_max;
+	int values[16];
+	int enc_c0, enc_c1;
+	int i, k;
+	if( channels != 4 )
+	{
+		compress_DDS_color_block( channels, uncompressed, compressed );
+		return;
+	}
+	/*	split the 16 RGBA pixels into R, G and B, 4 at a time	*/
+	for( i = 0; i < 4; ++i )
+	{
+		__m128i px = _mm_loadu_si128( (const __m128i*)(uncompressed + 16*i) );
+		r[i] = _mm_cvtepi32_ps( _mm_and_si128( px, mask ) );
+		g[i] = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( px, 8 ), mask ) );
+		b[i] = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( px, 16 ), mask ) );
+	}
+	/*	the covariance sums	*/
+	for( k = 0; k < 9; ++k )
+	{
+		acc[k] = _mm_setzero_ps();
+	}
+	for( i = 0; i < 4; ++i )
+	{
+		acc[0] = _mm_add_ps( acc[0], r[i] );
+		acc[1] = _mm_add_ps( acc[1], g[i] );
+		acc[2] = _mm_add_ps( acc[2], b[i] );
+		acc[3] = _mm_add_ps( acc[3], _mm_mul_ps( r[i], r[i] ) );
+		acc[4] = _mm_add_ps( acc[4], _mm_mul_ps( g[i], g[i] ) );
+		acc[5] = _mm_add_ps( acc[5], _mm_mul_ps( b[i], b[i] ) );
+		acc[6] = _mm_add_ps( acc[6], _mm_mul_ps( r[i], g[i] ) );
+		acc[7] = _mm_add_ps( acc[7], _mm_mul_ps( r[i], b[i] ) );
+		acc[8] = _mm_add_ps( acc[8], _mm_mul_ps( g[i], b[i] ) );
+	}
+	for( k = 0; k < 9; ++k )
+	{
+		sums[k] = hsum_SSE2( acc[k] );
+	}
+	color_line_from_sums( sums, point, direction );
+	/*	the extent of the colors along that line	*/
+	{
+		const __m128 d0 = _mm_set1_ps( direction[0] );
+		const __m128 d1 = _mm_set1_ps( direction[1] );
+		const __m128 d2 = _mm_set1_ps( direction[2] );
+		for( i = 0; i < 4; ++i )
+		{
+			__m128 dot = _mm_add_ps(
+					_mm_add_ps( _mm_mul_ps( d0, r[i] ), _mm_mul_ps( d1, g[i] ) ),
+					_mm_mul_ps( d2, b[i] ) );
+			dmin = (i == 0) ? dot : _mm_min_ps( dmin, dot );
+			dmax = (i == 0) ? dot : _mm_max_ps( dmax, dot );
+		}
+	}
+	_mm_storeu_ps( f, dmin );
+	dot_min = f[0];
+	for( i = 1; i < 4; ++i )
+	{
+		dot_min = (f[i] < dot_min) ? f[i] : dot_min;
+	}
+	_mm_storeu_ps( f, dmax );
+	dot_max = f[0];
+	for( i = 1; i < 4; ++i )
+	{
+		dot_max = (f[i] > dot_max) ? f[i] : dot_max;
+	}
+	master_colors_from_line( point, direction, dot_min, dot_max, &enc_c0, &enc_c1 );
+	DDS_color_line_from_master_colors( enc_c0, enc_c1, compressed, color_line, &dot_offset );
+	/*	and place every pixel on the line	*/
+	{
+		const __m128 l0 = _mm_set1_ps( color_line[0] );
+		const __m128 l1 = _mm_set1_ps( color_line[1] );
+		const __m128 l2 = _mm_set1_ps( color_line[2] );
+		const __m128 offset = _mm_set1_ps( dot_offset );
+		const __m128 three = _mm_set1_ps( 3.0f );
+		const __m128 half = _mm_set1_ps( 0.5f );
+		const __m128i zero_i = _mm_setzero_si128();
+		const __m128i three_i = _mm_set1_epi32( 3 );
+		for( i = 0; i < 4; ++i )
+		{
+			__m128 dot = _mm_sub_ps(
+					_mm_add_ps(
+						_mm_add_ps( _mm_mul_ps( l0, r[i] ), _mm_mul_ps( l1, g[i] ) ),
+						_mm_mul_ps( l2, b[i] ) ),
+					offset );
+			__m128i v = _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( dot, three ), half ) );
+			__m128i over;
+			/*	clamp to [0,3] (no epi32 min/max in SSE2)	*/
+			v = _mm_and_si128( v, _mm_cmpgt_epi32( v, zero_i ) );
+			over = _mm_cmpgt_epi32( v, three_i );
+			v = _mm_or_si128( _mm_andnot_si128( over, v ), _mm_and_si128( over, three_i ) );
+			_mm_storeu_si128( (__m128i*)&values[i*4], v );
+		}
+	}
+	store_DDS_color_indices( values, compressed );
+}
+
+__attribute__((target("avx2")))
+static float hsum_AVX2( __m256 v )
+{
+	float f[8];
+	_mm256_storeu_ps( f, v );
+	return ((f[0] + f[1]) + (f[2] + f[3])) + ((f[4] + f[5]) + (f[6] + f[7]));
+}
+
+__attribute__((target("avx2")))
+void compress_DDS_color_block_AVX2(
+		int channels,
+		const unsigned char *const uncompressed,
+		unsigned char compressed[8] )
+{
+	const __m256i mask = _mm256_set1_epi32( 0xFF );
+	__m256 r[2], g[2], b[2];
+	__m256 acc[9];
+	__m256 dmin, dmax;
+	float sums[9], point[3], direction[3];
+	float color_line[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float dot_offset = 0.0f, f[8], dot_min, dot_max;
+	int values[16];
+	int enc_c0, enc_c1;
+	int i, k;
+	if( channels != 4 )
+	{
+		compress_DDS_color_block( channels, uncompressed, compressed );
+		return;
+	}
+	/*	split the 16 RGBA pixels into R, G and B, 8 at a time	*/
+	for( i = 0; i < 2; ++i )
+	{
+		__m256i px = _mm256_loadu_si256( (const __m256i*)(uncompressed + 32*i) );
+		r[i] = _mm256_cvtepi32_ps( _mm256_and_si256( px, mask ) );
+		g[i] = _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_srli_epi32( px, 8 ), mask ) );
+		b[i] = _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_srli_epi32( px, 16 ), mask ) );
+	}
+	/*	the covariance sums	*/
+	for( k = 0; k < 9; ++k )
+	{
+		acc[k] = _mm256_setzero_ps();
+	}
+	for( i = 0; i < 2; ++i )
+	{
+		acc[0] = _mm256_add_ps( acc[0], r[i] );
+		acc[1] = _mm256_add_ps( acc[1], g[i] );
+		acc[2] = _mm256_add_ps( acc[2], b[i] );
+		acc[3] = _mm256_add_ps( acc[3], _mm256_mul_ps( r[i], r[i] ) );
+		acc[4] = _mm256_add_ps( acc[4], _mm256_mul_ps( g[i], g[i] ) );
+		acc[5] = _mm256_add_ps( acc[5], _mm256_mul_ps( b[i], b[i] ) );
+		acc[6] = _mm256_add_ps( acc[6], _mm256_mul_ps( r[i], g[i] ) );
+		acc[7] = _mm256_add_ps( acc[7], _mm256_mul_ps( r[i], b[i] ) );
+		acc[8] = _mm256_add_ps( acc[8], _mm256_mul_ps( g[i], b[i] ) );
+	}
+	for( k = 0; k < 9; ++k )
+	{
+		sums[k] = hsum_AVX2( acc[k] );
+	}
+	/*	(clean the upper halves before calling into SSE code, or pay for it)	*/
+	_mm256_zeroupper();
+	color_line_from_sums( sums, point, direction );
+	/*	the extent of the colors along that line	*/
+	{
+		const __m256 d0 = _mm256_set1_ps( direction[0] );
+		const __m256 d1 = _mm256_set1_ps( direction[1] );
+		const __m256 d2 = _mm256_set1_ps( direction[2] );
+		__m256 dot0 = _mm256_add_ps(
+				_mm256_add_ps( _mm256_mul_ps( d0, r[0] ), _mm256_mul_ps( d1, g[0] ) ),
+				_mm256_mul_ps( d2, b[0] ) );
+		__m256 dot1 = _mm256_add_ps(
+				_mm256_add_ps( _mm256_mul_ps( d0, r[1] ), _mm256_mul_ps( d1, g[1] ) ),
+				_mm256_mul_ps( d2, b[1] ) );
+		dmin = _mm256_min_ps( dot0, dot1 );
+		dmax = _mm256_max_ps( dot0, dot1 );
+	}
+	_mm256_storeu_ps( f, dmin );
+	dot_min = f[0];
+	for( i = 1; i < 8; ++i )
+	{
+		dot_min = (f[i] < dot_min) ? f[i] : dot_min;
+	}
+	_mm256_storeu_ps( f, dmax );
+	dot_max = f[0];
+	for( i = 1; i < 8; ++i )
+	{
+		dot_max = (f[i] > dot_max) ? f[i] : dot_max;
+	}
+	_mm256_zeroupper();
+	master_colors_from_line( point, direction, dot_min, dot_max, &enc_c0, &enc_c1 );
+	DDS_color_line_from_master_colors( enc_c0, enc_c1, compressed, color_line, &dot_offset );
+	/*	and place every pixel on the line	*/
+	{
+		const __m256 l0 = _mm256_set1_ps( color_line[0] );
+		const __m256 l1 = _mm256_set1_ps( color_line[1] );
+		const __m256 l2 = _mm256_set1_ps( color_line[2] );
+		const __m256 offset = _mm256_set1_ps( dot_offset );
+		const __m256 three = _mm256_set1_ps( 3.0f );
+		const __m256 half = _mm256_set1_ps( 0.5f );
+		for( i = 0; i < 2; ++i )
+		{
+			__m256 dot = _mm256_sub_ps(
+					_mm256_add_ps(
+						_mm256_add_ps( _mm256_mul_ps( l0, r[i] ), _mm256_mul_ps( l1, g[i] ) ),
+						_mm256_mul_ps( l2, b[i] ) ),
+					offset );
+			__m256i v = _mm256_cvttps_epi32( _mm256_add_ps( _mm256_mul_ps( dot, three ), half ) );
+			v = _mm256_max_epi32( v, _mm256_setzero_si256() );
+			v = _mm256_min_epi32( v, _mm256_set1_epi32( 3 ) );
+			_mm256_storeu_si256( (__m256i*)&values[i*8], v );
+		}
+	}
+	_mm256_zeroupper();
+	store_DDS_color_indices( values, compressed );
+}
+#endif
+
 void
 	compress_DDS_alpha_block
 	(
@@ -10,6 +10,10 @@
 #ifndef HEADER_IMAGE_DXT
 #define HEADER_IMAGE_DXT
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /**
 	Converts an image from an array of unsigned chars (RGB or RGBA) to
 	DXT1 or DXT5, then saves the converted image to disk.
@@ -23,6 +27,20 @@ save_image_as_DDS
     const unsigned char *const data
 );
 
+/**
+	Converts an image from an array of unsigned chars (RGB or RGBA) to
+	DXT1 or DXT5, builds the full MIPmap chain down to 1x1 (each level
+	is compressed separately), then saves all of it to disk.
+	\return 0 if failed, otherwise returns 1
+**/
+int
+save_image_as_DDS_with_MIPmaps
+(
+    const char *filename,
+    int width, int height, int channels,
+    const unsigned char *const data
+);
+
 /**
 	take an image and convert it to DXT1 (no alpha)
 **/
@@ -45,6 +63,41 @@ convert_image_to_DXT5
     int *out_size
 );
 
+/**
+	The instruction sets the block compressors can use.
+	Every one of them produces exactly the same output.
+**/
+enum
+{
+	DXT_SIMD_AUTO = -1,
+	DXT_SIMD_NONE = 0,
+	DXT_SIMD_SSE2 = 1,
+	DXT_SIMD_AVX2 = 2
+};
+
+/**
+	Picks the instruction set the DXT compressors use.  DXT_SIMD_AUTO
+	(the default) takes SSE2 if this CPU has it; AVX2 is only used when
+	asked for.  Asking for one the CPU lacks falls back to the next best.
+	\return the level now in use
+**/
+int
+set_DXT_SIMD_level
+(
+    int level
+);
+
+/**
+	Sets how many threads the block rows of an image are spread
+	over, 0 (the default) means one per CPU.  Small images are
+	always compressed on the calling thread.
+**/
+void
+set_DXT_thread_count
+(
+    int threads
+);
+
 /**	A bunch of DirectDraw Surface structures and flags **/
 typedef struct
 {
@@ -120,4 +173,8 @@ DDS_header ;
 #define DDSCAPS2_CUBEMAP_NEGATIVEZ	0x00008000
 #define DDSCAPS2_VOLUME	0x00200000
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* HEADER_IMAGE_DXT	*/
@@ -8,8 +8,190 @@
 
 #include "image_helper.h"
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
+#ifdef WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <pthread.h>
+	#include <unistd.h>
+#endif
+
+/*	SSE2 / SSSE3 kernels, picked at runtime (GCC and clang only,
+	everybody else just gets the plain C code)	*/
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define HELPER_HAS_X86_SIMD	1
+	#include <immintrin.h>
+#else
+	#define HELPER_HAS_X86_SIMD	0
+#endif
+
+/*	at most this many threads work on one image	*/
+#define HELPER_MAX_THREADS	64
+/*	less work than this (in bytes read) is not worth a thread	*/
+#define HELPER_MIN_BYTES_PER_THREAD	(256*1024)
+
+/********* Kernels *********/
+/*
+	Every operation is split into rows (or runs of pixels) that
+	don't depend on each other, so they can be spread over a few
+	threads, and each has a plain C kernel plus SIMD ones that
+	produce exactly the same bytes.
+*/
+typedef struct
+{
+	const unsigned char *orig;
+	int width, height, channels;
+	unsigned char *resampled;
+	int resampled_width;
+	float dx, dy;
+}
+up_scale_args;
+
+typedef struct
+{
+	const unsigned char *orig;
+	int width, height, channels;
+	unsigned char *resampled;
+	int block_size_x, block_size_y;
+	int mip_width;
+}
+mipmap_args;
+
+/*	one row of up_scale_image()	*/
+typedef void (*up_scale_row_proc)( const up_scale_args *args, int y );
+/*	one row of mipmap_image(), 'sums' has room for width*channels+4 ints	*/
+typedef void (*mipmap_row_proc)( const mipmap_args *args, int j, int *sums );
+/*	'count' pixels of the in-place conversions	*/
+typedef void (*NTSC_pixels_proc)( unsigned char *pixels, int count, int channels, const unsigned char scale_LUT[256] );
+typedef void (*YCoCg_pixels_proc)( unsigned char *pixels, int count, int channels );
+typedef void (*RGBE_pixels_proc)( unsigned char *pixels, int count, float scale );
+
+static void up_scale_row( const up_scale_args *args, int y );
+static void mipmap_row( const mipmap_args *args, int j, int *sums );
+static void scale_NTSC_pixels( unsigned char *pixels, int count, int channels, const unsigned char scale_LUT[256] );
+static void RGB_to_YCoCg_pixels( unsigned char *pixels, int count, int channels );
+static void YCoCg_to_RGB_pixels( unsigned char *pixels, int count, int channels );
+static void RGBE_to_RGBdivA_pixels( unsigned char *pixels, int count, float scale );
+static void RGBE_to_RGBdivA2_pixels( unsigned char *pixels, int count, float scale );
+static float find_max_RGBE_pixels( const unsigned char *pixels, int count );
+#if HELPER_HAS_X86_SIMD
+static void up_scale_row_SSE2( const up_scale_args *args, int y );
+static void mipmap_row_SSE2( const mipmap_args *args, int j, int *sums );
+static void scale_NTSC_pixels_SSE2( unsigned char *pixels, int count, int channels, const unsigned char scale_LUT[256] );
+static void RGB_to_YCoCg_pixels_SSE2( unsigned char *pixels, int count, int channels );
+static void YCoCg_to_RGB_pixels_SSE2( unsigned char *pixels, int count, int channels );
+static void RGB_to_YCoCg_pixels_SSSE3( unsigned char *pixels, int count, int channels );
+static void YCoCg_to_RGB_pixels_SSSE3( unsigned char *pixels, int count, int channels );
+static void RGBE_to_RGBdivA_pixels_SSE2( unsigned char *pixels, int count, float scale );
+static void RGBE_to_RGBdivA2_pixels_SSE2( unsigned char *pixels, int count, float scale );
+static float find_max_RGBE_pixels_SSE2( const unsigned char *pixels, int count );
+#endif
+
+/*	the kernels in use, NULL until the first call picks them	*/
+static up_scale_row_proc up_scale_row_run = NULL;
+static mipmap_row_proc mipmap_row_run = NULL;
+static NTSC_pixels_proc scale_NTSC_run = NULL;
+static YCoCg_pixels_proc RGB_to_YCoCg_run = NULL;
+static YCoCg_pixels_proc YCoCg_to_RGB_run = NULL;
+static RGBE_pixels_proc RGBE_to_RGBdivA_run = NULL;
+static RGBE_pixels_proc RGBE_to_RGBdivA2_run = NULL;
+static float (*find_max_RGBE_run)( const unsigned char *pixels, int count ) = NULL;
+/*	0 means one thread per CPU	*/
+static int helper_thread_count = 0;
+
+/*	works on the rows [first_row, end_row) of one operation	*/
+typedef void (*helper_rows_proc)( const void *args, int first_row, int end_row );
+/*
+	Calls proc on all the rows, spread over a few threads
+	when there are enough bytes to go through.
+*/
+static void helper_run_rows( helper_rows_proc proc, const void *args, int rows, int bytes_per_row );
+
+static void helper_init( void )
+{
+	/*	first time through?  pick the best kernels for this CPU	*/
+	if( NULL == up_scale_row_run )
+	{
+		set_image_helper_SIMD_level( IMAGE_HELPER_SIMD_AUTO );
+	}
+}
+
+/*	the row workers for helper_run_rows()	*/
+static void up_scale_rows( const void *args, int first_row, int end_row )
+{
+	int y;
+	for( y = first_row; y < end_row; ++y )
+	{
+		up_scale_row_run( (const up_scale_args*)args, y );
+	}
+}
+
+static void mipmap_rows( const void *args, int first_row, int end_row )
+{
+	const mipmap_args *a = (const mipmap_args*)args;
+	mipmap_row_proc row = mipmap_row_run;
+	int *sums = (int*)malloc( (a->width*a->channels + 4) * sizeof(int) );
+	int j;
+	if( NULL == sums )
+	{
+		/*	the plain C one doesn't need the scratch space	*/
+		row = mipmap_row;
+	}
+	for( j = first_row; j < end_row; ++j )
+	{
+		row( a, j, sums );
+	}
+	free( sums );
+}
+
+typedef struct
+{
+	unsigned char *image;
+	int width, channels;
+	const unsigned char *scale_LUT;
+	float scale;
+}
+pixel_rows_args;
+
+static void scale_NTSC_rows( const void *args, int first_row, int end_row )
+{
+	const pixel_rows_args *a = (const pixel_rows_args*)args;
+	scale_NTSC_run( a->image + first_row*a->width*a->channels,
+			(end_row - first_row) * a->width, a->channels, a->scale_LUT );
+}
+
+static void RGB_to_YCoCg_rows( const void *args, int first_row, int end_row )
+{
+	const pixel_rows_args *a = (const pixel_rows_args*)args;
+	RGB_to_YCoCg_run( a->image + first_row*a->width*a->channels,
+			(end_row - first_row) * a->width, a->channels );
+}
+
+static void YCoCg_to_RGB_rows( const void *args, int first_row, int end_row )
+{
+	const pixel_rows_args *a = (const pixel_rows_args*)args;
+	YCoCg_to_RGB_run( a->image + first_row*a->width*a->channels,
+			(end_row - first_row) * a->width, a->channels );
+}
+
+static void RGBE_to_RGBdivA_rows( const void *args, int first_row, int end_row )
+{
+	const pixel_rows_args *a = (const pixel_rows_args*)args;
+	RGBE_to_RGBdivA_run( a->image + first_row*a->width*4,
+			(end_row - first_row) * a->width, a->scale );
+}
+
+static void RGBE_to_RGBdivA2_rows( const void *args, int first_row, int end_row )
+{
+	const pixel_rows_args *a = (const pixel_rows_args*)args;
+	RGBE_to_RGBdivA2_run( a->image + first_row*a->width*4,
+			(end_row - first_row) * a->width, a->scale );
+}
+
+/********* Actual Exposed Functions *********/
 /*	Upscaling the image uses simple bilinear interpolation	*/
 int
 	up_scale_image
@@ -20,8 +202,7 @@ int
 		int resampled_width, int resampled_height
 	)
 {
-	float dx, dy;
-	int x, y, c;
+	up_scale_args args;
 
     /* error(s) check	*/
     if ( 	(width < 1) || (height < 1) ||
@@ -32,51 +213,20 @@ int
         /*	signify badness	*/
         return 0;
     }
+    helper_init();
     /*
 		for each given pixel in the new map, find the exact location
 		from the original map which would contribute to this guy
 	*/
-    dx = (width - 1.0f) / (resampled_width - 1.0f);
-    dy = (height - 1.0f) / (resampled_height - 1.0f);
-    for ( y = 0; y < resampled_height; ++y )
-    {
-    	/* find the base y index and fractional offset from that	*/
-    	float sampley = y * dy;
-    	int inty = (int)sampley;
-    	/*	if( inty < 0 ) { inty = 0; } else	*/
-		if( inty > height - 2 ) { inty = height - 2; }
-		sampley -= inty;
-        for ( x = 0; x < resampled_width; ++x )
-        {
-			float samplex = x * dx;
-			int intx = (int)samplex;
-			int base_index;
-			/* find the base x index and fractional offset from that	*/
-			/*	if( intx < 0 ) { intx = 0; } else	*/
-			if( intx > width - 2 ) { intx = width - 2; }
-			samplex -= intx;
-			/*	base index into the original image	*/
-			base_index = (inty * width + intx) * channels;
-            for ( c = 0; c < channels; ++c )
-            {
-            	/*	do the sampling	*/
-				float value = 0.5f;
-				value += orig[base_index]
-							*(1.0f-samplex)*(1.0f-sampley);
-				value += orig[base_index+channels]
-							*(samplex)*(1.0f-sampley);
-				value += orig[base_index+width*channels]
-							*(1.0f-samplex)*(sampley);
-				value += orig[base_index+width*channels+channels]
-							*(samplex)*(sampley);
-				/*	move to the next channel	*/
-				++base_index;
-            	/*	save the new value	*/
-            	resampled[y*resampled_width*channels+x*channels+c] =
-						(unsigned char)(value);
-            }
-        }
-    }
+    args.orig = orig;
+    args.width = width;
+    args.height = height;
+    args.channels = channels;
+    args.resampled = resampled;
+    args.resampled_width = resampled_width;
+    args.dx = (width - 1.0f) / (resampled_width - 1.0f);
+    args.dy = (height - 1.0f) / (resampled_height - 1.0f);
+    helper_run_rows( up_scale_rows, &args, resampled_height, resampled_width*channels*4 );
     /*	done	*/
     return 1;
 }
@@ -90,8 +240,8 @@ int
 		int block_size_x, int block_size_y
 	)
 {
+	mipmap_args args;
 	int mip_width, mip_height;
-	int i, j, c;
 
 	/*	error check	*/
 	if( (width < 1) || (height < 1) ||
@@ -102,6 +252,7 @@ int
 		/*	nothing to do	*/
 		return 0;
 	}
+	helper_init();
 	mip_width = width / block_size_x;
 	mip_height = height / block_size_y;
 	if( mip_width < 1 )
@@ -112,42 +263,15 @@ int
 	{
 		mip_height = 1;
 	}
-	for( j = 0; j < mip_height; ++j )
-	{
-		for( i = 0; i < mip_width; ++i )
-		{
-			for( c = 0; c < channels; ++c )
-			{
-				const int index = (j*block_size_y)*width*channels + (i*block_size_x)*channels + c;
-				int sum_value;
-				int u,v;
-				int u_block = block_size_x;
-				int v_block = block_size_y;
-				int block_area;
-				/*	do a bit of checking so we don't over-run the boundaries
-					(necessary for non-square textures!)	*/
-				if( block_size_x * (i+1) > width )
-				{
-					u_block = width - i*block_size_y;
-				}
-				if( block_size_y * (j+1) > height )
-				{
-					v_block = height - j*block_size_y;
-				}
-				block_area = u_block*v_block;
-				/*	for this pixel, see what the average
-					of all the values in the block are.
-					note: start the sum at the rounding value, not at 0	*/
-				sum_value = block_area >> 1;
-				for( v = 0; v < v_block; ++v )
-				for( u = 0; u < u_block; ++u )
-				{
-					sum_value += orig[index + v*width*channels + u*channels];
-				}
-				resampled[j*mip_width*channels + i*channels + c] = sum_value / block_area;
-			}
-		}
-	}
+	args.orig = orig;
+	args.width = width;
+	args.height = height;
+	args.channels = channels;
+	args.resampled = resampled;
+	args.block_size_x = block_size_x;
+	args.block_size_y = block_size_y;
+	args.mip_width = mip_width;
+	helper_run_rows( mipmap_rows, &args, mip_height, block_size_y*width*channels );
 	return 1;
 }
 
@@ -160,9 +284,9 @@ int
 {
 	const float scale_lo = 16.0f - 0.499f;
 	const float scale_hi = 235.0f + 0.499f;
-	int i, j;
-	int nc = channels;
+	int i;
 	unsigned char scale_LUT[256];
+	pixel_rows_args args;
 	/*	error check	*/
 	if( (width < 1) || (height < 1) ||
 		(channels < 1) || (orig == NULL) )
@@ -170,21 +294,18 @@ int
 		/*	nothing to do	*/
 		return 0;
 	}
+	helper_init();
 	/*	set up the scaling Look Up Table	*/
 	for( i = 0; i < 256; ++i )
 	{
 		scale_LUT[i] = (unsigned char)((scale_hi - scale_lo) * i / 255.0f + scale_lo);
 	}
-	/*	for channels = 2 or 4, ignore the alpha component	*/
-	nc -= 1 - (channels & 1);
 	/*	OK, go through the image and scale any non-alpha components	*/
-	for( i = 0; i < width*height*channels; i += channels )
-	{
-		for( j = 0; j < nc; ++j )
-		{
-			orig[i+j] = scale_LUT[orig[i+j]];
-		}
-	}
+	args.image = orig;
+	args.width = width;
+	args.channels = channels;
+	args.scale_LUT = scale_LUT;
+	helper_run_rows( scale_NTSC_rows, &args, height, width*channels );
 	return 1;
 }
 
@@ -204,7 +325,37 @@ int
 		int width, int height, int channels
 	)
 {
-	int i;
+	pixel_rows_args args;
+	/*	error check	*/
+	if( (width < 1) || (height < 1) ||
+		(channels < 3) || (channels > 4) ||
+		(orig == NULL) )
+	{
+		/*	nothing to do	*/
+		return -1;
+	}
+	helper_init();
+	/*	do the conversion	*/
+	args.image = orig;
+	args.width = width;
+	args.channels = channels;
+	helper_run_rows( RGB_to_YCoCg_rows, &args, height, width*channels );
+	/*	done	*/
+	return 0;
+}
+
+/*
+	This function takes the YCoCg components of the image
+	and converts them into RGB.  See above.
+*/
+int
+	convert_YCoCg_to_RGB
+	(
+		unsigned char* orig,
+		int width, int height, int channels
+	)
+{
+	pixel_rows_args args;
 	/*	error check	*/
 	if( (width < 1) || (height < 1) ||
 		(channels < 3) || (channels > 4) ||
@@ -213,10 +364,358 @@ int
 		/*	nothing to do	*/
 		return -1;
 	}
+	helper_init();
 	/*	do the conversion	*/
+	args.image = orig;
+	args.width = width;
+	args.channels = channels;
+	helper_run_rows( YCoCg_to_RGB_rows, &args, height, width*channels );
+	/*	done	*/
+	return 0;
+}
+
+float
+find_max_RGBE
+(
+	unsigned char *image,
+    int width, int height
+)
+{
+	helper_init();
+	return find_max_RGBE_run( image, width * height );
+}
+
+int
+RGBE_to_RGBdivA
+(
+    unsigned char *image,
+    int width, int height,
+    int rescale_to_max
+)
+{
+	/* local variables */
+	pixel_rows_args args;
+	float scale = 1.0f;
+	/* error check */
+	if( (!image) || (width < 1) || (height < 1) )
+	{
+		return 0;
+	}
+	helper_init();
+	/* convert (note: no negative numbers, but 0.0 is possible) */
+	if( rescale_to_max )
+	{
+		scale = 255.0f / find_max_RGBE( image, width, height );
+	}
+	args.image = image;
+	args.width = width;
+	args.scale = scale;
+	helper_run_rows( RGBE_to_RGBdivA_rows, &args, height, width*4 );
+	return 1;
+}
+
+int
+RGBE_to_RGBdivA2
+(
+    unsigned char *image,
+    int width, int height,
+    int rescale_to_max
+)
+{
+	/* local variables */
+	pixel_rows_args args;
+	float scale = 1.0f;
+	/* error check */
+	if( (!image) || (width < 1) || (height < 1) )
+	{
+		return 0;
+	}
+	helper_init();
+	/* convert (note: no negative numbers, but 0.0 is possible) */
+	if( rescale_to_max )
+	{
+		scale = 255.0f * 255.0f / find_max_RGBE( image, width, height );
+	}
+	args.image = image;
+	args.width = width;
+	args.scale = scale;
+	helper_run_rows( RGBE_to_RGBdivA2_rows, &args, height, width*4 );
+	return 1;
+}
+
+int set_image_helper_SIMD_level( int level )
+{
+	int best = IMAGE_HELPER_SIMD_NONE;
+	#if HELPER_HAS_X86_SIMD
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports( "sse2" ) )
+	{
+		best = IMAGE_HELPER_SIMD_SSE2;
+	}
+	if( __builtin_cpu_supports( "ssse3" ) )
+	{
+		best = IMAGE_HELPER_SIMD_SSSE3;
+	}
+	#endif
+	/*	can't go any higher than the CPU lets me	*/
+	if( (level == IMAGE_HELPER_SIMD_AUTO) || (level > best) )
+	{
+		level = best;
+	}
+	if( level < IMAGE_HELPER_SIMD_NONE )
+	{
+		level = IMAGE_HELPER_SIMD_NONE;
+	}
+	up_scale_row_run = up_scale_row;
+	mipmap_row_run = mipmap_row;
+	scale_NTSC_run = scale_NTSC_pixels;
+	RGB_to_YCoCg_run = RGB_to_YCoCg_pixels;
+	YCoCg_to_RGB_run = YCoCg_to_RGB_pixels;
+	RGBE_to_RGBdivA_run = RGBE_to_RGBdivA_pixels;
+	RGBE_to_RGBdivA2_run = RGBE_to_RGBdivA2_pixels;
+	find_max_RGBE_run = find_max_RGBE_pixels;
+	#if HELPER_HAS_X86_SIMD
+	if( level >= IMAGE_HELPER_SIMD_SSE2 )
+	{
+		up_scale_row_run = up_scale_row_SSE2;
+		mipmap_row_run = mipmap_row_SSE2;
+		scale_NTSC_run = scale_NTSC_pixels_SSE2;
+		RGB_to_YCoCg_run = RGB_to_YCoCg_pixels_SSE2;
+		YCoCg_to_RGB_run = YCoCg_to_RGB_pixels_SSE2;
+		RGBE_to_RGBdivA_run = RGBE_to_RGBdivA_pixels_SSE2;
+		RGBE_to_RGBdivA2_run = RGBE_to_RGBdivA2_pixels_SSE2;
+		find_max_RGBE_run = find_max_RGBE_pixels_SSE2;
+	}
+	if( level >= IMAGE_HELPER_SIMD_SSSE3 )
+	{
+		/*	RGB needs byte shuffles	*/
+		RGB_to_YCoCg_run = RGB_to_YCoCg_pixels_SSSE3;
+		YCoCg_to_RGB_run = YCoCg_to_RGB_pixels_SSSE3;
+	}
+	#endif
+	return level;
+}
+
+void set_image_helper_thread_count( int threads )
+{
+	helper_thread_count = (threads < 0) ? 0 : threads;
+}
+
+/********* Row Workers *********/
+typedef struct
+{
+	helper_rows_proc proc;
+	const void *args;
+	/*	the rows [first, end) this job takes care of	*/
+	int first_row, end_row;
+}
+helper_job;
+
+#ifdef WIN32
+static DWORD WINAPI helper_thread_main( LPVOID job )
+#else
+static void *helper_thread_main( void *job )
+#endif
+{
+	const helper_job *j = (const helper_job*)job;
+	j->proc( j->args, j->first_row, j->end_row );
+	return 0;
+}
+
+static int helper_CPU_count( void )
+{
+	#ifdef WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+	return (int)info.dwNumberOfProcessors;
+	#else
+	long count = sysconf( _SC_NPROCESSORS_ONLN );
+	return (count > 0) ? (int)count : 1;
+	#endif
+}
+
+static void helper_run_rows( helper_rows_proc proc, const void *args, int rows, int bytes_per_row )
+{
+	helper_job jobs[HELPER_MAX_THREADS];
+	#ifdef WIN32
+	HANDLE handles[HELPER_MAX_THREADS];
+	#else
+	pthread_t handles[HELPER_MAX_THREADS];
+	#endif
+	int started[HELPER_MAX_THREADS];
+	double worth = (double)rows * bytes_per_row / HELPER_MIN_BYTES_PER_THREAD;
+	int threads, t;
+	/*	how many threads are worth it?	*/
+	threads = helper_thread_count;
+	if( threads == 0 )
+	{
+		threads = helper_CPU_count();
+	}
+	if( threads > worth )
+	{
+		threads = (int)worth;
+	}
+	if( threads > rows )
+	{
+		threads = rows;
+	}
+	if( threads > HELPER_MAX_THREADS )
+	{
+		threads = HELPER_MAX_THREADS;
+	}
+	if( threads < 1 )
+	{
+		threads = 1;
+	}
+	/*	hand out the rows as evenly as possible	*/
+	for( t = 0; t < threads; ++t )
+	{
+		jobs[t].proc = proc;
+		jobs[t].args = args;
+		jobs[t].first_row = (int)((double)rows * t / threads);
+		jobs[t].end_row = (int)((double)rows * (t+1) / threads);
+	}
+	/*	the calling thread does the 1st job itself	*/
+	for( t = 1; t < threads; ++t )
+	{
+		#ifdef WIN32
+		handles[t] = CreateThread( NULL, 0, helper_thread_main, &jobs[t], 0, NULL );
+		started[t] = (handles[t] != NULL);
+		#else
+		started[t] = (pthread_create( &handles[t], NULL, helper_thread_main, &jobs[t] ) == 0);
+		#endif
+		if( !started[t] )
+		{
+			/*	no thread for you, do it here then	*/
+			proc( args, jobs[t].first_row, jobs[t].end_row );
+		}
+	}
+	proc( args, jobs[0].first_row, jobs[0].end_row );
+	for( t = 1; t < threads; ++t )
+	{
+		if( started[t] )
+		{
+			#ifdef WIN32
+			WaitForSingleObject( handles[t], INFINITE );
+			CloseHandle( handles[t] );
+			#else
+			pthread_join( handles[t], NULL );
+			#endif
+		}
+	}
+}
+
+/********* Plain C Kernels *********/
+static void up_scale_row( const up_scale_args *args, int y )
+{
+	const unsigned char* const orig = args->orig;
+	const int width = args->width, height = args->height, channels = args->channels;
+	const int resampled_width = args->resampled_width;
+	unsigned char* resampled = args->resampled;
+	int x, c;
+	/* find the base y index and fractional offset from that	*/
+	float sampley = y * args->dy;
+	int inty = (int)sampley;
+	/*	if( inty < 0 ) { inty = 0; } else	*/
+	if( inty > height - 2 ) { inty = height - 2; }
+	sampley -= inty;
+	for ( x = 0; x < resampled_width; ++x )
+	{
+		float samplex = x * args->dx;
+		int intx = (int)samplex;
+		int base_index;
+		/* find the base x index and fractional offset from that	*/
+		/*	if( intx < 0 ) { intx = 0; } else	*/
+		if( intx > width - 2 ) { intx = width - 2; }
+		samplex -= intx;
+		/*	base index into the original image	*/
+		base_index = (inty * width + intx) * channels;
+		for ( c = 0; c < channels; ++c )
+		{
+			/*	do the sampling	*/
+			float value = 0.5f;
+			value += orig[base_index]
+						*(1.0f-samplex)*(1.0f-sampley);
+			value += orig[base_index+channels]
+						*(samplex)*(1.0f-sampley);
+			value += orig[base_index+width*channels]
+						*(1.0f-samplex)*(sampley);
+			value += orig[base_index+width*channels+channels]
+						*(samplex)*(sampley);
+			/*	move to the next channel	*/
+			++base_index;
+			/*	save the new value	*/
+			resampled[y*resampled_width*channels+x*channels+c] =
+					(unsigned char)(value);
+		}
+	}
+}
+
+static void mipmap_row( const mipmap_args *args, int j, int *sums )
+{
+	const unsigned char* const orig = args->orig;
+	const int width = args->width, height = args->height, channels = args->channels;
+	const int block_size_x = args->block_size_x, block_size_y = args->block_size_y;
+	const int mip_width = args->mip_width;
+	unsigned char* resampled = args->resampled;
+	int i, c;
+	(void)sums;
+	for( i = 0; i < mip_width; ++i )
+	{
+		for( c = 0; c < channels; ++c )
+		{
+			const int index = (j*block_size_y)*width*channels + (i*block_size_x)*channels + c;
+			int sum_value;
+			int u,v;
+			int u_block = block_size_x;
+			int v_block = block_size_y;
+			int block_area;
+			/*	do a bit of checking so we don't over-run the boundaries
+				(necessary for non-square textures!)	*/
+			if( block_size_x * (i+1) > width )
+			{
+				u_block = width - i*block_size_y;
+			}
+			if( block_size_y * (j+1) > height )
+			{
+				v_block = height - j*block_size_y;
+			}
+			block_area = u_block*v_block;
+			/*	for this pixel, see what the average
+				of all the values in the block are.
+				note: start the sum at the rounding value, not at 0	*/
+			sum_value = block_area >> 1;
+			for( v = 0; v < v_block; ++v )
+			for( u = 0; u < u_block; ++u )
+			{
+				sum_value += orig[index + v*width*channels + u*channels];
+			}
+			resampled[j*mip_width*channels + i*channels + c] = sum_value / block_area;
+		}
+	}
+}
+
+static void scale_NTSC_pixels( unsigned char *pixels, int count, int channels, const unsigned char scale_LUT[256] )
+{
+	int i, j;
+	int nc = channels;
+	/*	for channels = 2 or 4, ignore the alpha component	*/
+	nc -= 1 - (channels & 1);
+	for( i = 0; i < count*channels; i += channels )
+	{
+		for( j = 0; j < nc; ++j )
+		{
+			pixels[i+j] = scale_LUT[pixels[i+j]];
+		}
+	}
+}
+
+static void RGB_to_YCoCg_pixels( unsigned char *orig, int count, int channels )
+{
+	int i;
 	if( channels == 3 )
 	{
-		for( i = 0; i < width*height*3; i += 3 )
+		for( i = 0; i < count*3; i += 3 )
 		{
 			int r = orig[i+0];
 			int g = (orig[i+1] + 1) >> 1;
@@ -231,7 +730,7 @@ int
 		}
 	} else
 	{
-		for( i = 0; i < width*height*4; i += 4 )
+		for( i = 0; i < count*4; i += 4 )
 		{
 			int r = orig[i+0];
 			int g = (orig[i+1] + 1) >> 1;
@@ -248,34 +747,14 @@ int
 			orig[i+3] = clamp_byte( g + tmp );
 		}
 	}
-	/*	done	*/
-	return 0;
 }
 
-/*
-	This function takes the YCoCg components of the image
-	and converts them into RGB.  See above.
-*/
-int
-	convert_YCoCg_to_RGB
-	(
-		unsigned char* orig,
-		int width, int height, int channels
-	)
+static void YCoCg_to_RGB_pixels( unsigned char *orig, int count, int channels )
 {
 	int i;
-	/*	error check	*/
-	if( (width < 1) || (height < 1) ||
-		(channels < 3) || (channels > 4) ||
-		(orig == NULL) )
-	{
-		/*	nothing to do	*/
-		return -1;
-	}
-	/*	do the conversion	*/
 	if( channels == 3 )
 	{
-		for( i = 0; i < width*height*3; i += 3 )
+		for( i = 0; i < count*3; i += 3 )
 		{
 			int co = orig[i+0] - 128;
 			int y  = orig[i+1];
@@ -289,7 +768,7 @@ int
 		}
 	} else
 	{
-		for( i = 0; i < width*height*4; i += 4 )
+		for( i = 0; i < count*4; i += 4 )
 		{
 			int co = orig[i+0] - 128;
 			int cg = orig[i+1] - 128;
@@ -305,21 +784,14 @@ int
 			orig[i+3] = a;
 		}
 	}
-	/*	done	*/
-	return 0;
 }
 
-float
-find_max_RGBE
-(
-	unsigned char *image,
-    int width, int height
-)
+static float find_max_RGBE_pixels( const unsigned char *image, int count )
 {
 	float max_val = 0.0f;
-	unsigned char *img = image;
+	const unsigned char *img = image;
 	int i, j;
-	for( i = width * height; i > 0; --i )
+	for( i = count; i > 0; --i )
 	{
 		/* float scale = powf( 2.0f, img[3] - 128.0f ) / 255.0f; */
 		float scale = ldexp( 1.0f / 255.0f, (int)(img[3]) - 128 );
@@ -336,29 +808,11 @@ find_max_RGBE
 	return max_val;
 }
 
-int
-RGBE_to_RGBdivA
-(
-    unsigned char *image,
-    int width, int height,
-    int rescale_to_max
-)
+static void RGBE_to_RGBdivA_pixels( unsigned char *image, int count, float scale )
 {
-	/* local variables */
 	int i, iv;
 	unsigned char *img = image;
-	float scale = 1.0f;
-	/* error check */
-	if( (!image) || (width < 1) || (height < 1) )
-	{
-		return 0;
-	}
-	/* convert (note: no negative numbers, but 0.0 is possible) */
-	if( rescale_to_max )
-	{
-		scale = 255.0f / find_max_RGBE( image, width, height );
-	}
-	for( i = width * height; i > 0; --i )
+	for( i = count; i > 0; --i )
 	{
 		/* decode this pixel, and find the max */
 		float r,g,b,e, m;
@@ -382,32 +836,13 @@ RGBE_to_RGBdivA
 		/* and on to the next pixel */
 		img += 4;
 	}
-	return 1;
 }
 
-int
-RGBE_to_RGBdivA2
-(
-    unsigned char *image,
-    int width, int height,
-    int rescale_to_max
-)
+static void RGBE_to_RGBdivA2_pixels( unsigned char *image, int count, float scale )
 {
-	/* local variables */
 	int i, iv;
 	unsigned char *img = image;
-	float scale = 1.0f;
-	/* error check */
-	if( (!image) || (width < 1) || (height < 1) )
-	{
-		return 0;
-	}
-	/* convert (note: no negative numbers, but 0.0 is possible) */
-	if( rescale_to_max )
-	{
-		scale = 255.0f * 255.0f / find_max_RGBE( image, width, height );
-	}
-	for( i = width * height; i > 0; --i )
+	for( i = count; i > 0; --i )
 	{
 		/* decode this pixel, and find the max */
 		float r,g,b,e, m;
@@ -431,5 +866,535 @@ RGBE_to_RGBdivA2
 		/* and on to the next pixel */
 		img += 4;
 	}
-	return 1;
 }
+
+/********* SIMD Kernels *********/
+#if HELPER_HAS_X86_SIMD
+/*
+	Each of these does exactly what the plain C kernel above it
+	does, in the same order for the float math, so the bytes come
+	out the same.  The odd pixels at the end go to the plain C one.
+*/
+
+/*	one pixel of 3 or 4 channels, one per 32 bit lane	*/
+__attribute__((target("sse2")))
+static __m128i load_pixel_SSE2( const unsigned char *p, int channels )
+{
+	int v;
+	if( channels == 4 )
+	{
+		memcpy( &v, p, 4 );
+	} else
+	{
+		v = p[0] | (p[1] << 8) | (p[2] << 16);
+	}
+	return _mm_unpacklo_epi16(
+			_mm_unpacklo_epi8( _mm_cvtsi32_si128( v ), _mm_setzero_si128() ),
+			_mm_setzero_si128() );
+}
+
+__attribute__((target("sse2")))
+static void store_pixel_SSE2( unsigned char *p, __m128i v, int channels )
+{
+	int bytes;
+	v = _mm_packs_epi32( v, v );
+	bytes = _mm_cvtsi128_si32( _mm_packus_epi16( v, v ) );
+	memcpy( p, &bytes, channels );
+}
+
+/*	all the channels of a pixel at once	*/
+__attribute__((target("sse2")))
+static void up_scale_row_SSE2( const up_scale_args *args, int y )
+{
+	const int width = args->width, height = args->height, channels = args->channels;
+	const unsigned char *row0, *row1;
+	unsigned char *out;
+	float sampley;
+	int inty, x;
+	__m128 wy0, wy1;
+	if( channels < 3 )
+	{
+		up_scale_row( args, y );
+		return;
+	}
+	sampley = y * args->dy;
+	inty = (int)sampley;
+	if( inty > height - 2 ) { inty = height - 2; }
+	sampley -= inty;
+	wy0 = _mm_set1_ps( 1.0f - sampley );
+	wy1 = _mm_set1_ps( sampley );
+	row0 = args->orig + inty*width*channels;
+	row1 = row0 + width*channels;
+	out = args->resampled + y*args->resampled_width*channels;
+	for( x = 0; x < args->resampled_width; ++x, out += channels )
+	{
+		float samplex = x * args->dx;
+		int intx = (int)samplex;
+		__m128 wx0, wx1, value;
+		if( intx > width - 2 ) { intx = width - 2; }
+		samplex -= intx;
+		wx0 = _mm_set1_ps( 1.0f - samplex );
+		wx1 = _mm_set1_ps( samplex );
+		value = _mm_set1_ps( 0.5f );
+		value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( _mm_cvtepi32_ps(
+				load_pixel_SSE2( row0 + intx*channels, channels ) ), wx0 ), wy0 ) );
+		value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( _mm_cvtepi32_ps(
+				load_pixel_SSE2( row0 + (intx+1)*channels, channels ) ), wx1 ), wy0 ) );
+		value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( _mm_cvtepi32_ps(
+				load_pixel_SSE2( row1 + intx*channels, channels ) ), wx0 ), wy1 ) );
+		value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( _mm_cvtepi32_ps(
+				load_pixel_SSE2( row1 + (intx+1)*channels, channels ) ), wx1 ), wy1 ) );
+		store_pixel_SSE2( out, _mm_cvttps_epi32( value ), channels );
+	}
+}
+
+/*	add up the block's rows into 'sums' 16 bytes at a time, then
+	add up the columns of each block a pixel (4 lanes) at a time	*/
+__attribute__((target("sse2")))
+static void mipmap_row_SSE2( const mipmap_args *args, int j, int *sums )
+{
+	const int width = args->width, channels = args->channels;
+	const int block_size_x = args->block_size_x, block_size_y = args->block_size_y;
+	const int row_bytes = width*channels;
+	const unsigned char *src = args->orig + j*block_size_y*row_bytes;
+	unsigned char *out = args->resampled + j*args->mip_width*channels;
+	const __m128i zero = _mm_setzero_si128();
+	int u_block = block_size_x;
+	int v_block = block_size_y;
+	int block_area, shift, bytes, i, k, v;
+	__m128i round;
+	if( channels > 4 )
+	{
+		mipmap_row( args, j, sums );
+		return;
+	}
+	/*	same clipping as mipmap_row(): a block only sticks out when
+		it is the only one, and then it is as wide as the image	*/
+	if( block_size_x > width )
+	{
+		u_block = width;
+	}
+	if( block_size_y * (j+1) > args->height )
+	{
+		v_block = args->height - j*block_size_y;
+	}
+	block_area = u_block*v_block;
+	bytes = args->mip_width*u_block*channels;
+	/*	(and the slack read past the last pixel)	*/
+	memset( sums, 0, (bytes + 4)*sizeof(int) );
+	for( v = 0; v < v_block; ++v, src += row_bytes )
+	{
+		for( k = 0; k + 16 <= bytes; k += 16 )
+		{
+			__m128i p = _mm_loadu_si128( (const __m128i*)(src + k) );
+			__m128i lo = _mm_unpacklo_epi8( p, zero ), hi = _mm_unpackhi_epi8( p, zero );
+			__m128i *s = (__m128i*)(sums + k);
+			_mm_storeu_si128( s+0, _mm_add_epi32( _mm_loadu_si128( s+0 ), _mm_unpacklo_epi16( lo, zero ) ) );
+			_mm_storeu_si128( s+1, _mm_add_epi32( _mm_loadu_si128( s+1 ), _mm_unpackhi_epi16( lo, zero ) ) );
+			_mm_storeu_si128( s+2, _mm_add_epi32( _mm_loadu_si128( s+2 ), _mm_unpacklo_epi16( hi, zero ) ) );
+			_mm_storeu_si128( s+3, _mm_add_epi32( _mm_loadu_si128( s+3 ), _mm_unpackhi_epi16( hi, zero ) ) );
+		}
+		for( ; k < bytes; ++k )
+		{
+			sums[k] += src[k];
+		}
+	}
+	/*	power of 2 blocks (all of SOIL's) divide with a shift	*/
+	for( shift = 0; (1 << shift) < block_area; ++shift );
+	if( (1 << shift) != block_area )
+	{
+		shift = -1;
+	}
+	round = _mm_set1_epi32( block_area >> 1 );
+	for( i = 0; i < args->mip_width; ++i, out += channels )
+	{
+		/*	the lanes past 'channels' are junk (or the slack
+			at the end of sums), and never stored	*/
+		const int *s = sums + i*u_block*channels;
+		__m128i total = round;
+		int u;
+		for( u = 0; u < u_block; ++u, s += channels )
+		{
+			total = _mm_add_epi32( total, _mm_loadu_si128( (const __m128i*)s ) );
+		}
+		if( shift >= 0 )
+		{
+			total = _mm_srl_epi32( total, _mm_cvtsi32_si128( shift ) );
+		} else
+		{
+			int lanes[4];
+			_mm_storeu_si128( (__m128i*)lanes, total );
+			for( k = 0; k < 4; ++k )
+			{
+				lanes[k] /= block_area;
+			}
+			total = _mm_loadu_si128( (const __m128i*)lanes );
+		}
+		store_pixel_SSE2( out, total, channels );
+	}
+}
+
+/*	the LUT is a straight line, which works out in 16.15 fixed point
+	as 15 + ((i*28268 + 16656) >> 15); checked against the LUT first,
+	in case the compiler's float math made a different one	*/
+#define NTSC_FIXED_MUL	28268
+#define NTSC_FIXED_ADD	16656
+#define NTSC_FIXED_BASE	15
+
+__attribute__((target("sse2")))
+static void scale_NTSC_pixels_SSE2( unsigned char *pixels, int count, int channels, const unsigned char scale_LUT[256] )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i factors = _mm_set1_epi32( NTSC_FIXED_MUL | (NTSC_FIXED_ADD << 16) );
+	const __m128i ones = _mm_set1_epi16( 1 );
+	const __m128i base = _mm_set1_epi16( NTSC_FIXED_BASE );
+	__m128i alpha;
+	int i, n = count*channels;
+	if( channels > 4 )
+	{
+		scale_NTSC_pixels( pixels, count, channels, scale_LUT );
+		return;
+	}
+	for( i = 0; i < 256; ++i )
+	{
+		if( ((i*NTSC_FIXED_MUL + NTSC_FIXED_ADD) >> 15) + NTSC_FIXED_BASE != scale_LUT[i] )
+		{
+			scale_NTSC_pixels( pixels, count, channels, scale_LUT );
+			return;
+		}
+	}
+	/*	the bytes to leave alone	*/
+	switch( channels )
+	{
+	case 2:		alpha = _mm_set1_epi16( (short)0xFF00 );	break;
+	case 4:		alpha = _mm_set1_epi32( (int)0xFF000000 );	break;
+	default:	alpha = zero;	break;
+	}
+	for( i = 0; i + 16 <= n; i += 16 )
+	{
+		__m128i p = _mm_loadu_si128( (const __m128i*)(pixels + i) );
+		__m128i lo = _mm_unpacklo_epi8( p, zero ), hi = _mm_unpackhi_epi8( p, zero );
+		__m128i q;
+		/*	(i, 1) pairs times (mul, add)	*/
+		lo = _mm_packs_epi32(
+				_mm_srai_epi32( _mm_madd_epi16( _mm_unpacklo_epi16( lo, ones ), factors ), 15 ),
+				_mm_srai_epi32( _mm_madd_epi16( _mm_unpackhi_epi16( lo, ones ), factors ), 15 ) );
+		hi = _mm_packs_epi32(
+				_mm_srai_epi32( _mm_madd_epi16( _mm_unpacklo_epi16( hi, ones ), factors ), 15 ),
+				_mm_srai_epi32( _mm_madd_epi16( _mm_unpackhi_epi16( hi, ones ), factors ), 15 ) );
+		q = _mm_packus_epi16( _mm_add_epi16( lo, base ), _mm_add_epi16( hi, base ) );
+		q = _mm_or_si128( _mm_and_si128( alpha, p ), _mm_andnot_si128( alpha, q ) );
+		_mm_storeu_si128( (__m128i*)(pixels + i), q );
+	}
+	/*	16 bytes are whole pixels of 2 or 4 channels, and
+		with 1 or 3 every byte gets scaled anyway	*/
+	if( channels & 1 )
+	{
+		scale_NTSC_pixels( pixels + i, n - i, 1, scale_LUT );
+	} else
+	{
+		scale_NTSC_pixels( pixels + i, (n - i) / channels, channels, scale_LUT );
+	}
+}
+
+/*	8 pixels of R,G,B as 16 bit lanes to Co, Y, Cg (clamped to 0..255)	*/
+#define RGB_TO_YCOCG_SSE2( r, g, b, co, y, cg ) \
+	{ \
+		const __m128i one = _mm_set1_epi16( 1 ), c128 = _mm_set1_epi16( 128 ); \
+		const __m128i c255 = _mm_set1_epi16( 255 ), zero16 = _mm_setzero_si128(); \
+		__m128i half_g = _mm_srai_epi16( _mm_add_epi16( g, one ), 1 ); \
+		__m128i tmp = _mm_srai_epi16( _mm_add_epi16( _mm_add_epi16( r, b ), _mm_set1_epi16( 2 ) ), 2 ); \
+		co = _mm_add_epi16( c128, _mm_srai_epi16( _mm_add_epi16( _mm_sub_epi16( r, b ), one ), 1 ) ); \
+		y = _mm_add_epi16( half_g, tmp ); \
+		cg = _mm_sub_epi16( _mm_add_epi16( c128, half_g ), tmp ); \
+		co = _mm_min_epi16( _mm_max_epi16( co, zero16 ), c255 ); \
+		y = _mm_min_epi16( _mm_max_epi16( y, zero16 ), c255 ); \
+		cg = _mm_min_epi16( _mm_max_epi16( cg, zero16 ), c255 ); \
+	}
+
+/*	8 pixels of Co, Y, Cg as 16 bit lanes to R, G, B (clamped to 0..255)	*/
+#define YCOCG_TO_RGB_SSE2( co, y, cg, r, g, b ) \
+	{ \
+		const __m128i c128 = _mm_set1_epi16( 128 ); \
+		const __m128i c255 = _mm_set1_epi16( 255 ), zero16 = _mm_setzero_si128(); \
+		__m128i co_s = _mm_sub_epi16( co, c128 ), cg_s = _mm_sub_epi16( cg, c128 ); \
+		r = _mm_sub_epi16( _mm_add_epi16( y, co_s ), cg_s ); \
+		g = _mm_add_epi16( y, cg_s ); \
+		b = _mm_sub_epi16( _mm_sub_epi16( y, co_s ), cg_s ); \
+		r = _mm_min_epi16( _mm_max_epi16( r, zero16 ), c255 ); \
+		g = _mm_min_epi16( _mm_max_epi16( g, zero16 ), c255 ); \
+		b = _mm_min_epi16( _mm_max_epi16( b, zero16 ), c255 ); \
+	}
+
+/*	byte 'n' of each 32 bit lane, 8 pixels' worth as 16 bit lanes	*/
+#define PIXEL_BYTE_SSE2( p0, p1, n ) \
+	_mm_packs_epi32( \
+			_mm_and_si128( _mm_srli_epi32( p0, 8*n ), _mm_set1_epi32( 0xFF ) ), \
+			_mm_and_si128( _mm_srli_epi32( p1, 8*n ), _mm_set1_epi32( 0xFF ) ) )
+
+/*	and back: 4 16 bit lanes of 0..255 to 8 pixels of 4 bytes	*/
+#define STORE_PIXELS_SSE2( dst, b0, b1, b2, b3 ) \
+	{ \
+		__m128i lo_ = _mm_or_si128( b0, _mm_slli_epi16( b1, 8 ) ); \
+		__m128i hi_ = _mm_or_si128( b2, _mm_slli_epi16( b3, 8 ) ); \
+		_mm_storeu_si128( (__m128i*)(dst), _mm_unpacklo_epi16( lo_, hi_ ) ); \
+		_mm_storeu_si128( (__m128i*)(dst) + 1, _mm_unpackhi_epi16( lo_, hi_ ) ); \
+	}
+
+/*	RGBA only, RGB needs the SSSE3 version	*/
+__attribute__((target("sse2")))
+static void RGB_to_YCoCg_pixels_SSE2( unsigned char *orig, int count, int channels )
+{
+	int i = 0;
+	if( channels == 4 )
+	{
+		for( ; i + 8 <= count; i += 8 )
+		{
+			__m128i p0 = _mm_loadu_si128( (const __m128i*)(orig + i*4) );
+			__m128i p1 = _mm_loadu_si128( (const __m128i*)(orig + i*4) + 1 );
+			__m128i r = PIXEL_BYTE_SSE2( p0, p1, 0 );
+			__m128i g = PIXEL_BYTE_SSE2( p0, p1, 1 );
+			__m128i b = PIXEL_BYTE_SSE2( p0, p1, 2 );
+			__m128i a = PIXEL_BYTE_SSE2( p0, p1, 3 );
+			__m128i co, y, cg;
+			RGB_TO_YCOCG_SSE2( r, g, b, co, y, cg )
+			STORE_PIXELS_SSE2( orig + i*4, co, cg, a, y )
+		}
+	}
+	RGB_to_YCoCg_pixels( orig + i*channels, count - i, channels );
+}
+
+__attribute__((target("sse2")))
+static void YCoCg_to_RGB_pixels_SSE2( unsigned char *orig, int count, int channels )
+{
+	int i = 0;
+	if( channels == 4 )
+	{
+		for( ; i + 8 <= count; i += 8 )
+		{
+			__m128i p0 = _mm_loadu_si128( (const __m128i*)(orig + i*4) );
+			__m128i p1 = _mm_loadu_si128( (const __m128i*)(orig + i*4) + 1 );
+			__m128i co = PIXEL_BYTE_SSE2( p0, p1, 0 );
+			__m128i cg = PIXEL_BYTE_SSE2( p0, p1, 1 );
+			__m128i a = PIXEL_BYTE_SSE2( p0, p1, 2 );
+			__m128i y = PIXEL_BYTE_SSE2( p0, p1, 3 );
+			__m128i r, g, b;
+			YCOCG_TO_RGB_SSE2( co, y, cg, r, g, b )
+			STORE_PIXELS_SSE2( orig + i*4, r, g, b, a )
+		}
+	}
+	YCoCg_to_RGB_pixels( orig + i*channels, count - i, channels );
+}
+
+/*	one channel of 8 RGB pixels as 16 bit lanes, gathered by two shuffles from
+	the first 16 and the last 16 of their 24 bytes	*/
+#define RGB_CHANNEL_SSSE3( lo, hi, k ) \
+	_mm_or_si128( \
+			_mm_shuffle_epi8( lo, _mm_setr_epi8( k, -1, 3+k, -1, 6+k, -1, 9+k, -1, \
+					12+k, -1, k ? -1 : 15, -1, -1, -1, -1, -1 ) ), \
+			_mm_shuffle_epi8( hi, _mm_setr_epi8( -1, -1, -1, -1, -1, -1, -1, -1, \
+					-1, -1, k ? 7+k : -1, -1, 10+k, -1, 13+k, -1 ) ) )
+
+/*	8 RGB pixels (24 bytes) from 'src' as 3 lanes of 16 bit channels	*/
+#define LOAD_RGB_SSSE3( src, c0, c1, c2 ) \
+	{ \
+		__m128i lo_ = _mm_loadu_si128( (const __m128i*)(src) ); \
+		__m128i hi_ = _mm_loadu_si128( (const __m128i*)((src) + 8) ); \
+		c0 = RGB_CHANNEL_SSSE3( lo_, hi_, 0 ); \
+		c1 = RGB_CHANNEL_SSSE3( lo_, hi_, 1 ); \
+		c2 = RGB_CHANNEL_SSSE3( lo_, hi_, 2 ); \
+	}
+
+/*	and back, interleaving the bytes of the first two channels with the third	*/
+#define STORE_RGB_SSSE3( dst, c0, c1, c2 ) \
+	{ \
+		__m128i p_ = _mm_packus_epi16( c0, c1 ); \
+		__m128i q_ = _mm_packus_epi16( c2, c2 ); \
+		_mm_storeu_si128( (__m128i*)(dst), _mm_or_si128( \
+				_mm_shuffle_epi8( p_, _mm_setr_epi8( 0, 8, -1, 1, 9, -1, 2, 10, -1, 3, 11, -1, 4, 12, -1, 5 ) ), \
+				_mm_shuffle_epi8( q_, _mm_setr_epi8( -1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1 ) ) ) ); \
+		_mm_storel_epi64( (__m128i*)((dst) + 16), _mm_or_si128( \
+				_mm_shuffle_epi8( p_, _mm_setr_epi8( 13, -1, 6, 14, -1, 7, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1 ) ), \
+				_mm_shuffle_epi8( q_, _mm_setr_epi8( -1, 5, -1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1 ) ) ) ); \
+	}
+
+__attribute__((target("ssse3")))
+static void RGB_to_YCoCg_pixels_SSSE3( unsigned char *orig, int count, int channels )
+{
+	int i = 0;
+	if( channels == 3 )
+	{
+		for( ; i + 8 <= count; i += 8 )
+		{
+			__m128i r, g, b, co, y, cg;
+			LOAD_RGB_SSSE3( orig + i*3, r, g, b )
+			RGB_TO_YCOCG_SSE2( r, g, b, co, y, cg )
+			STORE_RGB_SSSE3( orig + i*3, co, y, cg )
+		}
+		RGB_to_YCoCg_pixels( orig + i*3, count - i, 3 );
+	} else
+	{
+		RGB_to_YCoCg_pixels_SSE2( orig, count, channels );
+	}
+}
+
+__attribute__((target("ssse3")))
+static void YCoCg_to_RGB_pixels_SSSE3( unsigned char *orig, int count, int channels )
+{
+	int i = 0;
+	if( channels == 3 )
+	{
+		for( ; i + 8 <= count; i += 8 )
+		{
+			__m128i co, y, cg, r, g, b;
+			LOAD_RGB_SSSE3( orig + i*3, co, y, cg )
+			YCOCG_TO_RGB_SSE2( co, y, cg, r, g, b )
+			STORE_RGB_SSSE3( orig + i*3, r, g, b )
+		}
+		YCoCg_to_RGB_pixels( orig + i*3, count - i, 3 );
+	} else
+	{
+		YCoCg_to_RGB_pixels_SSE2( orig, count, channels );
+	}
+}
+
+/*
+	ldexp( 1.0f / 255.0f, E - 128 ) for 4 pixels' E, times 'scale',
+	rounded to float once at the end just like the double math in
+	the plain C code (2^(E-128) is built straight into a double)
+*/
+__attribute__((target("sse2")))
+static __m128 RGBE_scale_SSE2( __m128i e, double scale )
+{
+	const __m128d factor = _mm_set1_pd( scale * (double)(1.0f / 255.0f) );
+	const __m128i bias = _mm_set1_epi32( 1023 - 128 );
+	__m128i lo = _mm_slli_epi64( _mm_unpacklo_epi32( _mm_add_epi32( e, bias ), _mm_setzero_si128() ), 52 );
+	__m128i hi = _mm_slli_epi64( _mm_unpackhi_epi32( _mm_add_epi32( e, bias ), _mm_setzero_si128() ), 52 );
+	return _mm_movelh_ps(
+			_mm_cvtpd_ps( _mm_mul_pd( factor, _mm_castsi128_pd( lo ) ) ),
+			_mm_cvtpd_ps( _mm_mul_pd( factor, _mm_castsi128_pd( hi ) ) ) );
+}
+
+__attribute__((target("sse2")))
+static float find_max_RGBE_pixels_SSE2( const unsigned char *image, int count )
+{
+	const __m128i mask = _mm_set1_epi32( 0xFF );
+	__m128 max4 = _mm_setzero_ps();
+	float lanes[4], max_val, rest;
+	int i;
+	for( i = 0; i + 4 <= count; i += 4 )
+	{
+		__m128i p = _mm_loadu_si128( (const __m128i*)(image + i*4) );
+		__m128 scale = RGBE_scale_SSE2( _mm_srli_epi32( p, 24 ), 1.0 );
+		max4 = _mm_max_ps( max4, _mm_mul_ps( _mm_cvtepi32_ps( _mm_and_si128( p, mask ) ), scale ) );
+		max4 = _mm_max_ps( max4, _mm_mul_ps( _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( p, 8 ), mask ) ), scale ) );
+		max4 = _mm_max_ps( max4, _mm_mul_ps( _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( p, 16 ), mask ) ), scale ) );
+	}
+	_mm_storeu_ps( lanes, max4 );
+	max_val = find_max_RGBE_pixels( image + i*4, count - i );
+	for( i = 0; i < 4; ++i )
+	{
+		rest = lanes[i];
+		if( rest > max_val )
+		{
+			max_val = rest;
+		}
+	}
+	return max_val;
+}
+
+/*	4 pixels, SoA: decode to r, g, b and the max of them	*/
+#define RGBE_DECODE_SSE2( src, scale, r, g, b, m ) \
+	{ \
+		const __m128i mask_ = _mm_set1_epi32( 0xFF ); \
+		__m128i p_ = _mm_loadu_si128( (const __m128i*)(src) ); \
+		__m128 e_ = RGBE_scale_SSE2( _mm_srli_epi32( p_, 24 ), scale ); \
+		r = _mm_mul_ps( e_, _mm_cvtepi32_ps( _mm_and_si128( p_, mask_ ) ) ); \
+		g = _mm_mul_ps( e_, _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( p_, 8 ), mask_ ) ) ); \
+		b = _mm_mul_ps( e_, _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( p_, 16 ), mask_ ) ) ); \
+		m = _mm_max_ps( b, _mm_max_ps( r, g ) ); \
+	}
+
+/*	the plain C code's int -> float -> int trip through the ?:, and
+	its clamping to 1..255 (the x86 int overflow value included)	*/
+__attribute__((target("sse2")))
+static __m128i RGBE_alpha_SSE2( __m128 m, __m128 q )
+{
+	const __m128i one = _mm_set1_epi32( 1 ), c255 = _mm_set1_epi32( 255 );
+	__m128i iv = _mm_cvttps_epi32( _mm_cvtepi32_ps( _mm_cvttps_epi32( q ) ) );
+	__m128i zero_m = _mm_castps_si128( _mm_cmpeq_ps( m, _mm_setzero_ps() ) );
+	__m128i low, high;
+	iv = _mm_or_si128( _mm_and_si128( zero_m, one ), _mm_andnot_si128( zero_m, iv ) );
+	low = _mm_cmplt_epi32( iv, one );
+	iv = _mm_or_si128( _mm_and_si128( low, one ), _mm_andnot_si128( low, iv ) );
+	high = _mm_cmpgt_epi32( iv, c255 );
+	return _mm_or_si128( _mm_and_si128( high, c255 ), _mm_andnot_si128( high, iv ) );
+}
+
+/*	(int)(x + 0.5f) clamped to 255	*/
+__attribute__((target("sse2")))
+static __m128i RGBE_channel_SSE2( __m128 x )
+{
+	const __m128i c255 = _mm_set1_epi32( 255 );
+	__m128i iv = _mm_cvttps_epi32( _mm_add_ps( x, _mm_set1_ps( 0.5f ) ) );
+	__m128i high = _mm_cmpgt_epi32( iv, c255 );
+	return _mm_or_si128( _mm_and_si128( high, c255 ), _mm_andnot_si128( high, iv ) );
+}
+
+/*	only the low byte of each, like storing an int to an unsigned char
+	(huge values overflow to INT_MIN, which stores as 0)	*/
+__attribute__((target("sse2")))
+static void store_RGBA_SSE2( unsigned char *dst, __m128i r, __m128i g, __m128i b, __m128i a )
+{
+	const __m128i mask = _mm_set1_epi32( 0xFF );
+	__m128i p;
+	r = _mm_and_si128( r, mask );
+	g = _mm_and_si128( g, mask );
+	b = _mm_and_si128( b, mask );
+	p = _mm_or_si128(
+			_mm_or_si128( r, _mm_slli_epi32( g, 8 ) ),
+			_mm_or_si128( _mm_slli_epi32( b, 16 ), _mm_slli_epi32( a, 24 ) ) );
+	_mm_storeu_si128( (__m128i*)dst, p );
+}
+
+__attribute__((target("sse2")))
+static void RGBE_to_RGBdivA_pixels_SSE2( unsigned char *image, int count, float scale )
+{
+	int i;
+	for( i = 0; i + 4 <= count; i += 4 )
+	{
+		__m128 r, g, b, m, af;
+		__m128i a;
+		RGBE_DECODE_SSE2( image + i*4, scale, r, g, b, m )
+		a = RGBE_alpha_SSE2( m, _mm_div_ps( _mm_set1_ps( 255.0f ), m ) );
+		af = _mm_cvtepi32_ps( a );
+		store_RGBA_SSE2( image + i*4,
+				RGBE_channel_SSE2( _mm_mul_ps( af, r ) ),
+				RGBE_channel_SSE2( _mm_mul_ps( af, g ) ),
+				RGBE_channel_SSE2( _mm_mul_ps( af, b ) ), a );
+	}
+	RGBE_to_RGBdivA_pixels( image + i*4, count - i, scale );
+}
+
+__attribute__((target("sse2")))
+static void RGBE_to_RGBdivA2_pixels_SSE2( unsigned char *image, int count, float scale )
+{
+	const __m128 c255 = _mm_set1_ps( 255.0f );
+	int i;
+	for( i = 0; i + 4 <= count; i += 4 )
+	{
+		__m128 r, g, b, m, aa;
+		__m128i a;
+		RGBE_DECODE_SSE2( image + i*4, scale, r, g, b, m )
+		a = RGBE_alpha_SSE2( m, _mm_sqrt_ps( _mm_div_ps( _mm_set1_ps( 255.0f * 255.0f ), m ) ) );
+		/*	a*a is exact as a float	*/
+		aa = _mm_cvtepi32_ps( a );
+		aa = _mm_mul_ps( aa, aa );
+		store_RGBA_SSE2( image + i*4,
+				RGBE_channel_SSE2( _mm_div_ps( _mm_mul_ps( aa, r ), c255 ) ),
+				RGBE_channel_SSE2( _mm_div_ps( _mm_mul_ps( aa, g ), c255 ) ),
+				RGBE_channel_SSE2( _mm_div_ps( _mm_mul_ps( aa, b ), c255 ) ), a );
+	}
+	RGBE_to_RGBdivA2_pixels( image + i*4, count - i, scale );
+}
+#endif
@@ -108,6 +108,41 @@ int
 		int rescale_to_max
 	);
 
+/**
+	The instruction sets the image helpers can use.
+	Every one of them produces exactly the same output.
+**/
+enum
+{
+	IMAGE_HELPER_SIMD_AUTO = -1,
+	IMAGE_HELPER_SIMD_NONE = 0,
+	IMAGE_HELPER_SIMD_SSE2 = 1,
+	IMAGE_HELPER_SIMD_SSSE3 = 2
+};
+
+/**
+	Picks the instruction set the image helpers use.  IMAGE_HELPER_SIMD_AUTO
+	(the default) takes the best this CPU has.  Asking for one the CPU
+	lacks falls back to the next best.
+	\return the level now in use
+**/
+int
+	set_image_helper_SIMD_level
+	(
+		int level
+	);
+
+/**
+	Sets how many threads the rows of an image are spread
+	over, 0 (the default) means one per CPU.  Small images are
+	always done on the calling thread.
+**/
+void
+	set_image_helper_thread_count
+	(
+		int threads
+	);
+
 #ifdef __cplusplus
 }
 #endif
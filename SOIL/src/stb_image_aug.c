@@ -13,10 +13,12 @@
       HDR (radiance rgbE format)
       writes BMP,TGA (define STBI_NO_WRITE to remove code)
       decoded from memory or through stdio FILE (define STBI_NO_STDIO to remove code)
-      supports installable dequantizing-IDCT, YCbCr-to-RGB conversion (define STBI_SIMD)
+      supports installable dequantizing-IDCT, YCbCr-to-RGB conversion
+      SSE2/SSSE3/AVX2 PNG unfiltering, alpha expansion, JPEG IDCT, color
+          conversion and upsampling, picked at runtime (stbi_set_simd_level)
 
    TODO:
-      stbi_info_*
+      stbi_info_* for formats other than jpeg, png and tga
 
    history:
       1.16   major bugfix - convert_format converted one too many pixels
@@ -78,6 +80,15 @@
 #include <assert.h>
 #include <stdarg.h>
 
+// SSE2/SSSE3 versions of the PNG unfilters and alpha expansion, picked at
+// runtime (GCC and clang on x86 only, everybody else gets the plain C loops)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STBI_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define STBI_X86_SIMD 0
+#endif
+
 #ifndef _MSC_VER
   #ifdef __cplusplus
   #define __forceinline inline
@@ -94,6 +105,7 @@ typedef   signed short  int16;
 typedef unsigned int   uint32;
 typedef   signed int    int32;
 typedef unsigned int   uint;
+typedef unsigned long long uint64;
 
 // should produce compiler error if size is wrong
 typedef unsigned char validate_uint32[sizeof(uint32)==4];
@@ -320,12 +332,93 @@ extern int      stbi_is_hdr_from_file(FILE *f)
 
 #endif
 
-// @TODO: get image dimensions & components without fully decoding
+// tga's test is so weak it's only trusted once nothing else claims the
+// data, like stbi_load does; call once jpeg and png have been ruled out
+#ifndef STBI_NO_STDIO
+static int only_tga_file(FILE *f)
+{
+   int i;
+   if (stbi_bmp_test_file(f) || stbi_psd_test_file(f)) return 0;
+   #ifndef STBI_NO_DDS
+   if (stbi_dds_test_file(f)) return 0;
+   #endif
+   #ifndef STBI_NO_HDR
+   if (stbi_hdr_test_file(f)) return 0;
+   #endif
+   for (i=0; i < max_loaders; ++i)
+      if (loaders[i]->test_file(f)) return 0;
+   return stbi_tga_test_file(f);
+}
+#endif
+
+static int only_tga_memory(stbi_uc const *buffer, int len)
+{
+   int i;
+   if (stbi_bmp_test_memory(buffer,len) || stbi_psd_test_memory(buffer,len)) return 0;
+   #ifndef STBI_NO_DDS
+   if (stbi_dds_test_memory(buffer,len)) return 0;
+   #endif
+   #ifndef STBI_NO_HDR
+   if (stbi_hdr_test_memory(buffer,len)) return 0;
+   #endif
+   for (i=0; i < max_loaders; ++i)
+      if (loaders[i]->test_memory(buffer,len)) return 0;
+   return stbi_tga_test_memory(buffer,len);
+}
+
+// get image dimensions & components; jpeg, png and tga only read the header,
+// @TODO: everything else still gets fully decoded
 #ifndef STBI_NO_STDIO
-extern int      stbi_info            (char const *filename,           int *x, int *y, int *comp);
-extern int      stbi_info_from_file  (FILE *f,                  int *x, int *y, int *comp);
+int stbi_info_from_file(FILE *f, int *x, int *y, int *comp)
+{
+   int n, w, h, c;
+   stbi_uc *data;
+   if (stbi_jpeg_test_file(f))
+      return stbi_jpeg_info_from_file(f,x,y,comp);
+   if (stbi_png_test_file(f))
+      return stbi_png_info_from_file(f,x,y,comp);
+   if (only_tga_file(f))
+      return stbi_tga_info_from_file(f,x,y,comp);
+   n = ftell(f);
+   data = stbi_load_from_file(f,&w,&h,&c,0);
+   fseek(f,n,SEEK_SET);
+   if (data == NULL) return 0;
+   stbi_image_free(data);
+   if (x) *x = w;
+   if (y) *y = h;
+   if (comp) *comp = c;
+   return 1;
+}
+
+int stbi_info(char const *filename, int *x, int *y, int *comp)
+{
+   int r;
+   FILE *f = fopen(filename, "rb");
+   if (!f) return e("can't fopen", "Unable to open file");
+   r = stbi_info_from_file(f,x,y,comp);
+   fclose(f);
+   return r;
+}
 #endif
-extern int      stbi_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp);
+
+int stbi_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp)
+{
+   int w, h, c;
+   stbi_uc *data;
+   if (stbi_jpeg_test_memory(buffer,len))
+      return stbi_jpeg_info_from_memory(buffer,len,x,y,comp);
+   if (stbi_png_test_memory(buffer,len))
+      return stbi_png_info_from_memory(buffer,len,x,y,comp);
+   if (only_tga_memory(buffer,len))
+      return stbi_tga_info_from_memory(buffer,len,x,y,comp);
+   data = stbi_load_from_memory(buffer,len,&w,&h,&c,0);
+   if (data == NULL) return 0;
+   stbi_image_free(data);
+   if (x) *x = w;
+   if (y) *y = h;
+   if (comp) *comp = c;
+   return 1;
+}
 
 #ifndef STBI_NO_HDR
 static float h2l_gamma_i=1.0f/2.2f, h2l_scale_i=1.0f;
@@ -360,12 +453,17 @@ typedef struct
    FILE  *img_file;
    #endif
    uint8 *img_buffer, *img_buffer_end;
+
+   // caller's buffer for the final image, see stbi_load_into()
+   uint8 *out_buffer;
+   uint32 out_size;
 } stbi;
 
 #ifndef STBI_NO_STDIO
 static void start_file(stbi *s, FILE *f)
 {
    s->img_file = f;
+   s->out_buffer = NULL;
 }
 #endif
 
@@ -376,6 +474,26 @@ static void start_mem(stbi *s, uint8 const *buffer, int len)
 #endif
    s->img_buffer = (uint8 *) buffer;
    s->img_buffer_end = (uint8 *) buffer+len;
+   s->out_buffer = NULL;
+}
+
+static void start_out(stbi *s, uint8 *out, int out_size)
+{
+   s->out_buffer = out;
+   s->out_size = out_size > 0 ? (uint32) out_size : 0;
+}
+
+// the final image goes straight into the caller's buffer when there is one
+// and it's big enough; only call these for the buffer that gets returned
+static uint8 *alloc_out(stbi *s, uint32 size)
+{
+   if (s->out_buffer && size <= s->out_size) return s->out_buffer;
+   return (uint8 *) malloc(size);
+}
+
+static void free_out(stbi *s, void *p)
+{
+   if (p != s->out_buffer) free(p);
 }
 
 __forceinline static int get8(stbi *s)
@@ -462,12 +580,72 @@ static void getn(stbi *s, stbi_uc *buffer, int n)
 //  assume data buffer is malloced, so malloc a new one and free that one
 //  only failure mode is malloc failing
 
+// adding an opaque alpha channel to grey or RGB pixels is by far the most
+// common conversion (png does it while unfiltering, everything else does it
+// here), so it gets its own kernels; indexed by the source component count
+typedef void (*add_alpha_proc)(uint8 *dest, uint8 const *src, uint32 count);
+
+static void add_alpha_1(uint8 *dest, uint8 const *src, uint32 count)
+{
+   uint32 i;
+   for (i=0; i < count; ++i, src += 1, dest += 2)
+      dest[0]=src[0], dest[1]=255;
+}
+
+static void add_alpha_3(uint8 *dest, uint8 const *src, uint32 count)
+{
+   uint32 i;
+   for (i=0; i < count; ++i, src += 3, dest += 4)
+      dest[0]=src[0], dest[1]=src[1], dest[2]=src[2], dest[3]=255;
+}
+
+#if STBI_X86_SIMD
+__attribute__((target("sse2")))
+static void add_alpha_1_sse2(uint8 *dest, uint8 const *src, uint32 count)
+{
+   __m128i opaque = _mm_set1_epi8((char) 255);
+   uint32 i;
+   for (i=0; i + 16 <= count; i += 16) {
+      __m128i grey = _mm_loadu_si128((__m128i const *) (src + i));
+      _mm_storeu_si128((__m128i *) (dest + i*2     ), _mm_unpacklo_epi8(grey, opaque));
+      _mm_storeu_si128((__m128i *) (dest + i*2 + 16), _mm_unpackhi_epi8(grey, opaque));
+   }
+   add_alpha_1(dest + i*2, src + i, count - i);
+}
+
+__attribute__((target("ssse3")))
+static void add_alpha_3_ssse3(uint8 *dest, uint8 const *src, uint32 count)
+{
+   __m128i spread = _mm_setr_epi8(0,1,2,-1, 3,4,5,-1, 6,7,8,-1, 9,10,11,-1);
+   __m128i opaque = _mm_set1_epi32((int) 0xff000000);
+   uint32 i;
+   // 4 pixels per step, but each load reads 16 bytes, so stop early
+   for (i=0; i + 6 <= count; i += 4) {
+      __m128i rgb = _mm_loadu_si128((__m128i const *) (src + i*3));
+      _mm_storeu_si128((__m128i *) (dest + i*4), _mm_or_si128(_mm_shuffle_epi8(rgb, spread), opaque));
+   }
+   add_alpha_3(dest + i*4, src + i*3, count - i);
+}
+#endif
+
+static add_alpha_proc add_alpha[4] = { NULL, add_alpha_1, NULL, add_alpha_3 };
+
+// set by stbi_set_simd_level(), which the kernels' users call the first
+// time through if nobody else has
+static int simd_ready;
+
+static void simd_init(void)
+{
+   if (!simd_ready) stbi_set_simd_level(STBI_SIMD_LEVEL_AUTO);
+}
+
 static uint8 compute_y(int r, int g, int b)
 {
    return (uint8) (((r*77) + (g*150) +  (29*b)) >> 8);
 }
 
-static unsigned char *convert_format(unsigned char *data, int img_n, int req_comp, uint x, uint y)
+// the converted image is the final one, so it can go into s's out buffer
+static unsigned char *convert_format(stbi *s, unsigned char *data, int img_n, int req_comp, uint x, uint y)
 {
    int i,j;
    unsigned char *good;
@@ -475,16 +653,22 @@ static unsigned char *convert_format(unsigned char *data, int img_n, int req_com
    if (req_comp == img_n) return data;
    assert(req_comp >= 1 && req_comp <= 4);
 
-   good = (unsigned char *) malloc(req_comp * x * y);
+   good = alloc_out(s, req_comp * x * y);
    if (good == NULL) {
       free(data);
       return epuc("outofmem", "Out of memory");
    }
 
+   simd_init();
    for (j=0; j < (int) y; ++j) {
       unsigned char *src  = data + j * x * img_n   ;
       unsigned char *dest = good + j * x * req_comp;
 
+      if (req_comp == img_n+1 && add_alpha[img_n]) {
+         add_alpha[img_n](dest, src, x);
+         continue;
+      }
+
       #define COMBO(a,b)  ((a)*8+(b))
       #define CASE(a,b)   case COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
       // convert source image with img_n components to one with req_comp components;
@@ -599,13 +783,11 @@ typedef struct
 
 typedef struct
 {
-   #if STBI_SIMD
-   unsigned short dequant2[4][64];
-   #endif
    stbi s;
    huffman huff_dc[4];
    huffman huff_ac[4];
-   uint8 dequant[4][64];
+   int16 fast_ac[4][1 << FAST_BITS];
+   unsigned short dequant[4][64];
 
 // sizes for components, interleaved MCUs
    int img_h_max, img_v_max;
@@ -627,7 +809,7 @@ typedef struct
       uint8 *linebuf;
    } img_comp[4];
 
-   uint32         code_buffer; // jpeg entropy-coded buffer
+   uint32         code_buffer; // jpeg entropy-coded buffer, next bit at the top
    int            code_bits;   // number of valid bits
    unsigned char  marker;      // marker seen while filling entropy buffer
    int            nomore;      // flag if we saw a marker so must stop
@@ -680,7 +862,7 @@ static int build_huffman(huffman *h, int *count)
 static void grow_buffer_unsafe(jpeg *j)
 {
    do {
-      int b = j->nomore ? 0 : get8(&j->s);
+      unsigned int b = j->nomore ? 0 : get8(&j->s);
       if (b == 0xff) {
          int c = get8(&j->s);
          if (c != 0) {
@@ -689,7 +871,7 @@ static void grow_buffer_unsafe(jpeg *j)
             return;
          }
       }
-      j->code_buffer = (j->code_buffer << 8) | b;
+      j->code_buffer |= b << (24 - j->code_bits);
       j->code_bits += 8;
    } while (j->code_bits <= 24);
 }
@@ -707,12 +889,14 @@ __forceinline static int decode(jpeg *j, huffman *h)
 
    // look at the top FAST_BITS and determine what symbol ID it is,
    // if the code is <= FAST_BITS
-   c = (j->code_buffer >> (j->code_bits - FAST_BITS)) & ((1 << FAST_BITS)-1);
+   c = j->code_buffer >> (32 - FAST_BITS);
    k = h->fast[c];
    if (k < 255) {
-      if (h->size[k] > j->code_bits)
+      int s = h->size[k];
+      if (s > j->code_bits)
          return -1;
-      j->code_bits -= h->size[k];
+      j->code_buffer <<= s;
+      j->code_bits -= s;
       return h->values[k];
    }
 
@@ -722,10 +906,7 @@ __forceinline static int decode(jpeg *j, huffman *h)
    // end; in other words, regardless of the number of bits, it
    // wants to be compared against something shifted to have 16;
    // that way we don't need to shift inside the loop.
-   if (j->code_bits < 16)
-      temp = (j->code_buffer << (16 - j->code_bits)) & 0xffff;
-   else
-      temp = (j->code_buffer >> (j->code_bits - 16)) & 0xffff;
+   temp = j->code_buffer >> 16;
    for (k=FAST_BITS+1 ; ; ++k)
       if (temp < h->maxcode[k])
          break;
@@ -739,30 +920,62 @@ __forceinline static int decode(jpeg *j, huffman *h)
       return -1;
 
    // convert the huffman code to the symbol id
-   c = ((j->code_buffer >> (j->code_bits - k)) & bmask[k]) + h->delta[k];
-   assert((((j->code_buffer) >> (j->code_bits - h->size[c])) & bmask[h->size[c]]) == h->code[c]);
+   c = ((j->code_buffer >> (32 - k)) & bmask[k]) + h->delta[k];
+   assert((((j->code_buffer) >> (32 - h->size[c])) & bmask[h->size[c]]) == h->code[c]);
 
    // convert the id to a symbol
    j->code_bits -= k;
+   j->code_buffer <<= k;
    return h->values[c];
 }
 
+// what extend adds to a value received with its top bit clear, (-1 << n) + 1
+static int jbias[16] = {0,-1,-3,-7,-15,-31,-63,-127,-255,-511,-1023,-2047,-4095,-8191,-16383,-32767};
+
 // combined JPEG 'receive' and JPEG 'extend', since baseline
 // always extends everything it receives.
 __forceinline static int extend_receive(jpeg *j, int n)
 {
-   unsigned int m = 1 << (n-1);
    unsigned int k;
+   int sgn;
    if (j->code_bits < n) grow_buffer_unsafe(j);
-   k = (j->code_buffer >> (j->code_bits - n)) & bmask[n];
+   if (j->code_bits < n) return 0; // ran into a marker; corrupt data
+
+   // the top bit of the n is the sign: set, the value is k as is; clear,
+   // it's negative and needs the bias. Done with a mask instead of the
+   // branch, which predicts no better than a coin toss
+   sgn = (int32) j->code_buffer >> 31;
+   k = j->code_buffer >> (32 - n);
+   j->code_buffer <<= n;
    j->code_bits -= n;
-   // the following test is probably a random branch that won't
-   // predict well. I tried to table accelerate it but failed.
-   // maybe it's compiling as a conditional move?
-   if (k < m)
-      return (-1 << n) + k + 1;
-   else
-      return k;
+   return k + (jbias[n] & ~sgn);
+}
+
+// for the AC codes that fit in FAST_BITS together with the value they're
+// followed by, the whole decode in one lookup: value << 8 | run << 4 | the
+// total bits, or 0 for codes that take the long way
+static void build_fast_ac(int16 *fast_ac, huffman *h)
+{
+   int i;
+   for (i=0; i < (1 << FAST_BITS); ++i) {
+      uint8 fast = h->fast[i];
+      fast_ac[i] = 0;
+      if (fast < 255) {
+         int rs = h->values[fast];
+         int run = (rs >> 4) & 15;
+         int magbits = rs & 15;
+         int len = h->size[fast];
+
+         if (magbits && len + magbits <= FAST_BITS) {
+            // the value is the magbits after the code, extended
+            int k = ((i << len) & ((1 << FAST_BITS) - 1)) >> (FAST_BITS - magbits);
+            if (k < (1 << (magbits - 1))) k += jbias[magbits];
+            // only if it fits in what's left of the 16 bits
+            if (k >= -128 && k <= 127)
+               fast_ac[i] = (int16) ((k * 256) + (run * 16) + (len + magbits));
+         }
+      }
+   }
 }
 
 // given a value that's at position X in the zigzag stream,
@@ -783,11 +996,11 @@ static uint8 dezigzag[64+15] =
 };
 
 // decode one 64-entry block--
-static int decode_block(jpeg *j, short data[64], huffman *hdc, huffman *hac, int b)
+static int decode_block(jpeg *j, short data[64], huffman *hdc, huffman *hac, int16 *fac, int b)
 {
    int diff,dc,k;
    int t = decode(j, hdc);
-   if (t < 0) return e("bad huffman code","Corrupt JPEG");
+   if (t < 0 || t > 15) return e("bad huffman code","Corrupt JPEG");
 
    // 0 all the ac values now so we can do it 32-bits at a time
    memset(data,0,64*sizeof(data[0]));
@@ -800,18 +1013,30 @@ static int decode_block(jpeg *j, short data[64], huffman *hdc, huffman *hac, int
    // decode AC components, see JPEG spec
    k = 1;
    do {
-      int r,s;
-      int rs = decode(j, hac);
-      if (rs < 0) return e("bad huffman code","Corrupt JPEG");
-      s = rs & 15;
-      r = rs >> 4;
-      if (s == 0) {
-         if (rs != 0xf0) break; // end block
-         k += 16;
-      } else {
-         k += r;
+      int c,r,s;
+      if (j->code_bits < 16) grow_buffer_unsafe(j);
+      c = j->code_buffer >> (32 - FAST_BITS);
+      r = fac[c];
+      if (r && (r & 15) <= j->code_bits) { // code and value in one go
+         s = r & 15;
+         k += (r >> 4) & 15;
+         j->code_buffer <<= s;
+         j->code_bits -= s;
          // decode into unzigzag'd location
-         data[dezigzag[k++]] = (short) extend_receive(j,s);
+         data[dezigzag[k++]] = (short) (r >> 8);
+      } else {
+         int rs = decode(j, hac);
+         if (rs < 0) return e("bad huffman code","Corrupt JPEG");
+         s = rs & 15;
+         r = rs >> 4;
+         if (s == 0) {
+            if (rs != 0xf0) break; // end block
+            k += 16;
+         } else {
+            k += r;
+            // decode into unzigzag'd location
+            data[dezigzag[k++]] = (short) extend_receive(j,s);
+         }
       }
    } while (k < 64);
    return 1;
@@ -870,12 +1095,12 @@ __forceinline static uint8 clamp(int x)
    t1 += p2+p4;                                \
    t0 += p1+p3;
 
-#if !STBI_SIMD
 // .344 seconds on 3*anemones.jpg
-static void idct_block(uint8 *out, int out_stride, short data[64], uint8 *dequantize)
+static void idct_block(uint8 *out, int out_stride, short data[64], unsigned short *dequantize)
 {
    int i,val[64],*v=val;
-   uint8 *o,*dq = dequantize;
+   uint8 *o;
+   unsigned short *dq = dequantize;
    short *d = data;
 
    // columns
@@ -923,66 +1148,211 @@ static void idct_block(uint8 *out, int out_stride, short data[64], uint8 *dequan
       o[4] = clamp((x3-t0) >> 17);
    }
 }
-#else
-static void idct_block(uint8 *out, int out_stride, short data[64], unsigned short *dequantize)
-{
-   int i,val[64],*v=val;
-   uint8 *o;
-   unsigned short *dq = dequantize;
-   short *d = data;
+#if STBI_X86_SIMD
+// idct_block() again, bit for bit, on 4 (SSE2) or 8 (AVX2) columns at a
+// time and then, after a transpose, on as many rows.  The math stays in
+// 32 bits like the scalar version, which also makes the all-zero-AC
+// shortcut pointless: the full transform gives the same DC-only result.
+#define IDCT_1D_VEC(T,ADD,SUB,MUL,FSH,s0,s1,s2,s3,s4,s5,s6,s7) \
+   T t0,t1,t2,t3,p1,p2,p3,p4,p5,x0,x1,x2,x3;                    \
+   p2 = s2;                                                      \
+   p3 = s6;                                                      \
+   p1 = MUL(ADD(p2,p3), f2f(0.5411961f));                        \
+   t2 = ADD(p1, MUL(p3, f2f(-1.847759065f)));                    \
+   t3 = ADD(p1, MUL(p2, f2f( 0.765366865f)));                    \
+   p2 = s0;                                                      \
+   p3 = s4;                                                      \
+   t0 = FSH(ADD(p2,p3));                                         \
+   t1 = FSH(SUB(p2,p3));                                         \
+   x0 = ADD(t0,t3);                                              \
+   x3 = SUB(t0,t3);                                              \
+   x1 = ADD(t1,t2);                                              \
+   x2 = SUB(t1,t2);                                              \
+   t0 = s7;                                                      \
+   t1 = s5;                                                      \
+   t2 = s3;                                                      \
+   t3 = s1;                                                      \
+   p3 = ADD(t0,t2);                                              \
+   p4 = ADD(t1,t3);                                              \
+   p1 = ADD(t0,t3);                                              \
+   p2 = ADD(t1,t2);                                              \
+   p5 = MUL(ADD(p3,p4), f2f( 1.175875602f));                     \
+   t0 = MUL(t0, f2f( 0.298631336f));                             \
+   t1 = MUL(t1, f2f( 2.053119869f));                             \
+   t2 = MUL(t2, f2f( 3.072711026f));                             \
+   t3 = MUL(t3, f2f( 1.501321110f));                             \
+   p1 = ADD(p5, MUL(p1, f2f(-0.899976223f)));                    \
+   p2 = ADD(p5, MUL(p2, f2f(-2.562915447f)));                    \
+   p3 = MUL(p3, f2f(-1.961570560f));                             \
+   p4 = MUL(p4, f2f(-0.390180644f));                             \
+   t3 = ADD(t3, ADD(p1,p4));                                     \
+   t2 = ADD(t2, ADD(p2,p3));                                     \
+   t1 = ADD(t1, ADD(p2,p4));                                     \
+   t0 = ADD(t0, ADD(p1,p3));
+
+// the 8 outputs of a 1D pass, rounded and shifted down, in order
+#define IDCT_OUT_VEC(ADD,SUB,SRA,bias,shift,o)                   \
+   x0 = ADD(x0,bias); x1 = ADD(x1,bias);                         \
+   x2 = ADD(x2,bias); x3 = ADD(x3,bias);                         \
+   o[0] = SRA(ADD(x0,t3), shift);                                \
+   o[7] = SRA(SUB(x0,t3), shift);                                \
+   o[1] = SRA(ADD(x1,t2), shift);                                \
+   o[6] = SRA(SUB(x1,t2), shift);                                \
+   o[2] = SRA(ADD(x2,t1), shift);                                \
+   o[5] = SRA(SUB(x2,t1), shift);                                \
+   o[3] = SRA(ADD(x3,t0), shift);                                \
+   o[4] = SRA(SUB(x3,t0), shift);
+
+// c[k] holds output column k as 8 shorts, one per row: transpose them to
+// rows, clamp to 0..255 the same way clamp() does, and store
+#define IDCT_STORE_SSE2(c,out,out_stride) {                                   \
+   __m128i b0 = _mm_unpacklo_epi16(c[0],c[1]), b1 = _mm_unpackhi_epi16(c[0],c[1]); \
+   __m128i b2 = _mm_unpacklo_epi16(c[2],c[3]), b3 = _mm_unpackhi_epi16(c[2],c[3]); \
+   __m128i b4 = _mm_unpacklo_epi16(c[4],c[5]), b5 = _mm_unpackhi_epi16(c[4],c[5]); \
+   __m128i b6 = _mm_unpacklo_epi16(c[6],c[7]), b7 = _mm_unpackhi_epi16(c[6],c[7]); \
+   __m128i e0 = _mm_unpacklo_epi32(b0,b2), e1 = _mm_unpackhi_epi32(b0,b2);   \
+   __m128i e2 = _mm_unpacklo_epi32(b1,b3), e3 = _mm_unpackhi_epi32(b1,b3);   \
+   __m128i e4 = _mm_unpacklo_epi32(b4,b6), e5 = _mm_unpackhi_epi32(b4,b6);   \
+   __m128i e6 = _mm_unpacklo_epi32(b5,b7), e7 = _mm_unpackhi_epi32(b5,b7);   \
+   __m128i bias = _mm_set1_epi16(128), r;                                     \
+   r = _mm_packus_epi16(_mm_adds_epi16(_mm_unpacklo_epi64(e0,e4), bias),      \
+                        _mm_adds_epi16(_mm_unpackhi_epi64(e0,e4), bias));     \
+   _mm_storel_epi64((__m128i *) (out              ), r);                      \
+   _mm_storel_epi64((__m128i *) (out + out_stride  ), _mm_srli_si128(r, 8));  \
+   r = _mm_packus_epi16(_mm_adds_epi16(_mm_unpacklo_epi64(e1,e5), bias),      \
+                        _mm_adds_epi16(_mm_unpackhi_epi64(e1,e5), bias));     \
+   _mm_storel_epi64((__m128i *) (out + out_stride*2), r);                     \
+   _mm_storel_epi64((__m128i *) (out + out_stride*3), _mm_srli_si128(r, 8));  \
+   r = _mm_packus_epi16(_mm_adds_epi16(_mm_unpacklo_epi64(e2,e6), bias),      \
+                        _mm_adds_epi16(_mm_unpackhi_epi64(e2,e6), bias));     \
+   _mm_storel_epi64((__m128i *) (out + out_stride*4), r);                     \
+   _mm_storel_epi64((__m128i *) (out + out_stride*5), _mm_srli_si128(r, 8));  \
+   r = _mm_packus_epi16(_mm_adds_epi16(_mm_unpacklo_epi64(e3,e7), bias),      \
+                        _mm_adds_epi16(_mm_unpackhi_epi64(e3,e7), bias));     \
+   _mm_storel_epi64((__m128i *) (out + out_stride*6), r);                     \
+   _mm_storel_epi64((__m128i *) (out + out_stride*7), _mm_srli_si128(r, 8));  \
+}
+
+// SSE2 has no 32-bit multiply, so do the even and odd lanes separately
+// (the low 32 bits come out the same signed or unsigned)
+__attribute__((target("sse2")))
+static __forceinline __m128i mul32_sse2(__m128i a, int c)
+{
+   __m128i k = _mm_set1_epi32(c);
+   __m128i even = _mm_mul_epu32(a, k);
+   __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), k);
+   return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)),
+                             _mm_shuffle_epi32(odd , _MM_SHUFFLE(0,0,2,0)));
+}
+
+#define TRANSPOSE4_SSE2(a,b,c,d) {                                             \
+   __m128i t0 = _mm_unpacklo_epi32(a,b), t1 = _mm_unpacklo_epi32(c,d);        \
+   __m128i t2 = _mm_unpackhi_epi32(a,b), t3 = _mm_unpackhi_epi32(c,d);        \
+   a = _mm_unpacklo_epi64(t0,t1); b = _mm_unpackhi_epi64(t0,t1);              \
+   c = _mm_unpacklo_epi64(t2,t3); d = _mm_unpackhi_epi64(t2,t3);              \
+}
+
+#define ADD_SSE2(a,b)   _mm_add_epi32(a,b)
+#define SUB_SSE2(a,b)   _mm_sub_epi32(a,b)
+#define MUL_SSE2(a,c)   mul32_sse2(a,c)
+#define FSH_SSE2(a)     _mm_slli_epi32(a,12)
+
+__attribute__((target("sse2")))
+static void idct_block_sse2(uint8 *out, int out_stride, short data[64], unsigned short *dequantize)
+{
+   __m128i v[2][8], w[2][8], o[2][8], c[8];
+   int h,i;
+
+   // columns, 4 at a time, dequantizing (16x16 -> 32 bits) on the way in
+   for (h=0; h < 2; ++h) {
+      __m128i s[8];
+      for (i=0; i < 8; ++i) {
+         __m128i d = _mm_loadl_epi64((__m128i const *) (data + i*8 + h*4));
+         __m128i q = _mm_loadl_epi64((__m128i const *) (dequantize + i*8 + h*4));
+         s[i] = _mm_unpacklo_epi16(_mm_mullo_epi16(d, q), _mm_mulhi_epi16(d, q));
+      }
+      {
+         IDCT_1D_VEC(__m128i,ADD_SSE2,SUB_SSE2,MUL_SSE2,FSH_SSE2,s[0],s[1],s[2],s[3],s[4],s[5],s[6],s[7])
+         IDCT_OUT_VEC(ADD_SSE2,SUB_SSE2,_mm_srai_epi32,_mm_set1_epi32(512),10,v[h])
+      }
+   }
 
-   // columns
-   for (i=0; i < 8; ++i,++d,++dq, ++v) {
-      // if all zeroes, shortcut -- this avoids dequantizing 0s and IDCTing
-      if (d[ 8]==0 && d[16]==0 && d[24]==0 && d[32]==0
-           && d[40]==0 && d[48]==0 && d[56]==0) {
-         //    no shortcut                 0     seconds
-         //    (1|2|3|4|5|6|7)==0          0     seconds
-         //    all separate               -0.047 seconds
-         //    1 && 2|3 && 4|5 && 6|7:    -0.047 seconds
-         int dcterm = d[0] * dq[0] << 2;
-         v[0] = v[8] = v[16] = v[24] = v[32] = v[40] = v[48] = v[56] = dcterm;
-      } else {
-         IDCT_1D(d[ 0]*dq[ 0],d[ 8]*dq[ 8],d[16]*dq[16],d[24]*dq[24],
-                 d[32]*dq[32],d[40]*dq[40],d[48]*dq[48],d[56]*dq[56])
-         // constants scaled things up by 1<<12; let's bring them back
-         // down, but keep 2 extra bits of precision
-         x0 += 512; x1 += 512; x2 += 512; x3 += 512;
-         v[ 0] = (x0+t3) >> 10;
-         v[56] = (x0-t3) >> 10;
-         v[ 8] = (x1+t2) >> 10;
-         v[48] = (x1-t2) >> 10;
-         v[16] = (x2+t1) >> 10;
-         v[40] = (x2-t1) >> 10;
-         v[24] = (x3+t0) >> 10;
-         v[32] = (x3-t0) >> 10;
+   // v[h][row] has columns 4h..4h+3; turn that into w[h][column] with rows 4h..4h+3
+   for (h=0; h < 2; ++h)
+      for (i=0; i < 2; ++i) {
+         __m128i a = v[i][h*4], b = v[i][h*4+1], d = v[i][h*4+2], e = v[i][h*4+3];
+         TRANSPOSE4_SSE2(a,b,d,e)
+         w[h][i*4] = a; w[h][i*4+1] = b; w[h][i*4+2] = d; w[h][i*4+3] = e;
       }
+
+   // rows, 4 at a time
+   for (h=0; h < 2; ++h) {
+      IDCT_1D_VEC(__m128i,ADD_SSE2,SUB_SSE2,MUL_SSE2,FSH_SSE2,w[h][0],w[h][1],w[h][2],w[h][3],w[h][4],w[h][5],w[h][6],w[h][7])
+      IDCT_OUT_VEC(ADD_SSE2,SUB_SSE2,_mm_srai_epi32,_mm_set1_epi32(65536),17,o[h])
    }
+   for (i=0; i < 8; ++i)
+      c[i] = _mm_packs_epi32(o[0][i], o[1][i]);
+   IDCT_STORE_SSE2(c,out,out_stride)
+}
 
-   for (i=0, v=val, o=out; i < 8; ++i,v+=8,o+=out_stride) {
-      // no fast case since the first 1D IDCT spread components out
-      IDCT_1D(v[0],v[1],v[2],v[3],v[4],v[5],v[6],v[7])
-      // constants scaled things up by 1<<12, plus we had 1<<2 from first
-      // loop, plus horizontal and vertical each scale by sqrt(8) so together
-      // we've got an extra 1<<3, so 1<<17 total we need to remove.
-      x0 += 65536; x1 += 65536; x2 += 65536; x3 += 65536;
-      o[0] = clamp((x0+t3) >> 17);
-      o[7] = clamp((x0-t3) >> 17);
-      o[1] = clamp((x1+t2) >> 17);
-      o[6] = clamp((x1-t2) >> 17);
-      o[2] = clamp((x2+t1) >> 17);
-      o[5] = clamp((x2-t1) >> 17);
-      o[3] = clamp((x3+t0) >> 17);
-      o[4] = clamp((x3-t0) >> 17);
+#define ADD_AVX2(a,b)   _mm256_add_epi32(a,b)
+#define SUB_AVX2(a,b)   _mm256_sub_epi32(a,b)
+#define MUL_AVX2(a,c)   _mm256_mullo_epi32(a,_mm256_set1_epi32(c))
+#define FSH_AVX2(a)     _mm256_slli_epi32(a,12)
+
+__attribute__((target("avx2")))
+static void idct_block_avx2(uint8 *out, int out_stride, short data[64], unsigned short *dequantize)
+{
+   __m256i s[8], v[8], t[8], u[8], w[8], o[8];
+   __m128i c[8];
+   int i;
+
+   // all 8 columns at once
+   for (i=0; i < 8; ++i) {
+      __m256i d = _mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i const *) (data + i*8)));
+      __m256i q = _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i const *) (dequantize + i*8)));
+      s[i] = _mm256_mullo_epi32(d, q);
+   }
+   {
+      IDCT_1D_VEC(__m256i,ADD_AVX2,SUB_AVX2,MUL_AVX2,FSH_AVX2,s[0],s[1],s[2],s[3],s[4],s[5],s[6],s[7])
+      IDCT_OUT_VEC(ADD_AVX2,SUB_AVX2,_mm256_srai_epi32,_mm256_set1_epi32(512),10,v)
+   }
+
+   // 8x8 transpose: 4x4 within each 128-bit half, then swap halves across
+   for (i=0; i < 8; i += 4) {
+      t[i  ] = _mm256_unpacklo_epi32(v[i  ], v[i+1]);
+      t[i+1] = _mm256_unpackhi_epi32(v[i  ], v[i+1]);
+      t[i+2] = _mm256_unpacklo_epi32(v[i+2], v[i+3]);
+      t[i+3] = _mm256_unpackhi_epi32(v[i+2], v[i+3]);
+      u[i  ] = _mm256_unpacklo_epi64(t[i  ], t[i+2]);
+      u[i+1] = _mm256_unpackhi_epi64(t[i  ], t[i+2]);
+      u[i+2] = _mm256_unpacklo_epi64(t[i+1], t[i+3]);
+      u[i+3] = _mm256_unpackhi_epi64(t[i+1], t[i+3]);
    }
+   for (i=0; i < 4; ++i) {
+      w[i  ] = _mm256_permute2x128_si256(u[i], u[i+4], 0x20);
+      w[i+4] = _mm256_permute2x128_si256(u[i], u[i+4], 0x31);
+   }
+
+   // all 8 rows at once
+   {
+      IDCT_1D_VEC(__m256i,ADD_AVX2,SUB_AVX2,MUL_AVX2,FSH_AVX2,w[0],w[1],w[2],w[3],w[4],w[5],w[6],w[7])
+      IDCT_OUT_VEC(ADD_AVX2,SUB_AVX2,_mm256_srai_epi32,_mm256_set1_epi32(65536),17,o)
+   }
+   for (i=0; i < 8; ++i)
+      c[i] = _mm_packs_epi32(_mm256_castsi256_si128(o[i]), _mm256_extracti128_si256(o[i], 1));
+   IDCT_STORE_SSE2(c,out,out_stride)
 }
+#endif
+
 static stbi_idct_8x8 stbi_idct_installed = idct_block;
 
 extern void stbi_install_idct(stbi_idct_8x8 func)
 {
+   // so the first decode doesn't put the built-in one back
+   simd_init();
    stbi_idct_installed = func;
 }
-#endif
 
 #define MARKER_none  0xff
 // if there's a pending marker from the entropy stream, return that
@@ -1022,9 +1392,6 @@ static int parse_entropy_coded_data(jpeg *z)
    reset(z);
    if (z->scan_n == 1) {
       int i,j;
-      #if STBI_SIMD
-      __declspec(align(16))
-      #endif
       short data[64];
       int n = z->order[0];
       // non-interleaved data, we just need to process one block at a time,
@@ -1035,12 +1402,8 @@ static int parse_entropy_coded_data(jpeg *z)
       int h = (z->img_comp[n].y+7) >> 3;
       for (j=0; j < h; ++j) {
          for (i=0; i < w; ++i) {
-            if (!decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+z->img_comp[n].ha, n)) return 0;
-            #if STBI_SIMD
-            stbi_idct_installed(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
-            #else
-            idct_block(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
-            #endif
+            if (!decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+z->img_comp[n].ha, z->fast_ac[z->img_comp[n].ha], n)) return 0;
+            stbi_idct_installed(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
             // every data block is an MCU, so countdown the restart interval
             if (--z->todo <= 0) {
                if (z->code_bits < 24) grow_buffer_unsafe(z);
@@ -1065,12 +1428,8 @@ static int parse_entropy_coded_data(jpeg *z)
                   for (x=0; x < z->img_comp[n].h; ++x) {
                      int x2 = (i*z->img_comp[n].h + x)*8;
                      int y2 = (j*z->img_comp[n].v + y)*8;
-                     if (!decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+z->img_comp[n].ha, n)) return 0;
-                     #if STBI_SIMD
-                     stbi_idct_installed(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
-                     #else
-                     idct_block(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
-                     #endif
+                     if (!decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+z->img_comp[n].ha, z->fast_ac[z->img_comp[n].ha], n)) return 0;
+                     stbi_idct_installed(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
                   }
                }
             }
@@ -1114,10 +1473,6 @@ static int process_marker(jpeg *z, int m)
             if (t > 3) return e("bad DQT table","Corrupt JPEG");
             for (i=0; i < 64; ++i)
                z->dequant[t][dezigzag[i]] = get8u(&z->s);
-            #if STBI_SIMD
-            for (i=0; i < 64; ++i)
-               z->dequant2[t][i] = dequant[t][i];
-            #endif
             L -= 65;
          }
          return L==0;
@@ -1135,6 +1490,7 @@ static int process_marker(jpeg *z, int m)
                sizes[i] = get8(&z->s);
                m += sizes[i];
             }
+            if (m > 256) return e("bad DHT header","Corrupt JPEG");
             L -= 17;
             if (tc == 0) {
                if (!build_huffman(z->huff_dc+th, sizes)) return 0;
@@ -1145,6 +1501,8 @@ static int process_marker(jpeg *z, int m)
             }
             for (i=0; i < m; ++i)
                v[i] = get8u(&z->s);
+            if (tc != 0)
+               build_fast_ac(z->fast_ac[th], z->huff_ac+th);
             L -= m;
          }
          return L==0;
@@ -1368,6 +1726,46 @@ static uint8 *resample_row_hv_2(uint8 *out, uint8 *in_near, uint8 *in_far, int w
    return out;
 }
 
+#if STBI_X86_SIMD
+// 8 input samples per step; each makes the odd output before it and the
+// even one at it, from its own 3*near+far and the one to its left
+__attribute__((target("sse2")))
+static uint8 *resample_row_hv_2_sse2(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs)
+{
+   __m128i zero = _mm_setzero_si128(), bias = _mm_set1_epi16(8);
+   int i,t0,t1;
+   if (w < 9)
+      return resample_row_hv_2(out, in_near, in_far, w, hs);
+
+   t1 = 3*in_near[0] + in_far[0];
+   out[0] = div4(t1+2);
+   for (i=1; i + 8 <= w; i += 8) {
+      __m128i n  = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i const *) (in_near+i  )), zero);
+      __m128i f  = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i const *) (in_far +i  )), zero);
+      __m128i np = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i const *) (in_near+i-1)), zero);
+      __m128i fp = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i const *) (in_far +i-1)), zero);
+      __m128i cur  = _mm_add_epi16(_mm_add_epi16(n , _mm_slli_epi16(n , 1)), f );
+      __m128i prev = _mm_add_epi16(_mm_add_epi16(np, _mm_slli_epi16(np, 1)), fp);
+      __m128i odd  = _mm_add_epi16(_mm_add_epi16(prev, _mm_slli_epi16(prev, 1)), _mm_add_epi16(cur , bias));
+      __m128i even = _mm_add_epi16(_mm_add_epi16(cur , _mm_slli_epi16(cur , 1)), _mm_add_epi16(prev, bias));
+      odd  = _mm_srli_epi16(odd , 4);
+      even = _mm_srli_epi16(even, 4);
+      _mm_storeu_si128((__m128i *) (out + i*2-1), _mm_packus_epi16(_mm_unpacklo_epi16(odd, even), _mm_unpackhi_epi16(odd, even)));
+   }
+   t1 = 3*in_near[i-1] + in_far[i-1];
+   for (; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = div16(3*t0 + t1 + 8);
+      out[i*2  ] = div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = div4(t1+2);
+   return out;
+}
+#endif
+
+static resample_row_func resample_hv_2 = resample_row_hv_2;
+
 static uint8 *resample_row_generic(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs)
 {
    // resample with nearest-neighbor
@@ -1382,7 +1780,7 @@ static uint8 *resample_row_generic(uint8 *out, uint8 *in_near, uint8 *in_far, in
 
 // 0.38 seconds on 3*anemones.jpg   (0.25 with processor = Pro)
 // VC6 without processor=Pro is generating multiple LEAs per multiply!
-static void YCbCr_to_RGB_row(uint8 *out, uint8 *y, uint8 *pcb, uint8 *pcr, int count, int step)
+static void YCbCr_to_RGB_row(uint8 *out, uint8 const *y, uint8 const *pcb, uint8 const *pcr, int count, int step)
 {
    int i;
    for (i=0; i < count; ++i) {
@@ -1407,14 +1805,127 @@ static void YCbCr_to_RGB_row(uint8 *out, uint8 *y, uint8 *pcb, uint8 *pcr, int c
    }
 }
 
-#if STBI_SIMD
+#if STBI_X86_SIMD
+// YCbCr_to_RGB_row() again, bit for bit, 8 (SSE2) or 16 (AVX2) pixels at a
+// time.  The 16.16 products don't fit a 16-bit multiply, so each constant
+// is split into a power of two (a shift) and a part that does, and the
+// cr and cb terms go through one multiply-add:
+//    1.40200 = 65536 + 26345,  0.71414 = 32768 + 14034,  1.77200 = 131072 - 14942
+#define YCC_CR_R   (float2fixed(1.40200f) - 65536)
+#define YCC_CR_G   (float2fixed(0.71414f) - 32768)
+#define YCC_CB_G   (float2fixed(0.34414f))
+#define YCC_CB_B   (131072 - float2fixed(1.77200f))
+#define YCC_PAIR(cr,cb)   ((int) (((uint32) (cb) << 16) | ((uint32) (cr) & 0xffff)))
+
+// r,g,b: one pixel per byte, in order; writes RGBA, or RGB (+ one junk byte
+// past the end, like the scalar version) when step is 3
+#define YCC_STORE_SSE2(out,step,r8,g8,b8) {                                 \
+   __m128i rg = _mm_unpacklo_epi8(r8, g8);                                 \
+   __m128i ba = _mm_unpacklo_epi8(b8, _mm_set1_epi8((char) 255));          \
+   __m128i q[2];                                                           \
+   int k;                                                                  \
+   q[0] = _mm_unpacklo_epi16(rg, ba);                                      \
+   q[1] = _mm_unpackhi_epi16(rg, ba);                                      \
+   if (step == 4) {                                                        \
+      _mm_storeu_si128((__m128i *) (out     ), q[0]);                      \
+      _mm_storeu_si128((__m128i *) (out + 16), q[1]);                      \
+      out += 32;                                                           \
+   } else                                                                  \
+      for (k=0; k < 8; ++k, out += step) {                                 \
+         int px = _mm_cvtsi128_si32(q[k >> 2]);                            \
+         memcpy(out, &px, 4);                                              \
+         q[k >> 2] = _mm_srli_si128(q[k >> 2], 4);                         \
+      }                                                                    \
+}
+
+__attribute__((target("sse2")))
+static void YCbCr_to_RGB_row_sse2(uint8 *out, uint8 const *y, uint8 const *pcb, uint8 const *pcr, int count, int step)
+{
+   __m128i zero = _mm_setzero_si128(), c128 = _mm_set1_epi16(128), round = _mm_set1_epi32(32768);
+   __m128i k_r = _mm_set1_epi32(YCC_PAIR(YCC_CR_R, 0));
+   __m128i k_g = _mm_set1_epi32(YCC_PAIR(-YCC_CR_G, -YCC_CB_G));
+   __m128i k_b = _mm_set1_epi32(YCC_PAIR(0, -YCC_CB_B));
+   int i;
+   for (i=0; i + 8 <= count; i += 8) {
+      __m128i y16  = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i const *) (y+i)), zero);
+      __m128i cb16 = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((__m128i const *) (pcb+i)), zero), c128);
+      __m128i cr16 = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((__m128i const *) (pcr+i)), zero), c128);
+      __m128i r[2], g[2], b[2];
+      int h;
+      for (h=0; h < 2; ++h) {
+         // y<<16, cr<<16 and cb<<16 fall out of unpacking under zeros
+         __m128i yf   = _mm_add_epi32(h ? _mm_unpackhi_epi16(zero, y16 ) : _mm_unpacklo_epi16(zero, y16 ), round);
+         __m128i cr_s = h ? _mm_unpackhi_epi16(zero, cr16) : _mm_unpacklo_epi16(zero, cr16);
+         __m128i cb_s = h ? _mm_unpackhi_epi16(zero, cb16) : _mm_unpacklo_epi16(zero, cb16);
+         __m128i crcb = h ? _mm_unpackhi_epi16(cr16, cb16) : _mm_unpacklo_epi16(cr16, cb16);
+         r[h] = _mm_add_epi32(_mm_add_epi32(yf, cr_s), _mm_madd_epi16(crcb, k_r));
+         g[h] = _mm_sub_epi32(_mm_add_epi32(yf, _mm_madd_epi16(crcb, k_g)), _mm_srai_epi32(cr_s, 1));
+         b[h] = _mm_add_epi32(_mm_add_epi32(yf, _mm_slli_epi32(cb_s, 1)), _mm_madd_epi16(crcb, k_b));
+         r[h] = _mm_srai_epi32(r[h], 16);
+         g[h] = _mm_srai_epi32(g[h], 16);
+         b[h] = _mm_srai_epi32(b[h], 16);
+      }
+      {
+         __m128i r8 = _mm_packus_epi16(_mm_packs_epi32(r[0], r[1]), zero);
+         __m128i g8 = _mm_packus_epi16(_mm_packs_epi32(g[0], g[1]), zero);
+         __m128i b8 = _mm_packus_epi16(_mm_packs_epi32(b[0], b[1]), zero);
+         YCC_STORE_SSE2(out,step,r8,g8,b8)
+      }
+   }
+   YCbCr_to_RGB_row(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+
+__attribute__((target("avx2")))
+static void YCbCr_to_RGB_row_avx2(uint8 *out, uint8 const *y, uint8 const *pcb, uint8 const *pcr, int count, int step)
+{
+   __m256i zero = _mm256_setzero_si256(), c128 = _mm256_set1_epi16(128), round = _mm256_set1_epi32(32768);
+   __m256i k_r = _mm256_set1_epi32(YCC_PAIR(YCC_CR_R, 0));
+   __m256i k_g = _mm256_set1_epi32(YCC_PAIR(-YCC_CR_G, -YCC_CB_G));
+   __m256i k_b = _mm256_set1_epi32(YCC_PAIR(0, -YCC_CB_B));
+   int i;
+   for (i=0; i + 16 <= count; i += 16) {
+      __m256i y16  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i const *) (y+i)));
+      __m256i cb16 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i const *) (pcb+i))), c128);
+      __m256i cr16 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i const *) (pcr+i))), c128);
+      __m256i r[2], g[2], b[2], r16, g16, b16;
+      int h;
+      // the unpacks work within 128-bit halves, so [0] has pixels 0-3 and
+      // 8-11 and [1] has 4-7 and 12-15; packing puts them back in order
+      for (h=0; h < 2; ++h) {
+         __m256i yf   = _mm256_add_epi32(h ? _mm256_unpackhi_epi16(zero, y16 ) : _mm256_unpacklo_epi16(zero, y16 ), round);
+         __m256i cr_s = h ? _mm256_unpackhi_epi16(zero, cr16) : _mm256_unpacklo_epi16(zero, cr16);
+         __m256i cb_s = h ? _mm256_unpackhi_epi16(zero, cb16) : _mm256_unpacklo_epi16(zero, cb16);
+         __m256i crcb = h ? _mm256_unpackhi_epi16(cr16, cb16) : _mm256_unpacklo_epi16(cr16, cb16);
+         r[h] = _mm256_add_epi32(_mm256_add_epi32(yf, cr_s), _mm256_madd_epi16(crcb, k_r));
+         g[h] = _mm256_sub_epi32(_mm256_add_epi32(yf, _mm256_madd_epi16(crcb, k_g)), _mm256_srai_epi32(cr_s, 1));
+         b[h] = _mm256_add_epi32(_mm256_add_epi32(yf, _mm256_slli_epi32(cb_s, 1)), _mm256_madd_epi16(crcb, k_b));
+         r[h] = _mm256_srai_epi32(r[h], 16);
+         g[h] = _mm256_srai_epi32(g[h], 16);
+         b[h] = _mm256_srai_epi32(b[h], 16);
+      }
+      r16 = _mm256_packs_epi32(r[0], r[1]);
+      g16 = _mm256_packs_epi32(g[0], g[1]);
+      b16 = _mm256_packs_epi32(b[0], b[1]);
+      {
+         __m128i r8 = _mm_packus_epi16(_mm256_castsi256_si128(r16), _mm256_extracti128_si256(r16, 1));
+         __m128i g8 = _mm_packus_epi16(_mm256_castsi256_si128(g16), _mm256_extracti128_si256(g16, 1));
+         __m128i b8 = _mm_packus_epi16(_mm256_castsi256_si128(b16), _mm256_extracti128_si256(b16, 1));
+         YCC_STORE_SSE2(out,step,r8,g8,b8)
+         YCC_STORE_SSE2(out,step,_mm_srli_si128(r8, 8),_mm_srli_si128(g8, 8),_mm_srli_si128(b8, 8))
+      }
+   }
+   YCbCr_to_RGB_row(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+#endif
+
 static stbi_YCbCr_to_RGB_run stbi_YCbCr_installed = YCbCr_to_RGB_row;
 
 void stbi_install_YCbCr_to_RGB(stbi_YCbCr_to_RGB_run func)
 {
+   // so the first decode doesn't put the built-in one back
+   simd_init();
    stbi_YCbCr_installed = func;
 }
-#endif
 
 
 // clean up the temporary component buffers
@@ -1450,6 +1961,8 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
    if (req_comp < 0 || req_comp > 4) return epuc("bad req_comp", "Internal error");
    z->s.img_n = 0;
 
+   simd_init();
+
    // load a jpeg image from whichever source
    if (!decode_jpeg_image(z)) { cleanup_jpeg(z); return NULL; }
 
@@ -1488,12 +2001,12 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
          if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
          else if (r->hs == 1 && r->vs == 2) r->resample = resample_row_v_2;
          else if (r->hs == 2 && r->vs == 1) r->resample = resample_row_h_2;
-         else if (r->hs == 2 && r->vs == 2) r->resample = resample_row_hv_2;
+         else if (r->hs == 2 && r->vs == 2) r->resample = resample_hv_2;
          else                               r->resample = resample_row_generic;
       }
 
       // can't error after this so, this is safe
-      output = (uint8 *) malloc(n * z->s.img_x * z->s.img_y + 1);
+      output = alloc_out(&z->s, n * z->s.img_x * z->s.img_y);
       if (!output) { cleanup_jpeg(z); return epuc("outofmem", "Out of memory"); }
 
       // now go ahead and resample
@@ -1516,15 +2029,21 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
          if (n >= 3) {
             uint8 *y = coutput[0];
             if (z->s.img_n == 3) {
-               #if STBI_SIMD
-               stbi_YCbCr_installed(out, y, coutput[1], coutput[2], z->s.img_x, n);
-               #else
-               YCbCr_to_RGB_row(out, y, coutput[1], coutput[2], z->s.img_x, n);
-               #endif
+               if (n == 3 && j == z->s.img_y-1) {
+                  // RGB conversion writes a junk byte past each pixel, so
+                  // the very last one goes through a scratch pixel instead
+                  // of past the end of the (possibly caller's) buffer
+                  uint8 last[4];
+                  uint32 m = z->s.img_x-1;
+                  stbi_YCbCr_installed(out, y, coutput[1], coutput[2], m, n);
+                  stbi_YCbCr_installed(last, y+m, coutput[1]+m, coutput[2]+m, 1, n);
+                  memcpy(out + 3*m, last, 3);
+               } else
+                  stbi_YCbCr_installed(out, y, coutput[1], coutput[2], z->s.img_x, n);
             } else
                for (i=0; i < z->s.img_x; ++i) {
                   out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
+                  if (n == 4) out[3] = 255;
                   out += n;
                }
          } else {
@@ -1589,29 +2108,72 @@ int stbi_jpeg_test_memory(stbi_uc const *buffer, int len)
    return decode_jpeg_header(&j, SCAN_type);
 }
 
-// @TODO:
+static int jpeg_info(jpeg *j, int *x, int *y, int *comp)
+{
+   if (!decode_jpeg_header(j, SCAN_header)) return 0;
+   if (x) *x = j->s.img_x;
+   if (y) *y = j->s.img_y;
+   if (comp) *comp = j->s.img_n;
+   return 1;
+}
+
 #ifndef STBI_NO_STDIO
-extern int      stbi_jpeg_info            (char const *filename,           int *x, int *y, int *comp);
-extern int      stbi_jpeg_info_from_file  (FILE *f,                  int *x, int *y, int *comp);
+int stbi_jpeg_info_from_file(FILE *f, int *x, int *y, int *comp)
+{
+   int n,r;
+   jpeg j;
+   n = ftell(f);
+   start_file(&j.s, f);
+   r = jpeg_info(&j, x,y,comp);
+   fseek(f,n,SEEK_SET);
+   return r;
+}
+
+int stbi_jpeg_info(char const *filename, int *x, int *y, int *comp)
+{
+   int r;
+   FILE *f = fopen(filename, "rb");
+   if (!f) return e("can't fopen", "Unable to open file");
+   r = stbi_jpeg_info_from_file(f,x,y,comp);
+   fclose(f);
+   return r;
+}
 #endif
-extern int      stbi_jpeg_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp);
+
+int stbi_jpeg_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp)
+{
+   jpeg j;
+   start_mem(&j.s, buffer,len);
+   return jpeg_info(&j, x,y,comp);
+}
 
 // public domain zlib decode    v0.2  Sean Barrett 2006-11-18
 //    simple implementation
 //      - all input must be provided in an upfront buffer
 //      - all output is written to a single output buffer (can malloc/realloc)
 //    performance
-//      - fast huffman
+//      - fast huffman, two literals per lookup where they fit
+//      - 64-bit bit buffer, refilled 8 bytes at a time
 
 // fast-way is faster to check than jpeg huffman, but slow way is slower
-#define ZFAST_BITS  9 // accelerate all cases in default tables
+#define ZFAST_BITS  11 // accelerate all cases in default tables, most in dynamic ones
 #define ZFAST_MASK  ((1 << ZFAST_BITS) - 1)
 
+// a fast table entry is 0 for codes longer than ZFAST_BITS, otherwise it
+// has the symbol and its code size; literal/length tables also pair up a
+// literal with the literal after it when both codes fit in ZFAST_BITS
+#define ZFAST_HIT            (1 << 26)
+#define ZFAST_PAIR           (1 << 25)
+#define ZFAST_SYMBOL(f)      ((f) & 511)
+#define ZFAST_SECOND(f)      (((f) >> 9) & 255)
+#define ZFAST_SIZE(f)        (((f) >> 17) & 15)
+#define ZFAST_PAIR_SIZE(f)   (((f) >> 21) & 15)
+
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
 typedef struct
 {
-   uint16 fast[1 << ZFAST_BITS];
+   uint32 fast[1 << ZFAST_BITS];
    uint16 firstcode[16];
    int maxcode[17];
    uint16 firstsymbol[16];
@@ -1643,7 +2205,7 @@ static int zbuild_huffman(zhuffman *z, uint8 *sizelist, int num)
 
    // DEFLATE spec for generating codes
    memset(sizes, 0, sizeof(sizes));
-   memset(z->fast, 255, sizeof(z->fast));
+   memset(z->fast, 0, sizeof(z->fast));
    for (i=0; i < num; ++i)
       ++sizes[sizelist[i]];
    sizes[0] = 0;
@@ -1670,8 +2232,9 @@ static int zbuild_huffman(zhuffman *z, uint8 *sizelist, int num)
          z->value[c] = (uint16)i;
          if (s <= ZFAST_BITS) {
             int k = bit_reverse(next_code[s],s);
+            uint32 f = ZFAST_HIT | (s << 17) | i;
             while (k < (1 << ZFAST_BITS)) {
-               z->fast[k] = (uint16) c;
+               z->fast[k] = f;
                k += (1 << s);
             }
          }
@@ -1681,6 +2244,24 @@ static int zbuild_huffman(zhuffman *z, uint8 *sizelist, int num)
    return 1;
 }
 
+// for literal/length tables: wherever a literal's code leaves enough bits
+// in the lookup to be sure of the next code, and that's a literal too,
+// store both so the inner loop can write two bytes for one lookup
+static void zbuild_pairs(zhuffman *z)
+{
+   int k;
+   for (k=0; k < (1 << ZFAST_BITS); ++k) {
+      uint32 f = z->fast[k], g;
+      int s = ZFAST_SIZE(f);
+      if (!f || ZFAST_SYMBOL(f) >= 256 || s >= ZFAST_BITS) continue;
+      // only the low ZFAST_BITS-s bits of this index are real, which is
+      // fine as long as the code found there is no longer than that
+      g = z->fast[k >> s];
+      if (g && ZFAST_SYMBOL(g) < 256 && ZFAST_SIZE(g) <= ZFAST_BITS - s)
+         z->fast[k] = f | ZFAST_PAIR | (ZFAST_SYMBOL(g) << 9) | ((s + ZFAST_SIZE(g)) << 21);
+   }
+}
+
 // zlib-from-memory implementation for PNG reading
 //    because PNG allows splitting the zlib stream arbitrarily,
 //    and it's annoying structurally to have PNG call ZLIB call PNG,
@@ -1691,7 +2272,8 @@ typedef struct
 {
    uint8 *zbuffer, *zbuffer_end;
    int num_bits;
-   uint32 code_buffer;
+   uint64 code_buffer;
+   int overrun; // bytes of zeros fed in past the end of the input
 
    char *zout;
    char *zout_start;
@@ -1707,40 +2289,56 @@ __forceinline static int zget8(zbuf *z)
    return *z->zbuffer++;
 }
 
+__forceinline static uint64 zget64(uint8 const *p)
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86) || \
+    (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+   uint64 v;
+   memcpy(&v, p, 8);
+   return v;
+#else
+   int i;
+   uint64 v = 0;
+   for (i=7; i >= 0; --i)
+      v = (v << 8) | p[i];
+   return v;
+#endif
+}
+
 static void fill_bits(zbuf *z)
 {
+   // load 8 bytes and keep as many as fit; whatever lands above num_bits
+   // is the next input anyway, so it's no harm to OR it in again later
+   if (z->zbuffer_end - z->zbuffer >= 8) {
+      z->code_buffer |= zget64(z->zbuffer) << z->num_bits;
+      z->zbuffer += (63 - z->num_bits) >> 3;
+      z->num_bits |= 56;
+      return;
+   }
    do {
-      assert(z->code_buffer < (1U << z->num_bits));
-      z->code_buffer |= zget8(z) << z->num_bits;
+      if (z->zbuffer >= z->zbuffer_end) ++z->overrun;
+      z->code_buffer |= (uint64) zget8(z) << z->num_bits;
       z->num_bits += 8;
-   } while (z->num_bits <= 24);
+   } while (z->num_bits <= 56);
 }
 
 __forceinline static unsigned int zreceive(zbuf *z, int n)
 {
    unsigned int k;
    if (z->num_bits < n) fill_bits(z);
-   k = z->code_buffer & ((1 << n) - 1);
+   k = (unsigned int) (z->code_buffer & ((1 << n) - 1));
    z->code_buffer >>= n;
    z->num_bits -= n;
    return k;
 }
 
-__forceinline static int zhuffman_decode(zbuf *a, zhuffman *z)
+static int zhuffman_decode_slow(zbuf *a, zhuffman *z)
 {
    int b,s,k;
-   if (a->num_bits < 16) fill_bits(a);
-   b = z->fast[a->code_buffer & ZFAST_MASK];
-   if (b < 0xffff) {
-      s = z->size[b];
-      a->code_buffer >>= s;
-      a->num_bits -= s;
-      return z->value[b];
-   }
 
    // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = bit_reverse(a->code_buffer, 16);
+   k = bit_reverse((int) (a->code_buffer & 0xffff), 16);
    for (s=ZFAST_BITS+1; ; ++s)
       if (k < z->maxcode[s])
          break;
@@ -1753,6 +2351,20 @@ __forceinline static int zhuffman_decode(zbuf *a, zhuffman *z)
    return z->value[b];
 }
 
+__forceinline static int zhuffman_decode(zbuf *a, zhuffman *z)
+{
+   uint32 f;
+   if (a->num_bits < 16) fill_bits(a);
+   f = z->fast[a->code_buffer & ZFAST_MASK];
+   if (f) {
+      int s = ZFAST_SIZE(f);
+      a->code_buffer >>= s;
+      a->num_bits -= s;
+      return ZFAST_SYMBOL(f);
+   }
+   return zhuffman_decode_slow(a, z);
+}
+
 static int expand(zbuf *z, int n)  // need to make room for n bytes
 {
    char *q;
@@ -1787,7 +2399,26 @@ static int dist_extra[32] =
 static int parse_huffman_block(zbuf *a)
 {
    for(;;) {
-      int z = zhuffman_decode(a, &a->z_length);
+      uint32 f;
+      int z;
+      // one refill covers a whole length/distance pair (at most 48 bits)
+      if (a->num_bits < 48) fill_bits(a);
+      f = a->z_length.fast[a->code_buffer & ZFAST_MASK];
+      if (f & ZFAST_PAIR) {
+         if (a->zout + 2 > a->zout_end) if (!expand(a, 2)) return 0;
+         a->zout[0] = (char) ZFAST_SYMBOL(f);
+         a->zout[1] = (char) ZFAST_SECOND(f);
+         a->zout += 2;
+         a->code_buffer >>= ZFAST_PAIR_SIZE(f);
+         a->num_bits -= ZFAST_PAIR_SIZE(f);
+         continue;
+      }
+      if (f) {
+         a->code_buffer >>= ZFAST_SIZE(f);
+         a->num_bits -= ZFAST_SIZE(f);
+         z = ZFAST_SYMBOL(f);
+      } else
+         z = zhuffman_decode_slow(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return e("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (a->zout >= a->zout_end) if (!expand(a, 1)) return 0;
@@ -1806,8 +2437,27 @@ static int parse_huffman_block(zbuf *a)
          if (a->zout - a->zout_start < dist) return e("bad dist","Corrupt PNG");
          if (a->zout + len > a->zout_end) if (!expand(a, len)) return 0;
          p = (uint8 *) (a->zout - dist);
-         while (len--)
-            *a->zout++ = *p++;
+         if (dist >= len) {
+            // no overlap
+            memcpy(a->zout, p, len);
+            a->zout += len;
+         } else if (dist == 1) {
+            memset(a->zout, *p, len);
+            a->zout += len;
+         } else if (dist >= 8 && a->zout + len + 8 <= a->zout_end) {
+            // 8 bytes at a time never reads what it's writing; the last
+            // step can run past len into space that's still free
+            char *end = a->zout + len;
+            do {
+               memcpy(a->zout, p, 8);
+               a->zout += 8;
+               p += 8;
+            } while (a->zout < end);
+            a->zout = end;
+         } else {
+            while (len--)
+               *a->zout++ = *p++;
+         }
       }
    }
 }
@@ -1866,12 +2516,19 @@ static int parse_uncompressed_block(zbuf *a)
       zreceive(a, a->num_bits & 7); // discard
    // drain the bit-packed data into header
    k = 0;
-   while (a->num_bits > 0) {
+   while (a->num_bits > 0 && k < 4) {
       header[k++] = (uint8) (a->code_buffer & 255); // wtf this warns?
       a->code_buffer >>= 8;
       a->num_bits -= 8;
    }
-   assert(a->num_bits == 0);
+   // and hand back any whole bytes of real input still in the bit buffer
+   if (a->num_bits >> 3 > a->overrun) {
+      a->zbuffer -= (a->num_bits >> 3) - a->overrun;
+      a->overrun = 0;
+   } else
+      a->overrun -= a->num_bits >> 3;
+   a->code_buffer = 0;
+   a->num_bits = 0;
    // now fill header the normal way
    while (k < 4)
       header[k++] = (uint8) zget8(a);
@@ -1920,6 +2577,7 @@ static int parse_zlib(zbuf *a, int parse_header)
       if (!parse_zlib_header(a)) return 0;
    a->num_bits = 0;
    a->code_buffer = 0;
+   a->overrun = 0;
    do {
       final = zreceive(a,1);
       type = zreceive(a,2);
@@ -1936,6 +2594,7 @@ static int parse_zlib(zbuf *a, int parse_header)
          } else {
             if (!compute_huffman_codes(a)) return 0;
          }
+         zbuild_pairs(&a->z_length);
          if (!parse_huffman_block(a)) return 0;
       }
    } while (!final);
@@ -2075,74 +2734,303 @@ static int paeth(int a, int b, int c)
    return c;
 }
 
-// create the png data from post-deflated data
-static int create_png_image(png *a, uint8 *raw, uint32 raw_len, int out_n)
+// unfilter one row of len bytes with n bytes per pixel from raw into cur;
+// prior is the row above (not touched by the _first filters)
+typedef void (*png_unfilter_proc)(uint8 *cur, uint8 const *raw, uint8 const *prior, int n, int len);
+
+static void unfilter_none(uint8 *cur, uint8 const *raw, uint8 const *prior, int n, int len)
+{
+   memcpy(cur, raw, len);
+}
+
+static void unfilter_sub(uint8 *cur, uint8 const *raw, uint8 const *prior, int n, int len)
+{
+   int i;
+   for (i=0; i < n; ++i) cur[i] = raw[i];
+   for (   ; i < len; ++i) cur[i] = raw[i] + cur[i-n];
+}
+
+static void unfilter_up(uint8 *cur, uint8 const *raw, uint8 const *prior, int n, int len)
+{
+   int i;
+   for (i=0; i < len; ++i) cur[i] = raw[i] + prior[i];
+}
+
+static void unfilter_avg(uint8 *cur, uint8 const *raw, uint8 const *prior, int n, int len)
+{
+   int i;
+   for (i=0; i < n; ++i) cur[i] = raw[i] + (prior[i]>>1);
+   for (   ; i < len; ++i) cur[i] = raw[i] + ((prior[i] + cur[i-n])>>1);
+}
+
+static void unfilter_paeth(uint8 *cur, uint8 const *raw, uint8 const *prior, int n, int len)
+{
+   int i;
+   for (i=0; i < n; ++i) cur[i] = (uint8) (raw[i] + paeth(0,prior[i],0));
+   for (   ; i < len; ++i) cur[i] = (uint8) (raw[i] + paeth(cur[i-n],prior[i],prior[i-n]));
+}
+
+static void unfilter_avg_first(uint8 *cur, uint8 const *raw, uint8 const *prior, int n, int len)
+{
+   int i;
+   for (i=0; i < n; ++i) cur[i] = raw[i];
+   for (   ; i < len; ++i) cur[i] = raw[i] + (cur[i-n] >> 1);
+}
+
+// paeth(a,0,0) is always a, so F_paeth_first is just F_sub
+static png_unfilter_proc png_unfilter[7] =
+{
+   unfilter_none, unfilter_sub, unfilter_up, unfilter_avg, unfilter_paeth,
+   unfilter_avg_first, unfilter_sub,
+};
+
+#if STBI_X86_SIMD
+// Sub is a running sum of every n'th byte, so do it as a prefix sum over as
+// many whole pixels as fit in a register, then carry the last pixel over
+__attribute__((target("sse2")))
+static void unfilter_sub_sse2(uint8 *cur, uint8 const *raw, uint8 const *prior, int n, int len)
+{
+   __m128i last = _mm_setzero_si128(), x;
+   int i=0;
+   #define LOAD()   x = _mm_add_epi8(_mm_loadu_si128((__m128i const *) (raw+i)), last)
+   #define SUM(s)   x = _mm_add_epi8(x, _mm_slli_si128(x, s))
+   #define STORE()  _mm_storeu_si128((__m128i *) (cur+i), x)
+   switch (n) {
+      case 1:
+         for (; i + 16 <= len; i += 16) {
+            LOAD(); SUM(1); SUM(2); SUM(4); SUM(8); STORE();
+            last = _mm_srli_si128(x, 15);
+         }
+         break;
+      case 2:
+         for (; i + 16 <= len; i += 16) {
+            LOAD(); SUM(2); SUM(4); SUM(8); STORE();
+            last = _mm_srli_si128(x, 14);
+         }
+         break;
+      case 3:
+         // 5 pixels per step; the 16th byte is junk, and gets overwritten
+         // by the next step (or the tail below)
+         for (; i + 16 <= len; i += 15) {
+            LOAD(); SUM(3); SUM(6); SUM(12); STORE();
+            last = _mm_and_si128(_mm_srli_si128(x, 12), _mm_cvtsi32_si128(0xffffff));
+         }
+         break;
+      case 4:
+         for (; i + 16 <= len; i += 16) {
+            LOAD(); SUM(4); SUM(8); STORE();
+            last = _mm_srli_si128(x, 12);
+         }
+         break;
+   }
+   #undef LOAD
+   #undef SUM
+   #undef STORE
+   if (i == 0) {
+      unfilter_sub(cur, raw, prior, n, len);
+      return;
+   }
+   for (; i < len; ++i) cur[i] = raw[i] + cur[i-n];
+}
+
+__attribute__((target("sse2")))
+static void unfilter_up_sse2(uint8 *cur, uint8 const *raw, uint8 const *prior, int n, int len)
+{
+   int i;
+   for (i=0; i + 16 <= len; i += 16) {
+      __m128i x = _mm_loadu_si128((__m128i const *) (raw+i));
+      __m128i b = _mm_loadu_si128((__m128i const *) (prior+i));
+      _mm_storeu_si128((__m128i *) (cur+i), _mm_add_epi8(x, b));
+   }
+   for (; i < len; ++i) cur[i] = raw[i] + prior[i];
+}
+
+// Avg and Paeth need the finished pixel to the left, so these do one whole
+// pixel (3 or 4 bytes, as 4) per step instead of one byte; the 4th byte of an
+// RGB pixel is junk that lands on the next pixel and gets overwritten.  The
+// last RGB pixel of a row goes through a bounce buffer so nothing past the
+// row is read or written.
+static __forceinline uint32 load_pixel(uint8 const *p)
+{
+   uint32 v;
+   memcpy(&v, p, 4);
+   return v;
+}
+
+static __forceinline void store_pixel(uint8 *p, uint32 v)
+{
+   memcpy(p, &v, 4);
+}
+
+// floor((a+b)/2) per byte: pavgb rounds up, so take the odd bit back off
+__attribute__((target("sse2")))
+static __forceinline __m128i avg_pixel_sse2(__m128i x, __m128i a, __m128i b)
+{
+   __m128i odd = _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1));
+   return _mm_add_epi8(x, _mm_sub_epi8(_mm_avg_epu8(a, b), odd));
+}
+
+__attribute__((target("sse2")))
+static void unfilter_avg_sse2(uint8 *cur, uint8 const *raw, uint8 const *prior, int n, int len)
+{
+   __m128i a = _mm_setzero_si128();
+   uint8 in[3][4] = { { 0 } };
+   int i;
+   if (n < 3) {
+      unfilter_avg(cur, raw, prior, n, len);
+      return;
+   }
+   for (i=0; i + 4 <= len; i += n) {
+      a = avg_pixel_sse2(_mm_cvtsi32_si128(load_pixel(raw+i)), a, _mm_cvtsi32_si128(load_pixel(prior+i)));
+      store_pixel(cur+i, _mm_cvtsi128_si32(a));
+   }
+   if (i < len) {
+      memcpy(in[0], raw+i, 3);
+      memcpy(in[1], prior+i, 3);
+      a = avg_pixel_sse2(_mm_cvtsi32_si128(load_pixel(in[0])), a, _mm_cvtsi32_si128(load_pixel(in[1])));
+      store_pixel(in[2], _mm_cvtsi128_si32(a));
+      memcpy(cur+i, in[2], 3);
+   }
+}
+
+// same choice as paeth(), on 16-bit lanes: p-a is b-c, p-b is a-c and p-c
+// is (b-c)+(a-c), and ties go to a, then b
+__attribute__((target("sse2")))
+static __forceinline __m128i paeth_pixel_sse2(__m128i x, __m128i a, __m128i b, __m128i c)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i a16 = _mm_unpacklo_epi8(a, zero);
+   __m128i b16 = _mm_unpacklo_epi8(b, zero);
+   __m128i c16 = _mm_unpacklo_epi8(c, zero);
+   __m128i bc = _mm_sub_epi16(b16, c16);
+   __m128i ac = _mm_sub_epi16(a16, c16);
+   __m128i abc = _mm_add_epi16(bc, ac);
+   __m128i pa = _mm_max_epi16(bc, _mm_sub_epi16(zero, bc));
+   __m128i pb = _mm_max_epi16(ac, _mm_sub_epi16(zero, ac));
+   __m128i pc = _mm_max_epi16(abc, _mm_sub_epi16(zero, abc));
+   __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+   __m128i use_a = _mm_cmpeq_epi16(pa, smallest);
+   __m128i use_b = _mm_andnot_si128(use_a, _mm_cmpeq_epi16(pb, smallest));
+   __m128i pred = _mm_andnot_si128(_mm_or_si128(use_a, use_b), c16);
+   pred = _mm_or_si128(pred, _mm_and_si128(use_a, a16));
+   pred = _mm_or_si128(pred, _mm_and_si128(use_b, b16));
+   return _mm_add_epi8(x, _mm_packus_epi16(pred, pred));
+}
+
+__attribute__((target("sse2")))
+static void unfilter_paeth_sse2(uint8 *cur, uint8 const *raw, uint8 const *prior, int n, int len)
+{
+   __m128i a = _mm_setzero_si128(), b, c = _mm_setzero_si128();
+   uint8 in[3][4] = { { 0 } };
+   int i;
+   if (n < 3) {
+      unfilter_paeth(cur, raw, prior, n, len);
+      return;
+   }
+   for (i=0; i + 4 <= len; i += n) {
+      b = _mm_cvtsi32_si128(load_pixel(prior+i));
+      a = paeth_pixel_sse2(_mm_cvtsi32_si128(load_pixel(raw+i)), a, b, c);
+      store_pixel(cur+i, _mm_cvtsi128_si32(a));
+      c = b;
+   }
+   if (i < len) {
+      memcpy(in[0], raw+i, 3);
+      memcpy(in[1], prior+i, 3);
+      b = _mm_cvtsi32_si128(load_pixel(in[1]));
+      a = paeth_pixel_sse2(_mm_cvtsi32_si128(load_pixel(in[0])), a, b, c);
+      store_pixel(in[2], _mm_cvtsi128_si32(a));
+      memcpy(cur+i, in[2], 3);
+   }
+}
+#endif
+
+int stbi_set_simd_level(int level)
+{
+   int best = STBI_SIMD_LEVEL_NONE;
+   #if STBI_X86_SIMD
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("sse2"))  best = STBI_SIMD_LEVEL_SSE2;
+   if (__builtin_cpu_supports("ssse3")) best = STBI_SIMD_LEVEL_SSSE3;
+   if (__builtin_cpu_supports("avx2"))  best = STBI_SIMD_LEVEL_AVX2;
+   #endif
+   if (level == STBI_SIMD_LEVEL_AUTO || level > best)
+      level = best;
+   if (level < STBI_SIMD_LEVEL_NONE)
+      level = STBI_SIMD_LEVEL_NONE;
+
+   add_alpha[1] = add_alpha_1;
+   add_alpha[3] = add_alpha_3;
+   png_unfilter[F_sub]   = unfilter_sub;
+   png_unfilter[F_up]    = unfilter_up;
+   png_unfilter[F_avg]   = unfilter_avg;
+   png_unfilter[F_paeth] = unfilter_paeth;
+   png_unfilter[F_paeth_first] = unfilter_sub;
+   stbi_idct_installed = idct_block;
+   stbi_YCbCr_installed = YCbCr_to_RGB_row;
+   resample_hv_2 = resample_row_hv_2;
+   #if STBI_X86_SIMD
+   if (level >= STBI_SIMD_LEVEL_SSE2) {
+      add_alpha[1] = add_alpha_1_sse2;
+      png_unfilter[F_sub]   = unfilter_sub_sse2;
+      png_unfilter[F_up]    = unfilter_up_sse2;
+      png_unfilter[F_avg]   = unfilter_avg_sse2;
+      png_unfilter[F_paeth] = unfilter_paeth_sse2;
+      png_unfilter[F_paeth_first] = unfilter_sub_sse2;
+      stbi_idct_installed = idct_block_sse2;
+      stbi_YCbCr_installed = YCbCr_to_RGB_row_sse2;
+      resample_hv_2 = resample_row_hv_2_sse2;
+   }
+   if (level >= STBI_SIMD_LEVEL_SSSE3)
+      add_alpha[3] = add_alpha_3_ssse3;
+   if (level >= STBI_SIMD_LEVEL_AVX2) {
+      stbi_idct_installed = idct_block_avx2;
+      stbi_YCbCr_installed = YCbCr_to_RGB_row_avx2;
+   }
+   #endif
+   simd_ready = 1;
+   return level;
+}
+
+// create the png data from post-deflated data; if it's the final image it
+// can go into the caller's buffer
+static int create_png_image(png *a, uint8 *raw, uint32 raw_len, int out_n, int final)
 {
    stbi *s = &a->s;
-   uint32 i,j,stride = s->img_x*out_n;
-   int k;
+   uint32 j, stride = s->img_x*out_n, row_len;
    int img_n = s->img_n; // copy it into a local for later
+   uint8 *rows = NULL;
    assert(out_n == s->img_n || out_n == s->img_n+1);
-   a->out = (uint8 *) malloc(s->img_x * s->img_y * out_n);
+   simd_init();
+   row_len = img_n * s->img_x;
+   if (raw_len != (row_len + 1) * s->img_y) return e("not enough pixels","Corrupt PNG");
+   a->out = final ? alloc_out(s, s->img_x * s->img_y * out_n) : (uint8 *) malloc(s->img_x * s->img_y * out_n);
    if (!a->out) return e("outofmem", "Out of memory");
-   if (raw_len != (img_n * s->img_x + 1) * s->img_y) return e("not enough pixels","Corrupt PNG");
+   // if we're adding an alpha channel, unfilter into two alternating
+   // packed rows and expand each one into the output afterwards; same if
+   // it's the caller's buffer, which may be mapped GPU memory that's slow
+   // to read the prior row back from
+   if (img_n != out_n || a->out == s->out_buffer) {
+      assert(img_n == out_n || add_alpha[img_n]);
+      rows = (uint8 *) malloc(row_len * 2);
+      if (!rows) return e("outofmem", "Out of memory");
+   }
    for (j=0; j < s->img_y; ++j) {
-      uint8 *cur = a->out + stride*j;
-      uint8 *prior = cur - stride;
+      uint8 *out = a->out + stride*j;
+      uint8 *cur = rows ? rows + row_len*(j&1) : out;
+      uint8 *prior = rows ? rows + row_len*(~j&1) : out - stride;
       int filter = *raw++;
-      if (filter > 4) return e("invalid filter","Corrupt PNG");
+      if (filter > 4) {
+         free(rows);
+         return e("invalid filter","Corrupt PNG");
+      }
       // if first row, use special filter that doesn't sample previous row
       if (j == 0) filter = first_row_filter[filter];
-      // handle first pixel explicitly
-      for (k=0; k < img_n; ++k) {
-         switch(filter) {
-            case F_none       : cur[k] = raw[k]; break;
-            case F_sub        : cur[k] = raw[k]; break;
-            case F_up         : cur[k] = raw[k] + prior[k]; break;
-            case F_avg        : cur[k] = raw[k] + (prior[k]>>1); break;
-            case F_paeth      : cur[k] = (uint8) (raw[k] + paeth(0,prior[k],0)); break;
-            case F_avg_first  : cur[k] = raw[k]; break;
-            case F_paeth_first: cur[k] = raw[k]; break;
-         }
-      }
-      if (img_n != out_n) cur[img_n] = 255;
-      raw += img_n;
-      cur += out_n;
-      prior += out_n;
-      // this is a little gross, so that we don't switch per-pixel or per-component
-      if (img_n == out_n) {
-         #define CASE(f) \
-             case f:     \
-                for (i=s->img_x-1; i >= 1; --i, raw+=img_n,cur+=img_n,prior+=img_n) \
-                   for (k=0; k < img_n; ++k)
-         switch(filter) {
-            CASE(F_none)  cur[k] = raw[k]; break;
-            CASE(F_sub)   cur[k] = raw[k] + cur[k-img_n]; break;
-            CASE(F_up)    cur[k] = raw[k] + prior[k]; break;
-            CASE(F_avg)   cur[k] = raw[k] + ((prior[k] + cur[k-img_n])>>1); break;
-            CASE(F_paeth)  cur[k] = (uint8) (raw[k] + paeth(cur[k-img_n],prior[k],prior[k-img_n])); break;
-            CASE(F_avg_first)    cur[k] = raw[k] + (cur[k-img_n] >> 1); break;
-            CASE(F_paeth_first)  cur[k] = (uint8) (raw[k] + paeth(cur[k-img_n],0,0)); break;
-         }
-         #undef CASE
-      } else {
-         assert(img_n+1 == out_n);
-         #define CASE(f) \
-             case f:     \
-                for (i=s->img_x-1; i >= 1; --i, cur[img_n]=255,raw+=img_n,cur+=out_n,prior+=out_n) \
-                   for (k=0; k < img_n; ++k)
-         switch(filter) {
-            CASE(F_none)  cur[k] = raw[k]; break;
-            CASE(F_sub)   cur[k] = raw[k] + cur[k-out_n]; break;
-            CASE(F_up)    cur[k] = raw[k] + prior[k]; break;
-            CASE(F_avg)   cur[k] = raw[k] + ((prior[k] + cur[k-out_n])>>1); break;
-            CASE(F_paeth)  cur[k] = (uint8) (raw[k] + paeth(cur[k-out_n],prior[k],prior[k-out_n])); break;
-            CASE(F_avg_first)    cur[k] = raw[k] + (cur[k-out_n] >> 1); break;
-            CASE(F_paeth_first)  cur[k] = (uint8) (raw[k] + paeth(cur[k-out_n],0,0)); break;
-         }
-         #undef CASE
-      }
+      png_unfilter[filter](cur, raw, prior, img_n, row_len);
+      if (img_n != out_n) add_alpha[img_n](out, cur, s->img_x);
+      else if (rows) memcpy(out, cur, row_len);
+      raw += row_len;
    }
+   free(rows);
    return 1;
 }
 
@@ -2171,12 +3059,12 @@ static int compute_transparency(png *z, uint8 tc[3], int out_n)
    return 1;
 }
 
-static int expand_palette(png *a, uint8 *palette, int len, int pal_img_n)
+static int expand_palette(png *a, uint8 *palette, int len, int pal_img_n, int final)
 {
    uint32 i, pixel_count = a->s.img_x * a->s.img_y;
    uint8 *p, *temp_out, *orig = a->out;
 
-   p = (uint8 *) malloc(pixel_count * pal_img_n);
+   p = final ? alloc_out(&a->s, pixel_count * pal_img_n) : (uint8 *) malloc(pixel_count * pal_img_n);
    if (p == NULL) return e("outofmem", "Out of memory");
 
    // between here and free(out) below, exitting would leak
@@ -2309,16 +3197,21 @@ static int parse_png_file(png *z, int scan, int req_comp)
 
          case PNG_TYPE('I','E','N','D'): {
             uint32 raw_len;
+            int final;
             if (scan != SCAN_load) return 1;
             if (z->idata == NULL) return e("no IDAT","Corrupt PNG");
-            z->expanded = (uint8 *) stbi_zlib_decode_malloc((char *) z->idata, ioff, (int *) &raw_len);
+            // the header tells us exactly how much is coming, so the
+            // output buffer never has to grow
+            raw_len = (s->img_n * s->img_x + 1) * s->img_y;
+            z->expanded = (uint8 *) stbi_zlib_decode_malloc_guesssize((char *) z->idata, ioff, raw_len, (int *) &raw_len);
             if (z->expanded == NULL) return 0; // zlib should set error
             free(z->idata); z->idata = NULL;
             if ((req_comp == s->img_n+1 && req_comp != 3 && !pal_img_n) || has_trans)
                s->img_out_n = s->img_n+1;
             else
                s->img_out_n = s->img_n;
-            if (!create_png_image(z, z->expanded, raw_len, s->img_out_n)) return 0;
+            final = !pal_img_n && (!req_comp || req_comp == s->img_out_n);
+            if (!create_png_image(z, z->expanded, raw_len, s->img_out_n, final)) return 0;
             if (has_trans)
                if (!compute_transparency(z, tc, s->img_out_n)) return 0;
             if (pal_img_n) {
@@ -2326,7 +3219,8 @@ static int parse_png_file(png *z, int scan, int req_comp)
                s->img_n = pal_img_n; // record the actual colors we had
                s->img_out_n = pal_img_n;
                if (req_comp >= 3) s->img_out_n = req_comp;
-               if (!expand_palette(z, palette, pal_len, s->img_out_n))
+               final = !req_comp || req_comp == s->img_out_n;
+               if (!expand_palette(z, palette, pal_len, s->img_out_n, final))
                   return 0;
             }
             free(z->expanded); z->expanded = NULL;
@@ -2365,7 +3259,7 @@ static unsigned char *do_png(png *p, int *x, int *y, int *n, int req_comp)
       result = p->out;
       p->out = NULL;
       if (req_comp && req_comp != p->s.img_out_n) {
-         result = convert_format(result, p->s.img_out_n, req_comp, p->s.img_x, p->s.img_y);
+         result = convert_format(&p->s, result, p->s.img_out_n, req_comp, p->s.img_x, p->s.img_y);
          p->s.img_out_n = req_comp;
          if (result == NULL) return result;
       }
@@ -2373,9 +3267,9 @@ static unsigned char *do_png(png *p, int *x, int *y, int *n, int req_comp)
       *y = p->s.img_y;
       if (n) *n = p->s.img_n;
    }
-   free(p->out);      p->out      = NULL;
-   free(p->expanded); p->expanded = NULL;
-   free(p->idata);    p->idata    = NULL;
+   free_out(&p->s, p->out); p->out      = NULL;
+   free(p->expanded);       p->expanded = NULL;
+   free(p->idata);          p->idata    = NULL;
 
    return result;
 }
@@ -2426,12 +3320,125 @@ int stbi_png_test_memory(stbi_uc const *buffer, int len)
    return parse_png_file(&p, SCAN_type,STBI_default);
 }
 
-// TODO: load header from png
+static int png_info(png *p, int *x, int *y, int *comp)
+{
+   p->idata = NULL;
+   if (!parse_png_file(p, SCAN_header, 0)) return 0;
+   if (x) *x = p->s.img_x;
+   if (y) *y = p->s.img_y;
+   if (comp) *comp = p->s.img_n;
+   return 1;
+}
+
 #ifndef STBI_NO_STDIO
-extern int      stbi_png_info             (char const *filename,           int *x, int *y, int *comp);
-extern int      stbi_png_info_from_file   (FILE *f,                  int *x, int *y, int *comp);
+int stbi_png_info_from_file(FILE *f, int *x, int *y, int *comp)
+{
+   png p;
+   int n,r;
+   n = ftell(f);
+   start_file(&p.s, f);
+   r = png_info(&p, x,y,comp);
+   fseek(f,n,SEEK_SET);
+   return r;
+}
+
+int stbi_png_info(char const *filename, int *x, int *y, int *comp)
+{
+   int r;
+   FILE *f = fopen(filename, "rb");
+   if (!f) return e("can't fopen", "Unable to open file");
+   r = stbi_png_info_from_file(f,x,y,comp);
+   fclose(f);
+   return r;
+}
 #endif
-extern int      stbi_png_info_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp);
+
+int stbi_png_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp)
+{
+   png p;
+   start_mem(&p.s, buffer, len);
+   return png_info(&p, x,y,comp);
+}
+
+// decode into a caller's buffer: jpeg, png and tga write the final image
+// straight into it, everything else decodes as usual and gets copied over
+static stbi_uc *tga_load(stbi *s, int *x, int *y, int *comp, int req_comp);
+
+static int finish_into(stbi_uc *result, stbi_uc *out, int out_size, uint32 size)
+{
+   if (result == out) return 1;
+   if (size > (uint32) out_size) {
+      free(result);
+      return e("buffer too small", "Output buffer too small for image");
+   }
+   memcpy(out, result, size);
+   free(result);
+   return 1;
+}
+
+#ifndef STBI_NO_STDIO
+int stbi_load_from_file_into(FILE *f, stbi_uc *out, int out_size, int *x, int *y, int *comp, int req_comp)
+{
+   stbi_uc *result;
+   int n;
+   if (stbi_jpeg_test_file(f)) {
+      jpeg j;
+      start_file(&j.s, f);
+      start_out(&j.s, out, out_size);
+      result = load_jpeg_image(&j, x,y,&n,req_comp);
+   } else if (stbi_png_test_file(f)) {
+      png p;
+      start_file(&p.s, f);
+      start_out(&p.s, out, out_size);
+      result = do_png(&p, x,y,&n,req_comp);
+   } else if (only_tga_file(f)) {
+      stbi s;
+      start_file(&s, f);
+      start_out(&s, out, out_size);
+      result = tga_load(&s, x,y,&n,req_comp);
+   } else
+      result = stbi_load_from_file(f, x,y,&n,req_comp);
+   if (result == NULL) return 0;
+   if (comp) *comp = n;
+   return finish_into(result, out, out_size, (uint32) *x * *y * (req_comp ? req_comp : n));
+}
+
+int stbi_load_into(char const *filename, stbi_uc *out, int out_size, int *x, int *y, int *comp, int req_comp)
+{
+   int r;
+   FILE *f = fopen(filename, "rb");
+   if (!f) return e("can't fopen", "Unable to open file");
+   r = stbi_load_from_file_into(f, out, out_size, x,y,comp,req_comp);
+   fclose(f);
+   return r;
+}
+#endif
+
+int stbi_load_from_memory_into(stbi_uc const *buffer, int len, stbi_uc *out, int out_size, int *x, int *y, int *comp, int req_comp)
+{
+   stbi_uc *result;
+   int n;
+   if (stbi_jpeg_test_memory(buffer,len)) {
+      jpeg j;
+      start_mem(&j.s, buffer,len);
+      start_out(&j.s, out, out_size);
+      result = load_jpeg_image(&j, x,y,&n,req_comp);
+   } else if (stbi_png_test_memory(buffer,len)) {
+      png p;
+      start_mem(&p.s, buffer,len);
+      start_out(&p.s, out, out_size);
+      result = do_png(&p, x,y,&n,req_comp);
+   } else if (only_tga_memory(buffer,len)) {
+      stbi s;
+      start_mem(&s, buffer,len);
+      start_out(&s, out, out_size);
+      result = tga_load(&s, x,y,&n,req_comp);
+   } else
+      result = stbi_load_from_memory(buffer,len, x,y,&n,req_comp);
+   if (result == NULL) return 0;
+   if (comp) *comp = n;
+   return finish_into(result, out, out_size, (uint32) *x * *y * (req_comp ? req_comp : n));
+}
 
 // Microsoft/Windows BMP image
 
@@ -2692,7 +3699,7 @@ static stbi_uc *bmp_load(stbi *s, int *x, int *y, int *comp, int req_comp)
    }
 
    if (req_comp && req_comp != target) {
-      out = convert_format(out, target, req_comp, s->img_x, s->img_y);
+      out = convert_format(s, out, target, req_comp, s->img_x, s->img_y);
       if (out == NULL) return out; // convert_format frees input on failure
    }
 
@@ -2770,6 +3777,68 @@ int      stbi_tga_test_memory      (stbi_uc const *buffer, int len)
    return tga_test(&s);
 }
 
+//	the header is all there is to read for the size, same checks as tga_load
+static int tga_info(stbi *s, int *x, int *y, int *comp)
+{
+	int tga_indexed, tga_image_type, tga_palette_bits;
+	int tga_width, tga_height, tga_bits_per_pixel;
+	get8u(s);		//	discard Offset
+	tga_indexed = get8u(s);
+	tga_image_type = get8u(s);
+	get16le(s);		//	discard palette start
+	get16le(s);		//	discard palette length
+	tga_palette_bits = get8u(s);
+	get16le(s);		//	discard x origin
+	get16le(s);		//	discard y origin
+	tga_width = get16le(s);
+	tga_height = get16le(s);
+	tga_bits_per_pixel = get8u(s);
+	if( tga_image_type >= 8 ) tga_image_type -= 8;
+	if( (tga_width < 1) || (tga_height < 1) ||
+		(tga_image_type < 1) || (tga_image_type > 3) ||
+		((tga_bits_per_pixel != 8) && (tga_bits_per_pixel != 16) &&
+		(tga_bits_per_pixel != 24) && (tga_bits_per_pixel != 32))
+		)
+	{
+		return 0;
+	}
+	//	paletted images have as many components as their palette
+	if( tga_indexed ) tga_bits_per_pixel = tga_palette_bits;
+	if (x) *x = tga_width;
+	if (y) *y = tga_height;
+	if (comp) *comp = tga_bits_per_pixel / 8;
+	return 1;
+}
+
+#ifndef STBI_NO_STDIO
+int      stbi_tga_info_from_file   (FILE *f, int *x, int *y, int *comp)
+{
+   stbi s;
+   int r,n = ftell(f);
+   start_file(&s, f);
+   r = tga_info(&s, x,y,comp);
+   fseek(f,n,SEEK_SET);
+   return r;
+}
+
+int      stbi_tga_info             (char const *filename, int *x, int *y, int *comp)
+{
+   int r;
+   FILE *f = fopen(filename, "rb");
+   if (!f) return e("can't fopen", "Unable to open file");
+   r = stbi_tga_info_from_file(f,x,y,comp);
+   fclose(f);
+   return r;
+}
+#endif
+
+int      stbi_tga_info_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp)
+{
+   stbi s;
+   start_mem(&s, buffer, len);
+   return tga_info(&s, x,y,comp);
+}
+
 static stbi_uc *tga_load(stbi *s, int *x, int *y, int *comp, int req_comp)
 {
 	//	read in the TGA header stuff
@@ -2834,7 +3903,9 @@ static stbi_uc *tga_load(stbi *s, int *x, int *y, int *comp, int req_comp)
 		//	force a new number of components
 		*comp = tga_bits_per_pixel/8;
 	}
-	tga_data = (unsigned char*)malloc( tga_width * tga_height * req_comp );
+	//	this is the final image, so it can go in the caller's buffer
+	tga_data = alloc_out( s, tga_width * tga_height * req_comp );
+	if( tga_data == NULL ) return epuc("outofmem", "Out of memory");
 
 	//	skip to the data's starting position (offset usually = 0)
 	skip(s, tga_offset );
@@ -3191,7 +4262,7 @@ static stbi_uc *psd_load(stbi *s, int *x, int *y, int *comp, int req_comp)
 	}
 
 	if (req_comp && req_comp != 4) {
-		out = convert_format(out, 4, req_comp, w, h);
+		out = convert_format(s, out, 4, req_comp, w, h);
 		if (out == NULL) return out; // convert_format frees input on failure
 	}
 
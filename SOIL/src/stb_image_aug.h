@@ -13,10 +13,10 @@
       HDR (radiance rgbE format)
       writes BMP,TGA (define STBI_NO_WRITE to remove code)
       decoded from memory or through stdio FILE (define STBI_NO_STDIO to remove code)
-      supports installable dequantizing-IDCT, YCbCr-to-RGB conversion (define STBI_SIMD)
+      supports installable dequantizing-IDCT, YCbCr-to-RGB conversion
         
    TODO:
-      stbi_info_*
+      stbi_info_* for formats other than jpeg, png and tga
   
    history:
       1.16   major bugfix - convert_format converted one too many pixels
@@ -197,6 +197,16 @@ extern int      stbi_info_from_file  (FILE *f,                  int *x, int *y,
 extern stbi_uc *stbi_load_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp);
 // for stbi_load_from_file, file pointer is left pointing immediately after image
 
+// decode into a buffer of out_size bytes you provide (a reused one, a mapped
+// pixel buffer...) instead of a malloced one; it needs x*y*req_comp bytes,
+// or x*y*comp if req_comp is 0, which stbi_info can tell you up front.
+// jpeg, png and tga decode straight into it. returns 1 on success, 0 on failure
+#ifndef STBI_NO_STDIO
+extern int      stbi_load_into           (char const *filename,     stbi_uc *out, int out_size, int *x, int *y, int *comp, int req_comp);
+extern int      stbi_load_from_file_into (FILE *f,                  stbi_uc *out, int out_size, int *x, int *y, int *comp, int req_comp);
+#endif
+extern int      stbi_load_from_memory_into(stbi_uc const *buffer, int len, stbi_uc *out, int out_size, int *x, int *y, int *comp, int req_comp);
+
 #ifndef STBI_NO_HDR
 #ifndef STBI_NO_STDIO
 extern float *stbi_loadf            (char const *filename,     int *x, int *y, int *comp, int req_comp);
@@ -278,12 +288,15 @@ extern stbi_uc *stbi_bmp_load_from_file   (FILE *f,                  int *x, int
 
 // is it a tga?
 extern int      stbi_tga_test_memory      (stbi_uc const *buffer, int len);
+extern int      stbi_tga_info_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp);
 
 extern stbi_uc *stbi_tga_load             (char const *filename,     int *x, int *y, int *comp, int req_comp);
 extern stbi_uc *stbi_tga_load_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp);
 #ifndef STBI_NO_STDIO
+extern int      stbi_tga_info             (char const *filename,     int *x, int *y, int *comp);
 extern int      stbi_tga_test_file        (FILE *f);
 extern stbi_uc *stbi_tga_load_from_file   (FILE *f,                  int *x, int *y, int *comp, int req_comp);
+extern int      stbi_tga_info_from_file   (FILE *f,                  int *x, int *y, int *comp);
 #endif
 
 // is it a psd?
@@ -325,14 +338,29 @@ typedef struct
 // NOT THREADSAFE
 extern int stbi_register_loader(stbi_loader *loader);
 
-// define faster low-level operations (typically SIMD support)
-#if STBI_SIMD
-typedef void (*stbi_idct_8x8)(uint8 *out, int out_stride, short data[64], unsigned short *dequantize);
+// built-in SIMD kernels (PNG unfiltering, adding an alpha channel, JPEG
+// IDCT, YCbCr conversion and 2x2 upsampling), picked at runtime on x86 with
+// GCC/clang; the output is identical at every level.  AUTO (the default)
+// picks the best the CPU has, and you can't go higher than that; returns
+// the level actually in use.  Also replaces anything installed below.
+// NOT THREADSAFE
+enum
+{
+   STBI_SIMD_LEVEL_AUTO = -1,
+   STBI_SIMD_LEVEL_NONE,
+   STBI_SIMD_LEVEL_SSE2,
+   STBI_SIMD_LEVEL_SSSE3,
+   STBI_SIMD_LEVEL_AVX2,
+};
+extern int stbi_set_simd_level(int level);
+
+// replace the low-level JPEG operations (typically with SIMD code)
+typedef void (*stbi_idct_8x8)(stbi_uc *out, int out_stride, short data[64], unsigned short *dequantize);
 // compute an integer IDCT on "input"
 //     input[x] = data[x] * dequantize[x]
 //     write results to 'out': 64 samples, each run of 8 spaced by 'out_stride'
 //                             CLAMP results to 0..255
-typedef void (*stbi_YCbCr_to_RGB_run)(uint8 *output, uint8 const *y, uint8 const *cb, uint8 const *cr, int count, int step);
+typedef void (*stbi_YCbCr_to_RGB_run)(stbi_uc *output, stbi_uc const *y, stbi_uc const *cb, stbi_uc const *cr, int count, int step);
 // compute a conversion from YCbCr to RGB
 //     'count' pixels
 //     write pixels to 'output'; each pixel is 'step' bytes (either 3 or 4; if 4, write '255' as 4th), order R,G,B
@@ -342,7 +370,6 @@ typedef void (*stbi_YCbCr_to_RGB_run)(uint8 *output, uint8 const *y, uint8 const
 
 extern void stbi_install_idct(stbi_idct_8x8 func);
 extern void stbi_install_YCbCr_to_RGB(stbi_YCbCr_to_RGB_run func);
-#endif // STBI_SIMD
 
 #ifdef __cplusplus
 }
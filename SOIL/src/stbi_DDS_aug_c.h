@@ -468,7 +468,7 @@ static stbi_uc *dds_load(stbi *s, int *x, int *y, int *comp, int req_comp)
 		//	user has some requirements, meet them
 		if( req_comp != s->img_n )
 		{
-			dds_data = convert_format( dds_data, s->img_n, req_comp, s->img_x, s->img_y );
+			dds_data = convert_format( s, dds_data, s->img_n, req_comp, s->img_x, s->img_y );
 			*comp = s->img_n;
 		}
 	} else
@@ -476,7 +476,7 @@ static stbi_uc *dds_load(stbi *s, int *x, int *y, int *comp, int req_comp)
 		//	user had no requirements, only drop to RGB is no alpha
 		if( (has_alpha == 0) && (s->img_n == 4) )
 		{
-			dds_data = convert_format( dds_data, 4, 3, s->img_x, s->img_y );
+			dds_data = convert_format( s, dds_data, 4, 3, s->img_x, s->img_y );
 			*comp = 3;
 		}
 	}
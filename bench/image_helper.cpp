@@ -0,0 +1,182 @@
+/** image_helper benchmark
+  *
+  * Runs every image_helper kernel SOIL uses on the load path (upscaling to
+  * a power of two, MIPmapping, NTSC scaling, YCoCg and RGBE conversion) on
+  * synthetic 2048x2048 images with the plain C kernels and with every SIMD
+  * level this CPU has, on one thread and on all of them, checks that every
+  * run produced the same bytes and reports megapixels per second.
+  */
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <image_helper.h>
+
+namespace {
+  const int SIZE = 2048;
+  /* Upscaled to SIZE, like a non power of two texture */
+  const int SMALL = 1500;
+  const int RUNS = 3;
+
+  const char *LEVEL_NAMES[] = { "scalar", "sse2", "ssse3" };
+
+  /* Smooth gradients with some noise, in 'channels' channels */
+  vector<uint8_t> makeImage(int width, int height, int channels) {
+    vector<uint8_t> image(width * height * channels);
+    uint32_t seed = 1;
+
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        seed = seed * 1103515245 + 12345;
+        uint8_t noise = (seed >> 16) & 15;
+        uint8_t *p = &image[(y * width + x) * channels];
+
+        for (int c = 0; c < channels; c++) {
+          p[c] = (x * (c + 1) + y * (3 - c)) / 8 + noise;
+        }
+      }
+    }
+
+    return image;
+  }
+
+  struct Kernel {
+    string name;
+    /* Megapixels it goes through per run */
+    double megapixels;
+    /* Makes 'output' from 'input' */
+    function<void(const vector<uint8_t> &, vector<uint8_t> &)> run;
+    vector<uint8_t> input;
+  };
+
+  /* A kernel that works in place */
+  Kernel inPlace(const string & name, int channels, int (*convert)(unsigned char *, int, int, int)) {
+    return { name, SIZE * SIZE / 1e6, [convert, channels](const vector<uint8_t> & input, vector<uint8_t> & output) {
+      output = input;
+      convert(output.data(), SIZE, SIZE, channels);
+    }, makeImage(SIZE, SIZE, channels) };
+  }
+
+  /* Best of a few runs, in megapixels per second; copying the input for
+   * the in place kernels is part of the time, but it's the same for every
+   * code path */
+  double measure(const Kernel & kernel, vector<uint8_t> & output) {
+    double best = 0.0;
+
+    for (int run = 0; run < RUNS; run++) {
+      auto start = chrono::steady_clock::now();
+      kernel.run(kernel.input, output);
+      auto end = chrono::steady_clock::now();
+
+      double seconds = chrono::duration<double>(end - start).count();
+      double mps = kernel.megapixels / seconds;
+
+      if (mps > best) {
+        best = mps;
+      }
+    }
+
+    return best;
+  }
+
+  vector<Kernel> makeKernels() {
+    vector<Kernel> kernels;
+
+    for (int channels : { 3, 4 }) {
+      string suffix = " " + to_string(channels) + "ch";
+
+      kernels.push_back({ "up_scale" + suffix, SIZE * SIZE / 1e6, [channels](const vector<uint8_t> & input, vector<uint8_t> & output) {
+        output.resize(SIZE * SIZE * channels);
+        up_scale_image(input.data(), SMALL, SMALL, channels, output.data(), SIZE, SIZE);
+      }, makeImage(SMALL, SMALL, channels) });
+
+      /* The first level, and the whole chain the way SOIL builds it:
+       * every level straight from the full size image */
+      kernels.push_back({ "mipmap 2x2" + suffix, SIZE * SIZE / 1e6, [channels](const vector<uint8_t> & input, vector<uint8_t> & output) {
+        output.resize(SIZE * SIZE * channels / 4);
+        mipmap_image(input.data(), SIZE, SIZE, channels, output.data(), 2, 2);
+      }, makeImage(SIZE, SIZE, channels) });
+      kernels.push_back({ "mipmap chain" + suffix, SIZE * SIZE / 1e6, [channels](const vector<uint8_t> & input, vector<uint8_t> & output) {
+        output.clear();
+        vector<uint8_t> level(SIZE * SIZE * channels / 4);
+        for (int block = 2; block <= SIZE; block *= 2) {
+          int size = SIZE / block;
+          mipmap_image(input.data(), SIZE, SIZE, channels, level.data(), block, block);
+          output.insert(output.end(), level.begin(), level.begin() + size * size * channels);
+        }
+      }, makeImage(SIZE, SIZE, channels) });
+
+      kernels.push_back(inPlace("NTSC safe" + suffix, channels, scale_image_RGB_to_NTSC_safe));
+      kernels.push_back(inPlace("RGB to YCoCg" + suffix, channels, convert_RGB_to_YCoCg));
+      kernels.push_back(inPlace("YCoCg to RGB" + suffix, channels, convert_YCoCg_to_RGB));
+    }
+
+    /* RGBE is always 4 channels, and the last one is the exponent */
+    auto rgbe = [](int (*convert)(unsigned char *, int, int, int)) {
+      return [convert](const vector<uint8_t> & input, vector<uint8_t> & output) {
+        output = input;
+        convert(output.data(), SIZE, SIZE, 1);
+      };
+    };
+    auto hdr = makeImage(SIZE, SIZE, 4);
+    for (size_t i = 3; i < hdr.size(); i += 4) {
+      hdr[i] = 120 + hdr[i] % 16;
+    }
+    kernels.push_back({ "RGBE to RGBdivA", SIZE * SIZE / 1e6, rgbe(RGBE_to_RGBdivA), hdr });
+    kernels.push_back({ "RGBE to RGBdivA2", SIZE * SIZE / 1e6, rgbe(RGBE_to_RGBdivA2), hdr });
+
+    return kernels;
+  }
+}
+
+int main() {
+  auto kernels = makeKernels();
+  int levels = set_image_helper_SIMD_level(IMAGE_HELPER_SIMD_AUTO) + 1;
+  bool mismatch = false;
+
+  printf("%-18s", "MP/s");
+  for (int level = 0; level < levels; level++) {
+    printf(" %15s %15s", (string(LEVEL_NAMES[level]) + " 1 thread").c_str(), (string(LEVEL_NAMES[level]) + " all").c_str());
+  }
+  printf("\n");
+
+  for (auto & kernel : kernels) {
+    vector<uint8_t> reference;
+
+    printf("%-18s", kernel.name.c_str());
+    for (int level = 0; level < levels; level++) {
+      set_image_helper_SIMD_level(level);
+
+      for (int threads : { 1, 0 }) {
+        set_image_helper_thread_count(threads);
+
+        vector<uint8_t> output;
+        printf(" %15.1f", measure(kernel, output));
+        fflush(stdout);
+
+        /* Every path has to match the plain C one exactly */
+        if (reference.empty()) {
+          reference = output;
+        } else if (output != reference) {
+          fprintf(stderr, "\n%s differs at %s on %s\n", kernel.name.c_str(), LEVEL_NAMES[level], threads ? "1 thread" : "all threads");
+          mismatch = true;
+        }
+      }
+    }
+    printf("\n");
+  }
+
+  if (mismatch) {
+    fprintf(stderr, "Output differs between code paths!\n");
+    return 1;
+  }
+
+  return 0;
+}
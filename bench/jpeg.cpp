@@ -0,0 +1,119 @@
+/** JPEG decoder benchmark
+  *
+  * Decodes the JPEGs given on the command line (e.g. bench-jpeg
+  * SOIL/img_cheryl.jpg) with the plain C IDCT, color conversion and
+  * upsampling and with every SIMD level this CPU has, checks that every
+  * level produced the same pixels and reports megapixels per second, both
+  * as stored and expanded to RGBA.
+  */
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+
+#include <chrono>
+#include <vector>
+using namespace std;
+
+#include <stb_image_aug.h>
+
+namespace {
+  const int RUNS = 5;
+
+  const char *LEVEL_NAMES[] = { "scalar", "sse2", "ssse3", "avx2" };
+
+  /* Best of a few runs, in megapixels per second */
+  double measure(const vector<uint8_t> & jpeg, int reqComp, vector<uint8_t> & output) {
+    double best = 0.0;
+
+    for (int run = 0; run < RUNS; run++) {
+      int width, height, comp;
+
+      auto start = chrono::steady_clock::now();
+      stbi_uc *data = stbi_jpeg_load_from_memory(jpeg.data(), jpeg.size(), &width, &height, &comp, reqComp);
+      auto end = chrono::steady_clock::now();
+
+      if (!data) {
+        fprintf(stderr, "Decoding failed: %s\n", stbi_failure_reason());
+        exit(1);
+      }
+      output.assign(data, data + width * height * (reqComp ? reqComp : comp));
+      stbi_image_free(data);
+
+      double seconds = chrono::duration<double>(end - start).count();
+      double mps = (double) width * height / 1e6 / seconds;
+
+      if (mps > best) {
+        best = mps;
+      }
+    }
+
+    return best;
+  }
+
+  bool readFile(const char *path, vector<uint8_t> & data) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+      return false;
+    }
+
+    uint8_t buffer[65536];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      data.insert(data.end(), buffer, buffer + read);
+    }
+    fclose(file);
+    return true;
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s image.jpg...\n", argv[0]);
+    return 1;
+  }
+
+  int levels = stbi_set_simd_level(STBI_SIMD_LEVEL_AUTO) + 1;
+  bool mismatch = false;
+
+  printf("%-28s %-8s", "image", "output");
+  for (int level = 0; level < levels; level++) {
+    printf(" %8s MP/s", LEVEL_NAMES[level]);
+  }
+  printf("\n");
+
+  for (int i = 1; i < argc; i++) {
+    vector<uint8_t> jpeg;
+    if (!readFile(argv[i], jpeg)) {
+      fprintf(stderr, "Can't read %s\n", argv[i]);
+      return 1;
+    }
+
+    for (int reqComp : { 0, 4 }) {
+      vector<uint8_t> reference;
+
+      printf("%-28s %-8s", argv[i], reqComp ? "rgba" : "stored");
+      for (int level = 0; level < levels; level++) {
+        stbi_set_simd_level(level);
+
+        vector<uint8_t> output;
+        printf(" %13.1f", measure(jpeg, reqComp, output));
+
+        /* Every level has to match the plain C one */
+        if (level == 0) {
+          reference = output;
+        } else if (output != reference) {
+          mismatch = true;
+        }
+      }
+      printf("\n");
+    }
+  }
+
+  if (mismatch) {
+    fprintf(stderr, "Decoded pixels differ between code paths!\n");
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,555 @@
+/** PNG decoder benchmark
+  *
+  * Unfiltering: encodes synthetic 2048x2048 atlases as PNGs, once per filter
+  * type (and once cycling through all of them) at every channel count,
+  * decodes them with the plain C unfilters and with every SIMD level this
+  * CPU has, checks that every level produced the same pixels and reports
+  * megapixels per second. These images are stored uncompressed, so inflate
+  * costs no more than a copy and the numbers are mostly unfiltering and
+  * alpha expansion.
+  *
+  * Inflate: the same atlases, properly deflated, and any PNGs given on the
+  * command line (e.g. bench-png res/tiles.png res/items.png), reporting how
+  * fast their zlib stream inflates on its own and how fast the whole PNG
+  * decodes. The command line PNGs are also checked at every SIMD level.
+  */
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <chrono>
+#include <queue>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <stb_image_aug.h>
+
+namespace {
+  const int SIZE = 2048;
+  const int TILE = 32;
+  const int RUNS = 3;
+
+  const char *LEVEL_NAMES[] = { "scalar", "sse2", "ssse3", "avx2" };
+  const char *FILTER_NAMES[] = { "none", "sub", "up", "avg", "paeth", "mixed" };
+  const int MIXED = 5;
+
+  /* Tiles of gradients, flat areas and noise, like a sprite atlas */
+  vector<uint8_t> makeAtlas(int channels) {
+    vector<uint8_t> image(SIZE * SIZE * channels);
+    uint32_t seed = 1;
+
+    for (int y = 0; y < SIZE; y++) {
+      for (int x = 0; x < SIZE; x++) {
+        int tile = (y / TILE) * (SIZE / TILE) + x / TILE;
+        seed = seed * 1103515245 + 12345;
+        uint8_t noise = (tile % 3 == 0) ? (seed >> 16) & 31 : 0;
+        uint8_t *p = &image[(y * SIZE + x) * channels];
+
+        for (int c = 0; c < channels; c++) {
+          p[c] = (tile % 5 == 1) ? tile * 37 + c * 50 : (x * (c + 1) + y * (3 - c)) + noise;
+        }
+      }
+    }
+
+    return image;
+  }
+
+  uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+  }
+
+  void put32(vector<uint8_t> & out, uint32_t v) {
+    out.push_back(v >> 24);
+    out.push_back(v >> 16);
+    out.push_back(v >> 8);
+    out.push_back(v);
+  }
+
+  uint32_t crc32(const uint8_t *data, size_t size) {
+    static uint32_t table[256];
+    if (!table[1]) {
+      for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+          c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        }
+        table[i] = c;
+      }
+    }
+
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < size; i++) {
+      crc = table[(crc ^ data[i]) & 255] ^ (crc >> 8);
+    }
+    return crc ^ 0xffffffff;
+  }
+
+  /* Writes DEFLATE bits, least significant first */
+  class BitWriter {
+    public:
+      vector<uint8_t> & out;
+      uint32_t buffer = 0;
+      int bits = 0;
+
+      BitWriter(vector<uint8_t> & out) : out(out) {}
+
+      void put(uint32_t value, int count) {
+        buffer |= value << bits;
+        bits += count;
+        while (bits >= 8) {
+          out.push_back(buffer);
+          buffer >>= 8;
+          bits -= 8;
+        }
+      }
+
+      /* Huffman codes go in most significant bit first */
+      void putCode(uint32_t code, int length) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < length; i++) {
+          reversed |= ((code >> i) & 1) << (length - 1 - i);
+        }
+        put(reversed, length);
+      }
+
+      void flush() {
+        if (bits) {
+          put(0, 8 - bits);
+        }
+      }
+  };
+
+  /* Huffman code lengths for these frequencies, no longer than maxBits
+   * (flattening the frequencies until they fit) */
+  vector<uint8_t> codeLengths(vector<uint32_t> freqs, int maxBits) {
+    vector<uint8_t> lengths(freqs.size());
+
+    for (;;) {
+      typedef pair<uint64_t, int> Node;
+      priority_queue<Node, vector<Node>, greater<Node>> heap;
+      vector<int> parent(freqs.size() * 2, -1);
+      int next = freqs.size();
+
+      for (size_t i = 0; i < freqs.size(); i++) {
+        if (freqs[i]) {
+          heap.push(Node(freqs[i], i));
+        }
+      }
+      while (heap.size() > 1) {
+        Node a = heap.top(); heap.pop();
+        Node b = heap.top(); heap.pop();
+        parent[a.second] = parent[b.second] = next;
+        heap.push(Node(a.first + b.first, next++));
+      }
+
+      bool fits = true;
+      for (size_t i = 0; i < freqs.size(); i++) {
+        int length = 0;
+        for (int node = i; freqs[i] && parent[node] >= 0; node = parent[node]) {
+          length++;
+        }
+        lengths[i] = length;
+        fits = fits && length <= maxBits;
+      }
+      if (fits) {
+        return lengths;
+      }
+
+      for (auto & freq : freqs) {
+        freq = freq ? (freq + 1) / 2 : 0;
+      }
+    }
+  }
+
+  vector<uint32_t> canonicalCodes(const vector<uint8_t> & lengths) {
+    vector<uint32_t> codes(lengths.size());
+    uint32_t code = 0;
+
+    for (int length = 1; length <= 15; length++) {
+      for (size_t i = 0; i < lengths.size(); i++) {
+        if (lengths[i] == length) {
+          codes[i] = code++;
+        }
+      }
+      code <<= 1;
+    }
+
+    return codes;
+  }
+
+  const int LENGTH_BASE[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+  const int LENGTH_EXTRA[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+  const int DIST_BASE[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+  const int DIST_EXTRA[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+  /* A literal (length 0) or a match */
+  struct Token {
+    uint16_t length, dist;
+    uint8_t literal;
+  };
+
+  int symbolFor(const int *base, int count, int value) {
+    int symbol = 0;
+    while (symbol + 1 < count && base[symbol + 1] <= value) {
+      symbol++;
+    }
+    return symbol;
+  }
+
+  /* Greedy LZ77 with hash chains and one dynamic Huffman block per 64K
+   * tokens; nothing like zlib -9, but it makes the same kind of stream */
+  vector<uint8_t> deflate(const vector<uint8_t> & data) {
+    const int WINDOW = 32768, HASH = 1 << 15, CHAIN = 32;
+    vector<int> head(HASH, -1), prev(data.size(), -1);
+    vector<Token> tokens;
+
+    for (size_t i = 0; i < data.size();) {
+      int bestLength = 0, bestDist = 0;
+
+      if (i + 3 <= data.size()) {
+        int hash = ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & (HASH - 1);
+        int chain = CHAIN;
+        for (int j = head[hash]; j >= 0 && i - j <= WINDOW && chain--; j = prev[j]) {
+          int length = 0;
+          while (length < 258 && i + length < data.size() && data[j + length] == data[i + length]) {
+            length++;
+          }
+          if (length > bestLength) {
+            bestLength = length;
+            bestDist = i - j;
+          }
+        }
+        prev[i] = head[hash];
+        head[hash] = i;
+      }
+
+      if (bestLength >= 3) {
+        tokens.push_back({ (uint16_t) bestLength, (uint16_t) bestDist, 0 });
+        /* Only the start of the match goes into the hash chains */
+        i += bestLength;
+      } else {
+        tokens.push_back({ 0, 0, data[i] });
+        i++;
+      }
+    }
+
+    vector<uint8_t> out = { 0x78, 0x01 };
+    BitWriter bits(out);
+
+    for (size_t start = 0; start == 0 || start < tokens.size(); start += 65536) {
+      size_t end = min(tokens.size(), start + 65536);
+      vector<uint32_t> litFreqs(286), distFreqs(30);
+
+      for (size_t t = start; t < end; t++) {
+        if (tokens[t].length) {
+          litFreqs[257 + symbolFor(LENGTH_BASE, 29, tokens[t].length)]++;
+          distFreqs[symbolFor(DIST_BASE, 30, tokens[t].dist)]++;
+        } else {
+          litFreqs[tokens[t].literal]++;
+        }
+      }
+      litFreqs[256] = 1;
+      /* Keep at least two distance codes so the tree is complete */
+      distFreqs[0] += !distFreqs[0];
+      distFreqs[1] += !distFreqs[1];
+
+      auto litLengths = codeLengths(litFreqs, 15);
+      auto distLengths = codeLengths(distFreqs, 15);
+      auto litCodes = canonicalCodes(litLengths);
+      auto distCodes = canonicalCodes(distLengths);
+
+      /* Every code length sent as is, no run length codes */
+      vector<uint32_t> clFreqs(19);
+      for (auto length : litLengths) clFreqs[length]++;
+      for (auto length : distLengths) clFreqs[length]++;
+      clFreqs[0] += !clFreqs[0];
+      clFreqs[1] += !clFreqs[1];
+      auto clLengths = codeLengths(clFreqs, 7);
+      auto clCodes = canonicalCodes(clLengths);
+      static const int CL_ORDER[] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+      bits.put(end == tokens.size(), 1);
+      bits.put(2, 2);
+      bits.put(286 - 257, 5);
+      bits.put(30 - 1, 5);
+      bits.put(19 - 4, 4);
+      for (int i = 0; i < 19; i++) {
+        bits.put(clLengths[CL_ORDER[i]], 3);
+      }
+      for (auto length : litLengths) bits.putCode(clCodes[length], clLengths[length]);
+      for (auto length : distLengths) bits.putCode(clCodes[length], clLengths[length]);
+
+      for (size_t t = start; t < end; t++) {
+        const Token & token = tokens[t];
+        if (!token.length) {
+          bits.putCode(litCodes[token.literal], litLengths[token.literal]);
+          continue;
+        }
+        int symbol = symbolFor(LENGTH_BASE, 29, token.length);
+        bits.putCode(litCodes[257 + symbol], litLengths[257 + symbol]);
+        bits.put(token.length - LENGTH_BASE[symbol], LENGTH_EXTRA[symbol]);
+        symbol = symbolFor(DIST_BASE, 30, token.dist);
+        bits.putCode(distCodes[symbol], distLengths[symbol]);
+        bits.put(token.dist - DIST_BASE[symbol], DIST_EXTRA[symbol]);
+      }
+      bits.putCode(litCodes[256], litLengths[256]);
+    }
+    bits.flush();
+
+    uint32_t s1 = 1, s2 = 0;
+    for (uint8_t byte : data) {
+      s1 = (s1 + byte) % 65521;
+      s2 = (s2 + s1) % 65521;
+    }
+    put32(out, (s2 << 16) | s1);
+    return out;
+  }
+
+  void putChunk(vector<uint8_t> & out, const char *type, const vector<uint8_t> & data) {
+    put32(out, data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    put32(out, crc32(&out[start], out.size() - start));
+  }
+
+  /* An 8-bit PNG with every row filtered with the given filter (or all of
+   * them in turn), deflated for real or with stored blocks only */
+  vector<uint8_t> encodePNG(const vector<uint8_t> & image, int channels, int filter, bool compress) {
+    static const uint8_t COLOR_TYPES[] = { 0, 0, 4, 2, 6 };
+    size_t stride = SIZE * channels;
+
+    vector<uint8_t> filtered;
+    filtered.reserve((stride + 1) * SIZE);
+    for (int y = 0; y < SIZE; y++) {
+      const uint8_t *cur = &image[y * stride];
+      const uint8_t *prior = y ? cur - stride : nullptr;
+      int f = filter == MIXED ? y % 5 : filter;
+
+      filtered.push_back(f);
+      for (size_t i = 0; i < stride; i++) {
+        int a = i >= (size_t) channels ? cur[i - channels] : 0;
+        int b = prior ? prior[i] : 0;
+        int c = prior && i >= (size_t) channels ? prior[i - channels] : 0;
+        int predicted[] = { 0, a, b, (a + b) >> 1, paeth(a, b, c) };
+        filtered.push_back(cur[i] - predicted[f]);
+      }
+    }
+
+    vector<uint8_t> zlib = { 0x78, 0x01 };
+    if (compress) {
+      zlib = deflate(filtered);
+    }
+    for (size_t i = 0; i < filtered.size() && !compress; i += 65535) {
+      size_t len = min<size_t>(65535, filtered.size() - i);
+      zlib.push_back(i + len == filtered.size());
+      zlib.push_back(len);
+      zlib.push_back(len >> 8);
+      zlib.push_back(~len);
+      zlib.push_back(~len >> 8);
+      zlib.insert(zlib.end(), filtered.begin() + i, filtered.begin() + i + len);
+    }
+    uint32_t s1 = 1, s2 = 0;
+    for (uint8_t byte : filtered) {
+      s1 = (s1 + byte) % 65521;
+      s2 = (s2 + s1) % 65521;
+    }
+    if (!compress) {
+      put32(zlib, (s2 << 16) | s1);
+    }
+
+    vector<uint8_t> header;
+    put32(header, SIZE);
+    put32(header, SIZE);
+    header.insert(header.end(), { 8, COLOR_TYPES[channels], 0, 0, 0 });
+
+    vector<uint8_t> png = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    putChunk(png, "IHDR", header);
+    putChunk(png, "IDAT", zlib);
+    putChunk(png, "IEND", {});
+    return png;
+  }
+
+  /* Best of a few runs, in megapixels per second */
+  double measure(const vector<uint8_t> & png, int reqComp, vector<uint8_t> & output) {
+    double best = 0.0;
+
+    for (int run = 0; run < RUNS; run++) {
+      int width, height, comp;
+
+      auto start = chrono::steady_clock::now();
+      stbi_uc *data = stbi_png_load_from_memory(png.data(), png.size(), &width, &height, &comp, reqComp);
+      auto end = chrono::steady_clock::now();
+
+      if (!data) {
+        fprintf(stderr, "Decoding failed: %s\n", stbi_failure_reason());
+        exit(1);
+      }
+      output.assign(data, data + width * height * (reqComp ? reqComp : comp));
+      stbi_image_free(data);
+
+      double seconds = chrono::duration<double>(end - start).count();
+      double mps = (double) width * height / 1e6 / seconds;
+
+      if (mps > best) {
+        best = mps;
+      }
+    }
+
+    return best;
+  }
+
+  /* All the IDAT chunks of a PNG, which together are one zlib stream */
+  vector<uint8_t> zlibStream(const vector<uint8_t> & png) {
+    vector<uint8_t> zlib;
+
+    for (size_t i = 8; i + 8 <= png.size();) {
+      uint32_t length = (png[i] << 24) | (png[i + 1] << 16) | (png[i + 2] << 8) | png[i + 3];
+      if (i + 12 + length > png.size()) {
+        break;
+      }
+      if (equal(&png[i + 4], &png[i + 8], "IDAT")) {
+        zlib.insert(zlib.end(), &png[i + 8], &png[i + 8 + length]);
+      }
+      i += 12 + length;
+    }
+
+    return zlib;
+  }
+
+  /* Inflates a PNG's zlib stream and then decodes the whole PNG, best of a
+   * few runs each; prints megabytes out per second and megapixels per
+   * second */
+  void measureInflate(const char *name, const vector<uint8_t> & png) {
+    auto zlib = zlibStream(png);
+    double bestInflate = 0.0;
+    int outSize = 0;
+
+    for (int run = 0; run < RUNS; run++) {
+      auto start = chrono::steady_clock::now();
+      char *data = stbi_zlib_decode_malloc((const char *) zlib.data(), zlib.size(), &outSize);
+      auto end = chrono::steady_clock::now();
+
+      if (!data) {
+        fprintf(stderr, "Inflating %s failed: %s\n", name, stbi_failure_reason());
+        exit(1);
+      }
+      free(data);
+
+      double seconds = chrono::duration<double>(end - start).count();
+      bestInflate = max(bestInflate, outSize / 1e6 / seconds);
+    }
+
+    vector<uint8_t> output;
+    double decode = measure(png, 0, output);
+
+    printf("%-28s %10zu %10d %12.1f %12.1f\n", name, zlib.size(), outSize, bestInflate, decode);
+  }
+
+  bool readFile(const char *path, vector<uint8_t> & data) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+      return false;
+    }
+
+    uint8_t buffer[65536];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      data.insert(data.end(), buffer, buffer + read);
+    }
+    fclose(file);
+    return true;
+  }
+}
+
+int main(int argc, char **argv) {
+  int levels = stbi_set_simd_level(STBI_SIMD_LEVEL_AUTO) + 1;
+  bool mismatch = false;
+
+  printf("%-14s %-8s", "image", "filter");
+  for (int level = 0; level < levels; level++) {
+    printf(" %8s MP/s", LEVEL_NAMES[level]);
+  }
+  printf("\n");
+
+  /* Grey, grey+alpha, RGB and RGBA as stored, then RGB expanded to RGBA
+   * while unfiltering */
+  for (int channels = 1; channels <= 5; channels++) {
+    int source = channels == 5 ? 3 : channels;
+    int reqComp = channels == 5 ? 4 : 0;
+    auto image = makeAtlas(source);
+
+    for (int filter = 0; filter <= MIXED; filter++) {
+      auto png = encodePNG(image, source, filter, false);
+      vector<uint8_t> reference;
+
+      printf("%-14s %-8s", channels == 5 ? "3->4 channels" : (to_string(channels) + " channels").c_str(), FILTER_NAMES[filter]);
+      for (int level = 0; level < levels; level++) {
+        stbi_set_simd_level(level);
+
+        vector<uint8_t> output;
+        printf(" %13.1f", measure(png, reqComp, output));
+
+        /* Every level has to match the plain C one, which has to match
+         * the image we encoded */
+        if (level == 0) {
+          reference = output;
+          if (reqComp == 0 && reference != image) {
+            mismatch = true;
+          }
+        } else if (output != reference) {
+          mismatch = true;
+        }
+      }
+      printf("\n");
+    }
+  }
+
+  stbi_set_simd_level(STBI_SIMD_LEVEL_AUTO);
+  printf("\n%-28s %10s %10s %12s %12s\n", "image", "zlib bytes", "raw bytes", "inflate MB/s", "decode MP/s");
+
+  /* Mixed filters, like an encoder that picks per row */
+  for (int channels = 1; channels <= 4; channels++) {
+    auto png = encodePNG(makeAtlas(channels), channels, MIXED, true);
+    measureInflate((to_string(channels) + " channels").c_str(), png);
+  }
+
+  for (int i = 1; i < argc; i++) {
+    vector<uint8_t> png;
+    if (!readFile(argv[i], png)) {
+      fprintf(stderr, "Can't read %s\n", argv[i]);
+      return 1;
+    }
+
+    measureInflate(argv[i], png);
+
+    for (int reqComp : { 0, 4 }) {
+      vector<uint8_t> reference;
+
+      for (int level = 0; level < levels; level++) {
+        stbi_set_simd_level(level);
+
+        vector<uint8_t> output;
+        measure(png, reqComp, output);
+        if (level == 0) {
+          reference = output;
+        } else if (output != reference) {
+          fprintf(stderr, "%s decodes differently at %s\n", argv[i], LEVEL_NAMES[level]);
+          mismatch = true;
+        }
+      }
+    }
+  }
+
+  if (mismatch) {
+    fprintf(stderr, "Decoded pixels differ between code paths!\n");
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,411 @@
+/** SOIL pipeline benchmark suite
+  *
+  * Decodes every image given on the command line (the `benchmark` target
+  * passes the samples in SOIL/ and res/) plus a synthetic HDR image to RGBA,
+  * once into memory stb_image allocates and once into a buffer of our own,
+  * then runs the DXT compressors and the image_helper kernels on a
+  * synthetic image, all with the default SIMD level and thread count.
+  *
+  * For each it records the best time over a few runs and, where the build
+  * can track it (see CMakeLists.txt), the peak heap SOIL used on top of
+  * what it held before, and writes them as CSV so two runs can be compared:
+  *
+  *   bench-suite -o before.csv image...
+  *   bench-suite -o after.csv image...
+  *   bench-suite --compare before.csv after.csv
+  */
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+#ifdef TRACK_HEAP
+#include <malloc.h>
+#endif
+
+#include <stb_image_aug.h>
+#include <image_DXT.h>
+#include <image_helper.h>
+
+namespace {
+  /* Every measurement runs at least MIN_RUNS times and then until it has
+   * taken MIN_SECONDS or MAX_RUNS runs, so tiny images get timed often
+   * enough to be stable */
+  const int MIN_RUNS = 3;
+  const int MAX_RUNS = 200;
+  const double MIN_SECONDS = 0.25;
+
+  /* Size of the synthetic images */
+  const int SIZE = 1024;
+  /* Upscaled to SIZE, like a non power of two texture */
+  const int SMALL = 750;
+
+  const char *HEADER = "benchmark,input,width,height,best_ms,megapixels_per_second,peak_heap_bytes";
+
+  /* SOIL's heap use; only the library's own calls to malloc and friends
+   * are routed through the wrappers below */
+  atomic<size_t> heapInUse(0);
+  atomic<size_t> heapPeak(0);
+
+#ifdef TRACK_HEAP
+  const bool HEAP_TRACKED = true;
+
+  void allocated(void *pointer) {
+    if (pointer == nullptr) {
+      return;
+    }
+
+    size_t now = heapInUse += malloc_usable_size(pointer);
+    size_t peak = heapPeak;
+    while (now > peak && !heapPeak.compare_exchange_weak(peak, now)) {
+    }
+  }
+
+  void freed(void *pointer) {
+    if (pointer != nullptr) {
+      heapInUse -= malloc_usable_size(pointer);
+    }
+  }
+#else
+  const bool HEAP_TRACKED = false;
+#endif
+}
+
+#ifdef TRACK_HEAP
+/* Linked with -Wl,--wrap=malloc etc., so these take SOIL's calls and the
+ * __real_ ones are the C library's */
+extern "C" {
+  void *__real_malloc(size_t size);
+  void *__real_calloc(size_t count, size_t size);
+  void *__real_realloc(void *pointer, size_t size);
+  void __real_free(void *pointer);
+
+  void *__wrap_malloc(size_t size) {
+    void *pointer = __real_malloc(size);
+    allocated(pointer);
+    return pointer;
+  }
+
+  void *__wrap_calloc(size_t count, size_t size) {
+    void *pointer = __real_calloc(count, size);
+    allocated(pointer);
+    return pointer;
+  }
+
+  void *__wrap_realloc(void *old, size_t size) {
+    freed(old);
+    void *pointer = __real_realloc(old, size);
+    /* On failure the old block is still there */
+    allocated(pointer != nullptr || size == 0 ? pointer : old);
+    return pointer;
+  }
+
+  void __wrap_free(void *pointer) {
+    freed(pointer);
+    __real_free(pointer);
+  }
+}
+#endif
+
+namespace {
+  struct Result {
+    string benchmark;
+    string input;
+    int width;
+    int height;
+    double bestMs;
+    /* Only meaningful if the heap is tracked */
+    size_t peakHeap;
+  };
+
+  /* Best time of `run` in milliseconds and the most heap any run needed */
+  Result measure(const string & benchmark, const string & input, int width, int height, const function<void()> & run) {
+    double best = 0.0;
+    size_t peak = 0;
+    double total = 0.0;
+
+    for (int runs = 0; runs < MIN_RUNS || (runs < MAX_RUNS && total < MIN_SECONDS); runs++) {
+      size_t before = heapInUse;
+      heapPeak = before;
+
+      auto start = chrono::steady_clock::now();
+      run();
+      auto end = chrono::steady_clock::now();
+
+      double seconds = chrono::duration<double>(end - start).count();
+      total += seconds;
+      if (runs == 0 || seconds * 1000.0 < best) {
+        best = seconds * 1000.0;
+      }
+      peak = max(peak, heapPeak - before);
+    }
+
+    return { benchmark, input, width, height, best, peak };
+  }
+
+  bool readFile(const string & path, vector<uint8_t> & data) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+      return false;
+    }
+
+    uint8_t buffer[65536];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      data.insert(data.end(), buffer, buffer + read);
+    }
+    fclose(file);
+    return true;
+  }
+
+  string extension(const string & path) {
+    size_t dot = path.rfind('.');
+    string format = dot == string::npos ? "unknown" : path.substr(dot + 1);
+    transform(format.begin(), format.end(), format.begin(), ::tolower);
+    return format;
+  }
+
+  /* Smooth gradients with some noise and hard edges */
+  vector<uint8_t> makeImage(int width, int height) {
+    vector<uint8_t> image(width * height * 4);
+    uint32_t seed = 1;
+
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        seed = seed * 1103515245 + 12345;
+        uint8_t noise = (seed >> 16) & 15;
+        uint8_t *p = &image[(y * width + x) * 4];
+
+        p[0] = (x >> 2) + noise;
+        p[1] = (y >> 2) + noise;
+        p[2] = ((x / 64 + y / 64) & 1) ? 200 : 40;
+        p[3] = (x ^ y) & 255;
+      }
+    }
+
+    return image;
+  }
+
+  /* A Radiance file of the same image, run length encoded the way real
+   * ones are (only with literal runs), since there's no HDR sample */
+  vector<uint8_t> makeHDR() {
+    vector<uint8_t> image = makeImage(SIZE, SIZE);
+    string header = "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " + to_string(SIZE) + " +X " + to_string(SIZE) + "\n";
+    vector<uint8_t> hdr(header.begin(), header.end());
+
+    for (int y = 0; y < SIZE; y++) {
+      uint8_t *row = &image[y * SIZE * 4];
+      hdr.insert(hdr.end(), { 2, 2, uint8_t(SIZE >> 8), uint8_t(SIZE & 255) });
+
+      for (int c = 0; c < 4; c++) {
+        for (int x = 0; x < SIZE; x += 128) {
+          int count = min(128, SIZE - x);
+          hdr.push_back(count);
+          for (int i = 0; i < count; i++) {
+            /* Keep the exponents around 1.0 */
+            hdr.push_back(c == 3 ? 124 + row[(x + i) * 4 + 3] % 8 : row[(x + i) * 4 + c]);
+          }
+        }
+      }
+    }
+
+    return hdr;
+  }
+
+  /* Decodes to RGBA both ways; false if stb_image can't decode it */
+  bool benchmarkDecode(const string & input, const string & format, const vector<uint8_t> & data, vector<Result> & results) {
+    int width, height, comp;
+    if (!stbi_info_from_memory(data.data(), data.size(), &width, &height, &comp)) {
+      return false;
+    }
+
+    results.push_back(measure("decode " + format, input, width, height, [&]() {
+      int w, h, c;
+      stbi_image_free(stbi_load_from_memory(data.data(), data.size(), &w, &h, &c, 4));
+    }));
+
+    vector<uint8_t> pixels(width * height * 4);
+    results.push_back(measure("decode-into " + format, input, width, height, [&]() {
+      int w, h, c;
+      stbi_load_from_memory_into(data.data(), data.size(), pixels.data(), pixels.size(), &w, &h, &c, 4);
+    }));
+
+    return true;
+  }
+
+  void benchmarkKernels(vector<Result> & results) {
+    const string input = "synthetic";
+    vector<uint8_t> image = makeImage(SIZE, SIZE);
+    vector<uint8_t> small = makeImage(SMALL, SMALL);
+    vector<uint8_t> output(image.size());
+
+    results.push_back(measure("dxt1", input, SIZE, SIZE, [&]() {
+      int size;
+      free(convert_image_to_DXT1(image.data(), SIZE, SIZE, 4, &size));
+    }));
+    results.push_back(measure("dxt5", input, SIZE, SIZE, [&]() {
+      int size;
+      free(convert_image_to_DXT5(image.data(), SIZE, SIZE, 4, &size));
+    }));
+
+    results.push_back(measure("up_scale", input, SIZE, SIZE, [&]() {
+      up_scale_image(small.data(), SMALL, SMALL, 4, output.data(), SIZE, SIZE);
+    }));
+    results.push_back(measure("mipmap", input, SIZE, SIZE, [&]() {
+      mipmap_image(image.data(), SIZE, SIZE, 4, output.data(), 2, 2);
+    }));
+
+    /* The rest work in place, so the copy is part of the time */
+    auto inPlace = [&](const string & name, int (*convert)(unsigned char *, int, int, int), int last) {
+      results.push_back(measure(name, input, SIZE, SIZE, [&]() {
+        output = image;
+        convert(output.data(), SIZE, SIZE, last);
+      }));
+    };
+    inPlace("ntsc_safe", scale_image_RGB_to_NTSC_safe, 4);
+    inPlace("rgb_to_ycocg", convert_RGB_to_YCoCg, 4);
+    inPlace("ycocg_to_rgb", convert_YCoCg_to_RGB, 4);
+    /* The last argument is rescale_to_max for these */
+    inPlace("rgbe_to_rgbdiva", RGBE_to_RGBdivA, 1);
+    inPlace("rgbe_to_rgbdiva2", RGBE_to_RGBdivA2, 1);
+  }
+
+  void writeResults(FILE *out, const vector<Result> & results) {
+    fprintf(out, "%s\n", HEADER);
+
+    for (auto & result : results) {
+      double megapixels = double(result.width) * result.height / 1e6;
+      fprintf(out, "%s,%s,%d,%d,%.4f,%.2f,", result.benchmark.c_str(), result.input.c_str(),
+          result.width, result.height, result.bestMs, megapixels / (result.bestMs / 1000.0));
+      if (HEAP_TRACKED) {
+        fprintf(out, "%zu", result.peakHeap);
+      }
+      fprintf(out, "\n");
+    }
+  }
+
+  /* benchmark,input -> the rest of the line, split on commas */
+  bool readResults(const char *path, map<string, vector<string>> & results, vector<string> & order) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+      return false;
+    }
+
+    char line[4096];
+    bool header = true;
+    while (fgets(line, sizeof(line), file)) {
+      line[strcspn(line, "\r\n")] = '\0';
+      if (header) {
+        header = false;
+        continue;
+      }
+
+      vector<string> fields;
+      char *start = line;
+      for (char *comma; (comma = strchr(start, ',')) != nullptr; start = comma + 1) {
+        fields.push_back(string(start, comma));
+      }
+      fields.push_back(start);
+
+      if (fields.size() == 7) {
+        string key = fields[0] + "," + fields[1];
+        if (!results.count(key)) {
+          order.push_back(key);
+        }
+        results[key] = fields;
+      }
+    }
+
+    fclose(file);
+    return true;
+  }
+
+  int compare(const char *beforePath, const char *afterPath) {
+    map<string, vector<string>> before, after;
+    vector<string> order, afterOrder;
+    if (!readResults(beforePath, before, order) || !readResults(afterPath, after, afterOrder)) {
+      fprintf(stderr, "Can't read %s or %s\n", beforePath, afterPath);
+      return 1;
+    }
+
+    printf("%-24s %-28s %10s %10s %8s %12s %12s\n", "benchmark", "input", "before ms", "after ms", "speedup", "before heap", "after heap");
+    for (auto & key : order) {
+      if (!after.count(key)) {
+        continue;
+      }
+
+      auto & b = before[key];
+      auto & a = after[key];
+      double beforeMs = atof(b[4].c_str());
+      double afterMs = atof(a[4].c_str());
+      printf("%-24s %-28s %10.3f %10.3f %7.2fx %12s %12s\n", b[0].c_str(), b[1].c_str(),
+          beforeMs, afterMs, beforeMs / afterMs, b[6].c_str(), a[6].c_str());
+    }
+
+    return 0;
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc == 4 && strcmp(argv[1], "--compare") == 0) {
+    return compare(argv[2], argv[3]);
+  }
+
+  const char *outputPath = nullptr;
+  vector<string> inputs;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      outputPath = argv[++i];
+    } else {
+      inputs.push_back(argv[i]);
+    }
+  }
+
+  if (inputs.empty()) {
+    fprintf(stderr, "Usage: %s [-o results.csv] image...\n       %s --compare before.csv after.csv\n", argv[0], argv[0]);
+    return 1;
+  }
+
+  vector<Result> results;
+  bool failed = false;
+
+  for (auto & input : inputs) {
+    vector<uint8_t> data;
+    if (!readFile(input, data)) {
+      fprintf(stderr, "Can't read %s\n", input.c_str());
+      failed = true;
+    } else if (!benchmarkDecode(input, extension(input), data, results)) {
+      fprintf(stderr, "Can't decode %s: %s\n", input.c_str(), stbi_failure_reason());
+      failed = true;
+    }
+  }
+
+  if (!benchmarkDecode("synthetic.hdr", "hdr", makeHDR(), results)) {
+    fprintf(stderr, "Can't decode the synthetic HDR image: %s\n", stbi_failure_reason());
+    failed = true;
+  }
+
+  benchmarkKernels(results);
+
+  FILE *out = outputPath ? fopen(outputPath, "w") : stdout;
+  if (!out) {
+    fprintf(stderr, "Can't write %s\n", outputPath);
+    return 1;
+  }
+  writeResults(out, results);
+  if (outputPath) {
+    fclose(out);
+  }
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+
+#include <GL/glew.h>
+
+/* Where an image packed into an atlas ended up: the texture of the page
+ * it's on, and its rectangle there in texture coordinates */
+struct AtlasRegion {
+  GLuint texture;
+  GLfloat x, y, w, h;
+};
+
+/* Looks up the image at `path` in the atlases tools/atlas.cpp packed (see
+ * atlas.txt in ROGUE_BAKED_DIR), loading the page it's on the first time
+ * one of its images is asked for. False if it wasn't packed, in which
+ * case it has to be loaded by itself. */
+bool findAtlasRegion(const std::string & path, AtlasRegion & region);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/* Files kept between runs so the slow part of starting up (linking
+ * shaders, rasterizing glyphs) only happens once. Each file is named
+ * after a hash of everything that went into it, so anything that
+ * changes just misses and starts a new file. */
+namespace Cache {
+  /* FNV-1a; start from OFFSET and feed everything that goes into the key */
+  const uint64_t OFFSET = 0xcbf29ce484222325ull;
+  uint64_t hash(uint64_t h, const void *data, size_t size);
+
+  inline uint64_t hash(uint64_t h, const std::string & data) {
+    return hash(h, data.data(), data.size());
+  }
+
+  /* Where the file for `key` goes in `directory` */
+  std::string path(const char *directory, uint64_t key);
+
+  /* Writes `path` through `contents`, which returns whether all of it
+   * went out, creating its directory first. The file only shows up once
+   * it's complete; false, and nothing left behind, if it couldn't be. */
+  bool write(const std::string & path, const std::function<bool(FILE *)> & contents);
+}
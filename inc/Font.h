@@ -1,6 +1,8 @@
 #pragma once
 
 #include <vector>
+#include <list>
+#include <unordered_map>
 #include <string>
 #include <stdexcept>
 using namespace std;
@@ -15,24 +17,121 @@ using namespace glm;
 #include FT_FREETYPE_H
 
 #include <Shader.h>
+#include <StreamBuffer.h>
 
-struct Character {
-  GLuint textureID; /* ID handle of the glyph texture              */
-  ivec2  size;      /* Size of glyph                               */
-  ivec2  bearing;   /* Offset from baseline to left / top of glyph */
-  GLuint advance;   /* Offset to advance to next glyph             */
+/* A glyph in the atlas */
+struct Glyph {
+  uint32_t codepoint;
+  GLuint   pixelSize;
+  ivec2    position;  /* Top left in the atlas                       */
+  ivec2    size;      /* Size of glyph                               */
+  ivec2    bearing;   /* Offset from baseline to left / top of glyph */
+  GLuint   advance;   /* Offset to advance to next glyph             */
+  /* Shelf it sits on, or -1 for glyphs with nothing to draw */
+  int      shelf;
+  /* render() call it was last used in */
+  uint64_t used;
 };
 
+/* Text in a TrueType font, UTF-8 encoded. Glyphs are rasterized the
+ * first time they're drawn and packed into one atlas texture in rows
+ * ("shelves"). When the atlas is full, the shelf of the glyph that went
+ * unused the longest is cleared for new ones.
+ *
+ * As bitmaps, a glyph is rasterized for every size it's drawn in. As
+ * signed distance fields, it's rasterized once at SDF_SIZE and the text
+ * shader draws that at any size, sharp edges and all.
+ *
+ * What's in the atlas is saved to font-cache/ when the font goes away
+ * and mapped back in the next time the same font is made, so FreeType
+ * only opens the face once a glyph that isn't there yet is drawn. */
 class Font {
+  public:
+    enum Mode { BITMAP, SDF };
+
   private:
-    vector<Character> characters;
-    Shader shader;
+    /* Side of the atlas, in pixels */
+    static const int ATLAS_SIZE = 512;
+    /* Size distance fields are made at, and how many pixels on either
+     * side of an edge they reach */
+    static const int SDF_SIZE = 32;
+    static const int SDF_SPREAD = 4;
+
+    Mode mode;
+
+    struct Shelf {
+      int y, height;
+      /* Where the next glyph goes */
+      int x;
+    };
+
+    FT_Library library;
+    string path;
+    /* Opened on the first glyph that isn't in the atlas yet; null until
+     * then */
+    FT_Face face;
+    GLuint defaultSize;
+    /* What the face is set to */
+    GLuint faceSize;
+
+    GLuint atlas;
+    /* What's in it, to save to the cache */
+    vector<uint8_t> pixels;
+    vector<Shelf> shelves;
+
+    /* Most recently used first */
+    list<Glyph> glyphs;
+    unordered_map<uint64_t, list<Glyph>::iterator> lookup;
+    uint64_t renders;
+    /* A glyph didn't fit, even after evicting everything that could be */
+    bool atlasFull;
+
+    /* Where the atlas is cached, and whether it's changed since */
+    string cache;
+    bool dirty;
 
+    Shader & shader;
+
+    /* The quads are written into `stream` */
+    StreamBuffer & stream;
     GLuint vao;
-    GLuint vbo;
+
+    bool openFace();
+
+    /* Fills the atlas from the cache; false if there's none that's
+     * usable */
+    bool loadCache();
+    void saveCache() const;
+
+    /* The distance field of `bitmap`, which is `size` big; `size` becomes
+     * the size of the field */
+    static vector<uint8_t> distanceField(const FT_Bitmap & bitmap, ivec2 & size);
+
+    /* The glyph, rasterized if it has to be; null if it can't be */
+    const Glyph * glyph(uint32_t codepoint, GLuint pixelSize);
+
+    /* Finds room for a `width` by `height` bitmap; false if there's none
+     * without evicting anything */
+    bool allocate(int width, int height, ivec2 & position, int & shelf);
+    /* Adds `delta` to the shelf of every glyph on shelf `from` or after */
+    void renumberShelves(int from, int delta);
+    /* Makes room by clearing the shelf of the least recently used glyph
+     * that isn't used in this render() call; false if there's none */
+    bool evict();
 
   public:
-    Font(FT_Library ft, string path);
+    Font(FT_Library ft, string path, StreamBuffer & stream, GLuint size = 8, Mode mode = BITMAP);
+    ~Font();
+
+    Font(const Font &) = delete;
+    Font & operator=(const Font &) = delete;
+
+    /* Draws `text` with its baseline starting at `position`, at `size`
+     * pixels (the font's own size for 0) scaled by `scale` */
+    void render(const string & text, vec2 position, vec4 color = vec4(0), float scale = 1.0f, GLuint size = 0);
 
-    void render(string text, vec2 position, vec4 color = vec4(0), float scale = 1.0f);
+    Mode getMode() const { return mode; }
+    /* Glyphs in the atlas, and how many of its rows the shelves take */
+    size_t glyphCount() const { return glyphs.size(); }
+    int atlasRows() const { return shelves.empty() ? 0 : shelves.back().y + shelves.back().height; }
 };
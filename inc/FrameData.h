@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include <GL/glew.h>
+
+#include <StreamBuffer.h>
+
+/* What every shader draws with for a whole pass, laid out like the std140
+ * `Frame` uniform block in the shaders; only per-instance data is left to
+ * plain uniforms */
+struct FrameData {
+  mat4 projection;
+  mat4 view;
+  mat4 tileSize;
+  /* Pixels to clip space, for the UI and text */
+  mat4 screen;
+  GLfloat time;
+  GLfloat padding[3];
+};
+
+/* Room for a frame's worth of blocks, a few passes with one each; what
+ * each segment of the `stream` given to bindFrameData should hold */
+const GLsizeiptr FRAME_DATA_SEGMENT_SIZE = 4096;
+
+/* Writes `data` into `stream` and binds it as the `Frame` block of every
+ * shader (see Shader::FRAME_BINDING) for whatever is drawn next.
+ *
+ * The block stays bound for the whole pass, so `stream` is one of its
+ * own: vertices written into a shared one could wrap over it, or orphan
+ * it on GL 3.3, while it's still being drawn with */
+void bindFrameData(StreamBuffer & stream, const FrameData & data);
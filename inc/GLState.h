@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+#include <GL/glew.h>
+
+/* Remembers the program, VAO, 2D texture bindings and blending last set
+ * through it and skips the calls that wouldn't change anything.
+ *
+ * Everything that changes those has to go through here, or the cache
+ * goes stale; code that can't (SOIL binds textures by itself) has to
+ * `invalidate()` after. Deleting objects has to go through here too,
+ * since GL unbinds them by itself, and so does drawing, to be counted. */
+namespace GLState {
+  struct Counters {
+    /* Calls that made it to GL */
+    uint64_t issued;
+    /* Calls that were skipped for setting what was set already */
+    uint64_t skipped;
+    /* Draw calls */
+    uint64_t draws;
+  };
+
+  void useProgram(GLuint program);
+  void bindVertexArray(GLuint vao);
+  /* Binds `texture` to GL_TEXTURE_2D on texture unit `unit` */
+  void bindTexture(GLuint texture, GLuint unit = 0);
+
+  void setBlend(bool enabled);
+  void blendFunc(GLenum source, GLenum destination);
+
+  /* Draw as usual, counted */
+  void drawArrays(GLenum mode, GLint first, GLsizei count);
+  void drawElements(GLenum mode, GLsizei count, GLenum type, const void *indices);
+
+  void deleteTextures(GLsizei count, const GLuint *textures);
+  void deleteVertexArrays(GLsizei count, const GLuint *vaos);
+
+  /* Forgets everything, so the next call of each kind is issued */
+  void invalidate();
+
+  const Counters & counters();
+  void resetCounters();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <GL/glew.h>
+
+/* A GL 3.3 core context with no window, drawing into a framebuffer
+ * object instead; for running the renderer where there's no display, as
+ * in automated benchmarks and golden image tests.
+ *
+ * The context comes from EGL: on Mesa's surfaceless platform where
+ * there's one, which renders on llvmpipe with no GPU at all, or on the
+ * default display otherwise. Builds without EGL can't make one. */
+class Offscreen {
+  private:
+    struct Egl;
+    std::unique_ptr<Egl> egl;
+
+    int width, height;
+    GLuint framebuffer, color, depth;
+
+  public:
+    /* Makes the context and makes it current; throws std::runtime_error
+     * if there's no way to */
+    Offscreen(int width, int height);
+    ~Offscreen();
+
+    Offscreen(const Offscreen &) = delete;
+    Offscreen & operator=(const Offscreen &) = delete;
+
+    /* Makes the framebuffer the one drawn into, creating it the first
+     * time; GL has to be loaded by then */
+    void bind();
+
+    /* Reads back what was drawn and saves it as a .tga, .bmp or .dds,
+     * by extension; false if it can't be written */
+    bool save(const std::string & path) const;
+};
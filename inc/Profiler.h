@@ -0,0 +1,61 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include <Trace.h>
+
+class Font;
+
+/* Frame profiler: how long named scopes take on the CPU and render passes
+ * take on the GPU, as min / average / 99th percentile over the last few
+ * hundred frames, and an overlay that shows it.
+ *
+ * CPU scopes nest and add up over a frame, so a scope entered several
+ * times a frame shows its total. GPU passes can't nest (only one
+ * GL_TIME_ELAPSED query runs at a time) and are read back a few frames
+ * late, so the pipeline never waits for them. Names have to be string
+ * literals; they're kept as pointers. */
+namespace Profiler {
+  void beginFrame();
+  void endFrame();
+
+  /* Times the CPU from construction to destruction, and shows up in the
+   * trace if one is being recorded */
+  class Scope {
+    private:
+      Trace::Scope trace;
+
+    public:
+      Scope(const char *name);
+      ~Scope();
+  };
+
+  /* Times the GPU on the commands issued from construction to destruction */
+  class GpuScope {
+    public:
+      GpuScope(const char *name);
+      ~GpuScope();
+  };
+
+  struct Summary {
+    /* Milliseconds */
+    double min, average, p99;
+    size_t samples;
+  };
+
+  /* Keeps the last `frames` frames from now on, instead of a few hundred */
+  void setWindow(size_t frames);
+
+  /* Over the frames kept; false if `name` wasn't timed in any. GPU passes
+   * go by their names too */
+  bool summarize(const char *name, Summary & summary);
+
+  bool visible();
+  void toggle();
+
+  /* Draws the numbers at `position`, if visible */
+  void render(Font & font, vec2 position);
+}
@@ -5,24 +5,51 @@
 
 #include <GL/glew.h>
 
+#include <glm/glm.hpp>
+
+#include <GLState.h>
+
+/* Generated from res/ by tools/embed_shaders.cpp */
+#include <EmbeddedShaders.h>
+
 class Shader {
   private:
-    static GLuint create_shader(GLenum type, const char *path);
-    static GLuint create_program(const char *vertpath, const char *fragpath);
+    static GLuint create_shader(GLenum type, const std::string & contents);
+    static void check_shader(GLuint shader_id, const std::string & path);
+
+    std::string vertpath, fragpath;
+    /* Where the linked program is cached, if anywhere */
+    std::string cache;
+
+    GLuint vert_shader, frag_shader;
+    /* Still compiling and linking; see finish() */
+    bool pending;
 
   public:
+    /* Uniform buffer binding the `Frame` block of every shader reads from
+     * (see FrameData.h) */
+    static const GLuint FRAME_BINDING = 0;
+
     GLuint id;
 
-    Shader(const char *vertpath, const char *fragpath) {
-      id = create_program(vertpath, fragpath);
-    };
+    /* Loads the linked program from shader-cache/ if the driver made one
+     * from the same sources before. Otherwise it starts compiling and
+     * linking the embedded sources without waiting for either. */
+    Shader(ShaderSourceId vert, ShaderSourceId frag);
+
+    Shader(const Shader &) = delete;
+    Shader & operator=(const Shader &) = delete;
+
+    /* Waits for the program to link, reports what went wrong if anything
+     * did and caches it for next time */
+    void finish();
 
     void use() const {
-      glUseProgram(id);
+      GLState::useProgram(id);
     };
 
     void disuse() const {
-      glUseProgram(0);
+      GLState::useProgram(0);
     }
 
     GLuint location(std::string name) const {
@@ -34,3 +61,22 @@ class Shader {
       throw std::invalid_argument { "I don't know how to set a uniform of that type." };
     }
 };
+
+/* The types there are setters for, in Shader.cpp; without these, code
+ * elsewhere would get the throwing one above */
+template <> void Shader::setUniform<GLfloat>(std::string name, const GLfloat &value);
+template <> void Shader::setUniform<GLuint>(std::string name, const GLuint &value);
+template <> void Shader::setUniform<GLint>(std::string name, const GLint &value);
+template <> void Shader::setUniform<glm::vec2>(std::string name, const glm::vec2 &value);
+template <> void Shader::setUniform<glm::vec3>(std::string name, const glm::vec3 &value);
+template <> void Shader::setUniform<glm::vec4>(std::string name, const glm::vec4 &value);
+template <> void Shader::setUniform<glm::mat3>(std::string name, const glm::mat3 &matrix);
+template <> void Shader::setUniform<glm::mat4>(std::string name, const glm::mat4 &matrix);
+
+/* Starts compiling a program for getShader() to hand out later, so
+ * several can compile at once while the rest of startup goes on */
+void preloadShader(ShaderSourceId vert, ShaderSourceId frag);
+
+/* The one program for these sources, shared by everyone who asks for it;
+ * compiled on first use unless it was preloaded */
+Shader & getShader(ShaderSourceId vert, ShaderSourceId frag);
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+#include <GL/glew.h>
+
+/* Ring buffer for vertex data that's written anew every frame.
+ *
+ * With ARB_buffer_storage the whole ring stays mapped for good and is
+ * split into one segment per frame in flight. A segment gets a fence once
+ * the frame is done with it and is only written again once the GPU has
+ * passed that fence, so nothing ever waits on the driver.
+ *
+ * Without it (plain GL 3.3) the ring is filled front to back through
+ * unsynchronized maps, and orphaned when it runs out so the driver can
+ * hand out fresh memory while the old one is still being drawn from.
+ *
+ * Either way, vertices go straight into memory the GPU reads from; VAOs
+ * point their attributes at `buffer()` once and draw from the offset
+ * `map()` hands back. */
+class StreamBuffer {
+  private:
+    GLuint vbo;
+
+    GLsizeiptr segmentSize;
+    /* One per frame in flight */
+    std::vector<GLsync> fences;
+    size_t segment;
+
+    /* Where the next allocation goes, from the start of the buffer */
+    GLsizeiptr head;
+
+    /* The whole buffer, when it's persistently mapped */
+    uint8_t *persistent;
+
+    /* Waits for the next segment to be free and moves on to it */
+    void nextSegment();
+
+  public:
+    StreamBuffer(GLsizeiptr segmentSize = 1 << 20, size_t frames = 3);
+    ~StreamBuffer();
+
+    StreamBuffer(const StreamBuffer &) = delete;
+    StreamBuffer & operator=(const StreamBuffer &) = delete;
+
+    GLuint buffer() const {
+      return vbo;
+    }
+
+    /* The most one `map()` hands out */
+    GLsizeiptr capacity() const {
+      return segmentSize;
+    }
+
+    /* Room for `size` bytes at an `offset` into `buffer()` that is a
+     * multiple of `alignment` (the vertex size, so `offset / alignment` is
+     * the first vertex to draw), to be filled before `unmap()`. Null if
+     * it's nothing or more than a segment holds, in which case there's
+     * nothing to unmap either. */
+    void *map(GLsizeiptr size, GLsizeiptr alignment, GLintptr & offset);
+    void unmap();
+
+    /* Marks the end of the frame's vertices; call once per frame */
+    void endFrame();
+};
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+#include <GL/glew.h>
+
+/* Where the build writes what it bakes out of res/ (see CMakeLists.txt),
+ * so it's found whichever directory the game is run from */
+#ifndef ROGUE_BAKED_DIR
+#define ROGUE_BAKED_DIR "baked/"
+#endif
+
+/* Loads the image at `path` into `texture`. If a baked, DXT compressed
+ * `.dds` of it is in ROGUE_BAKED_DIR (see tools/bake.cpp) and the driver
+ * can take S3TC data, that is uploaded directly with its MIPmaps;
+ * otherwise the image itself is decoded and uploaded as RGBA. */
+void loadTexture(GLuint texture, const std::string & path, int * width = nullptr, int * height = nullptr);
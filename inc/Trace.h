@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/* Timeline of what every thread did, for looking at long sessions
+ * offline: scopes are recorded with when they started and how long they
+ * took, and written out as a Chrome trace (chrome://tracing, Perfetto).
+ *
+ * Every thread records into a buffer of its own, so recording never
+ * waits on anything; while not recording a scope costs one load. Names
+ * and categories have to be string literals, they're kept as pointers
+ * and written out as they are. */
+namespace Trace {
+  void start();
+  void stop();
+  bool recording();
+
+  /* Writes out everything recorded since the last write and forgets it;
+   * false if the file couldn't be written */
+  bool write(const std::string & path);
+
+  class Scope {
+    private:
+      const char *name;
+      const char *category;
+      uint64_t begin;
+      bool active;
+
+    public:
+      Scope(const char *name, const char *category = "game");
+      ~Scope();
+
+      Scope(const Scope &) = delete;
+      Scope & operator=(const Scope &) = delete;
+  };
+}
@@ -0,0 +1,8 @@
+/* What stays the same for a whole pass; see inc/FrameData.h */
+layout (std140) uniform Frame {
+  mat4 projection;
+  mat4 view;
+  mat4 tileSize;
+  mat4 screen;
+  float time;
+};
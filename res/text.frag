@@ -8,5 +8,15 @@ uniform sampler2D text;
 uniform vec4 textColor;
 
 void main() {
-  color = vec4(textColor.rgb, texture(text, uv).r * textColor.a);
+#ifdef SDF
+  /* A distance field, with the edge at 0.5; it's smoothed over about a
+   * pixel on screen, however big that is in the field */
+  float distance = texture(text, uv).r;
+  float width = 0.7 * fwidth(distance);
+  float coverage = smoothstep(0.5 - width, 0.5 + width, distance);
+#else
+  float coverage = texture(text, uv).r;
+#endif
+
+  color = vec4(textColor.rgb, coverage * textColor.a);
 }
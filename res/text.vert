@@ -1,13 +1,13 @@
 #version 330 core
 
+#include "frame.glsl"
+
 layout (location = 0) in vec2 position;
 layout (location = 1) in vec2 tex;
 
 out vec2 uv;
 
-uniform mat4 projection;
-
 void main() {
-  gl_Position = projection * vec4(position, 0.0, 1.0);
+  gl_Position = screen * vec4(position, 0.0, 1.0);
   uv = tex;
 }
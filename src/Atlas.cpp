@@ -0,0 +1,90 @@
+#include <Atlas.h>
+
+#include <cstdio>
+
+#include <unordered_map>
+#include <vector>
+
+#include <Texture.h>
+
+namespace {
+  /* Written by the build (see CMakeLists.txt), pages and all */
+  const std::string TABLE_DIRECTORY = ROGUE_BAKED_DIR;
+  const std::string TABLE_PATH = TABLE_DIRECTORY + "atlas.txt";
+
+  struct Page {
+    std::string path;
+    int width, height;
+    /* Loaded on first use */
+    GLuint texture;
+  };
+
+  struct Entry {
+    size_t page;
+    int x, y, width, height;
+  };
+
+  bool loaded = false;
+  std::vector<Page> pages;
+  std::unordered_map<std::string, Entry> entries;
+
+  /* Reads the table; no table just means nothing was packed */
+  void loadTable() {
+    loaded = true;
+
+    FILE *file = fopen(TABLE_PATH.c_str(), "r");
+    if (file == nullptr) {
+      return;
+    }
+
+    char name[512];
+    int x, y, w, h;
+
+    while (fscanf(file, "%511s", name) == 1) {
+      if (std::string(name) == "page") {
+        if (fscanf(file, "%511s %d %d", name, &w, &h) != 3) {
+          break;
+        }
+        pages.push_back({ TABLE_DIRECTORY + name, w, h, 0 });
+      } else {
+        if (fscanf(file, "%d %d %d %d", &x, &y, &w, &h) != 4 || pages.empty()) {
+          break;
+        }
+        entries[name] = { pages.size() - 1, x, y, w, h };
+      }
+    }
+
+    if (!feof(file)) {
+      fprintf(stderr, "Malformed atlas table '%s'\n", TABLE_PATH.c_str());
+    }
+
+    fclose(file);
+  }
+}
+
+bool findAtlasRegion(const std::string & path, AtlasRegion & region) {
+  if (!loaded) {
+    loadTable();
+  }
+
+  auto entry = entries.find(path);
+  if (entry == entries.end()) {
+    return false;
+  }
+
+  Page & page = pages[entry->second.page];
+  if (page.texture == 0) {
+    glGenTextures(1, &page.texture);
+    loadTexture(page.texture, page.path);
+  }
+
+  region = {
+    page.texture,
+    GLfloat(entry->second.x) / page.width,
+    GLfloat(entry->second.y) / page.height,
+    GLfloat(entry->second.width) / page.width,
+    GLfloat(entry->second.height) / page.height,
+  };
+
+  return true;
+}
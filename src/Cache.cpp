@@ -0,0 +1,55 @@
+#include <Cache.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#define make_directory(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define make_directory(path) mkdir(path, 0755)
+#endif
+
+uint64_t Cache::hash(uint64_t h, const void *data, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    h = (h ^ static_cast<const uint8_t *>(data)[i]) * 0x100000001b3ull;
+  }
+  return h;
+}
+
+std::string Cache::path(const char *directory, uint64_t key) {
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long) key);
+  return directory + std::string(name);
+}
+
+bool Cache::write(const std::string & path, const std::function<bool(FILE *)> & contents) {
+  size_t slash = path.rfind('/');
+  if (slash != std::string::npos) {
+    make_directory(path.substr(0, slash).c_str());
+  }
+
+  /* Written beside it and then moved over it, so another instance
+   * starting up meanwhile never maps half a file */
+  std::string partial = path + ".tmp";
+
+  FILE *file = fopen(partial.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  bool written = contents(file);
+  written = fclose(file) == 0 && written;
+
+#ifdef _WIN32
+  written = written && MoveFileExA(partial.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+  written = written && rename(partial.c_str(), path.c_str()) == 0;
+#endif
+
+  /* Half a file would only be rejected on every start */
+  if (!written) {
+    remove(partial.c_str());
+  }
+
+  return written;
+}
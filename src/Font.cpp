@@ -1,75 +1,282 @@
 #include <Font.h>
 
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
+#include <algorithm>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <Cache.h>
+#include <Trace.h>
+
 namespace {
-  const int SCREEN_WIDTH  = 640;
-  const int SCREEN_HEIGHT = 480;
-}
+  const uint32_t REPLACEMENT_CHARACTER = 0xfffd;
 
-Font::Font(FT_Library ft, std::string path)
-  : shader("res/text.vert", "res/text.frag")
-{
-  /* Load the face */
-  FT_Face face;
+  /* The code point starting at `c`, moving `c` past it; malformed
+   * sequences come out as U+FFFD, a byte at a time */
+  uint32_t decodeUtf8(string::const_iterator & c, string::const_iterator end) {
+    uint8_t lead = *c++;
+
+    if (lead < 0x80) {
+      return lead;
+    }
+
+    int length;
+    uint32_t codepoint;
+
+    if ((lead & 0xe0) == 0xc0) {
+      length = 1;
+      codepoint = lead & 0x1f;
+    } else if ((lead & 0xf0) == 0xe0) {
+      length = 2;
+      codepoint = lead & 0x0f;
+    } else if ((lead & 0xf8) == 0xf0) {
+      length = 3;
+      codepoint = lead & 0x07;
+    } else {
+      return REPLACEMENT_CHARACTER;
+    }
+
+    auto start = c;
+    for (int i = 0; i < length; i++) {
+      if (c == end || (uint8_t(*c) & 0xc0) != 0x80) {
+        c = start;
+        return REPLACEMENT_CHARACTER;
+      }
+
+      codepoint = (codepoint << 6) | (uint8_t(*c++) & 0x3f);
+    }
 
-  if (FT_New_Face(ft, path.c_str(), 0, &face)) {
-    throw runtime_error("Failed to load font '" + path + "'.");
+    /* Overlong encodings, surrogates and what's past Unicode */
+    static const uint32_t SMALLEST[] = { 0, 0x80, 0x800, 0x10000 };
+    if (codepoint < SMALLEST[length] || (codepoint >= 0xd800 && codepoint <= 0xdfff) || codepoint > 0x10ffff) {
+      c = start;
+      return REPLACEMENT_CHARACTER;
+    }
+
+    return codepoint;
   }
 
-  FT_Set_Pixel_Sizes(face, 0, 8);
+  uint64_t glyphKey(uint32_t codepoint, GLuint pixelSize) {
+    return (uint64_t(pixelSize) << 32) | codepoint;
+  }
 
-  /* Generate the charset */
-  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  /* Atlases are kept here, one file per font, size, mode and FreeType */
+  const char *CACHE_DIRECTORY = "font-cache";
 
-  for (GLubyte c = 0; c < 128; c++) {
-    /* Load character glyph */
-    if (FT_Load_Char(face, c, FT_LOAD_RENDER)) {
-      fprintf(stderr, "Failed to load glyph 0x%x.\n", c);
-      continue;
+  /* Identifies a header, so caches from older builds are left alone */
+  const uint32_t CACHE_MAGIC = 0x46475352;
+
+  /* Followed by the shelves, the glyphs, most recently used first, and
+   * then the atlas */
+  struct CacheHeader {
+    uint32_t magic;
+    uint32_t shelves;
+    uint32_t glyphs;
+  };
+
+  /* A whole file mapped into memory, read only; `data` is null if it
+   * couldn't be */
+  class MappedFile {
+    private:
+#ifdef _WIN32
+      HANDLE mapping;
+#endif
+
+    public:
+      const uint8_t *data;
+      size_t size;
+
+      MappedFile(const string & path)
+        : data(nullptr)
+        , size(0)
+      {
+#ifdef _WIN32
+        mapping = nullptr;
+
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+          return;
+        }
+
+        LARGE_INTEGER length;
+        if (GetFileSizeEx(file, &length) && length.QuadPart > 0) {
+          mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        }
+        CloseHandle(file);
+
+        if (mapping != nullptr) {
+          data = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+          size = data != nullptr ? size_t(length.QuadPart) : 0;
+        }
+#else
+        int file = open(path.c_str(), O_RDONLY);
+        if (file < 0) {
+          return;
+        }
+
+        struct stat info;
+        if (fstat(file, &info) == 0 && info.st_size > 0) {
+          void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+
+          if (mapped != MAP_FAILED) {
+            data = static_cast<const uint8_t *>(mapped);
+            size = info.st_size;
+          }
+        }
+
+        /* The mapping stays without it */
+        close(file);
+#endif
+      }
+
+      ~MappedFile() {
+#ifdef _WIN32
+        if (data != nullptr) {
+          UnmapViewOfFile(data);
+        }
+        if (mapping != nullptr) {
+          CloseHandle(mapping);
+        }
+#else
+        if (data != nullptr) {
+          munmap(const_cast<uint8_t *>(data), size);
+        }
+#endif
+      }
+
+      MappedFile(const MappedFile &) = delete;
+      MappedFile & operator=(const MappedFile &) = delete;
+  };
+
+  /* Squared distance from each of the `n` samples `stride` apart in `f`
+   * to the nearest one that's 0, in place, given the squared distances
+   * along the other axis (Felzenszwalb & Huttenlocher) */
+  void distanceTransform(float * f, int n, int stride, vector<float> & d, vector<int> & v, vector<float> & z) {
+    d.resize(n);
+    v.resize(n);
+    z.resize(n + 1);
+
+    int k = 0;
+    v[0] = 0;
+    z[0] = -INFINITY;
+    z[1] = INFINITY;
+
+    /* The lower envelope of the parabolas rooted at every sample */
+    for (int q = 1; q < n; q++) {
+      float s;
+      while ((s = ((f[q * stride] + q * q) - (f[v[k] * stride] + v[k] * v[k])) / (2 * q - 2 * v[k])) <= z[k]) {
+        k--;
+      }
+
+      k++;
+      v[k] = q;
+      z[k] = s;
+      z[k + 1] = INFINITY;
+    }
+
+    k = 0;
+    for (int q = 0; q < n; q++) {
+      while (z[k + 1] < q) {
+        k++;
+      }
+
+      d[q] = (q - v[k]) * (q - v[k]) + f[v[k] * stride];
+    }
+
+    for (int q = 0; q < n; q++) {
+      f[q * stride] = d[q];
     }
+  }
+
+  /* Squared distance from every pixel to the glyph's edge, for those
+   * outside it or, with `inside`, for those inside; edge pixels start out
+   * as far from it as their coverage says */
+  vector<float> distances(const vector<float> & coverage, bool inside, int width, int height) {
+    /* Far enough to never be nearest and still square without overflow */
+    const float FAR = 1e10f;
+
+    vector<float> grid(width * height);
+    for (size_t i = 0; i < grid.size(); i++) {
+      float a = inside ? 1.0f - coverage[i] : coverage[i];
+
+      if (a == 1.0f) {
+        grid[i] = 0.0f;
+      } else if (a == 0.0f) {
+        grid[i] = FAR;
+      } else {
+        float edge = std::max(0.0f, 0.5f - a);
+        grid[i] = edge * edge;
+      }
+    }
+
+    vector<float> d, z;
+    vector<int> v;
+
+    for (int x = 0; x < width; x++) {
+      distanceTransform(&grid[x], height, width, d, v, z);
+    }
+
+    for (int y = 0; y < height; y++) {
+      distanceTransform(&grid[y * width], width, 1, d, v, z);
+    }
+
+    return grid;
+  }
+}
 
-    /* Generate texture */
-    GLuint texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        GL_RED,
-        face->glyph->bitmap.width,
-        face->glyph->bitmap.rows,
-        0,
-        GL_RED,
-        GL_UNSIGNED_BYTE,
-        face->glyph->bitmap.buffer
-    );
+Font::Font(FT_Library ft, std::string p, StreamBuffer & s, GLuint size, Mode m)
+  : mode(m)
+  , library(ft)
+  , path(p)
+  , face(nullptr)
+  , defaultSize(size)
+  , faceSize(0)
+  , pixels(ATLAS_SIZE * ATLAS_SIZE, 0)
+  , renders(0)
+  , atlasFull(false)
+  , dirty(false)
+  , shader(getShader(SHADER_TEXT_VERT, m == SDF ? SHADER_TEXT_FRAG_SDF : SHADER_TEXT_FRAG))
+  , stream(s)
+{
+  /* Generate the atlas, with whatever was cached in it */
+  glGenTextures(1, &atlas);
+  GLState::bindTexture(atlas);
+    if (!loadCache()) {
+      /* Cleared, since filtering reads past the glyphs into what's
+       * around them */
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, ATLAS_SIZE, ATLAS_SIZE, 0, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+
+      /* Nothing to start with, so the face is needed right away; glyphs
+       * are rasterized as they're drawn */
+      if (!openFace()) {
+        GLState::deleteTextures(1, &atlas);
+        throw runtime_error("Failed to load font '" + path + "'.");
+      }
+    }
 
     /* Set texture options */
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    /* Now store character for later use */
-    Character character = {
-      texture, 
-      ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
-      ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
-      (GLuint) face->glyph->advance.x
-    };
-
-    characters.push_back(character);
-  }
-
-  /* Clean up after FreeType */
-  FT_Done_Face(face);
+    /* Distances have to be interpolated for the edges to come out smooth */
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mode == SDF ? GL_LINEAR : GL_NEAREST);
 
   /* Prepare vertex arrays */
   glGenVertexArrays(1, &vao);
-  glGenBuffers(1, &vbo);
 
-  glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
+  GLState::bindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, stream.buffer());
 
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), 0);
     glEnableVertexAttribArray(0);
@@ -78,56 +285,459 @@ Font::Font(FT_Library ft, std::string path)
     glEnableVertexAttribArray(1);
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindVertexArray(0);  
+  GLState::bindVertexArray(0);
 }
 
-void Font::render(string text, vec2 position, vec4 color, float scale) {
+Font::~Font() {
+  if (dirty) {
+    saveCache();
+  }
+
+  GLState::deleteTextures(1, &atlas);
+  GLState::deleteVertexArrays(1, &vao);
+
+  if (face != nullptr) {
+    FT_Done_Face(face);
+  }
+}
+
+bool Font::openFace() {
+  Trace::Scope scope("openFace", "load");
+
+  if (FT_New_Face(library, path.c_str(), 0, &face)) {
+    face = nullptr;
+    return false;
+  }
+
+  return true;
+}
+
+bool Font::loadCache() {
+  Trace::Scope scope("loadFontCache", "load");
+
+  /* Keyed by the font file as it is now, so editing it starts over */
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0) {
+    return false;
+  }
+
+  FT_Int version[3];
+  FT_Library_Version(library, &version[0], &version[1], &version[2]);
+
+  uint64_t key[] = {
+    uint64_t(info.st_size), uint64_t(info.st_mtime),
+    defaultSize, uint64_t(mode),
+    uint64_t(version[0]), uint64_t(version[1]), uint64_t(version[2]),
+    ATLAS_SIZE, SDF_SIZE, SDF_SPREAD
+  };
+
+  uint64_t h = Cache::OFFSET;
+  h = Cache::hash(h, path);
+  h = Cache::hash(h, key, sizeof(key));
+  cache = Cache::path(CACHE_DIRECTORY, h);
+
+  MappedFile file(cache);
+  if (file.data == nullptr || file.size < sizeof(CacheHeader)) {
+    return false;
+  }
+
+  CacheHeader header;
+  memcpy(&header, file.data, sizeof(header));
+
+  size_t size = sizeof(header) + header.shelves * sizeof(Shelf) + header.glyphs * sizeof(Glyph) + pixels.size();
+  if (header.magic != CACHE_MAGIC || file.size != size) {
+    return false;
+  }
+
+  const uint8_t *data = file.data + sizeof(header);
+
+  /* Everything gets checked before it's used; a file of the right size
+   * can still be from something else entirely */
+  vector<Shelf> cachedShelves(header.shelves);
+  memcpy(cachedShelves.data(), data, header.shelves * sizeof(Shelf));
+  data += header.shelves * sizeof(Shelf);
+
+  int top = 0;
+  for (auto & s : cachedShelves) {
+    if (s.y < top || s.height <= 0 || s.height > ATLAS_SIZE - s.y || s.x < 0 || s.x > ATLAS_SIZE) {
+      return false;
+    }
+
+    top = s.y + s.height;
+  }
+
+  list<Glyph> cachedGlyphs;
+  unordered_map<uint64_t, list<Glyph>::iterator> cachedLookup;
+
+  for (uint32_t i = 0; i < header.glyphs; i++, data += sizeof(Glyph)) {
+    Glyph g;
+    memcpy(&g, data, sizeof(g));
+
+    if (g.shelf < -1 || g.shelf >= int(header.shelves) || g.size.x < 0 || g.size.y < 0) {
+      return false;
+    }
+
+    /* Within the filled part of its shelf */
+    if (g.shelf >= 0) {
+      const Shelf & s = cachedShelves[g.shelf];
+
+      if (g.size.x == 0 || g.size.y == 0 || g.position.x < 0 || g.position.x > s.x - g.size.x
+          || g.position.y < s.y || g.position.y > s.y + s.height - g.size.y) {
+        return false;
+      }
+    }
+
+    uint64_t key = glyphKey(g.codepoint, g.pixelSize);
+    if (cachedLookup.count(key) != 0) {
+      return false;
+    }
+
+    g.used = 0;
+    cachedGlyphs.push_back(g);
+    cachedLookup[key] = prev(cachedGlyphs.end());
+  }
+
+  shelves.swap(cachedShelves);
+  glyphs.swap(cachedGlyphs);
+  lookup.swap(cachedLookup);
+
+  /* Straight from the mapping */
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, ATLAS_SIZE, ATLAS_SIZE, 0, GL_RED, GL_UNSIGNED_BYTE, data);
+  memcpy(pixels.data(), data, pixels.size());
+
+  return true;
+}
+
+void Font::saveCache() const {
+  if (cache.empty()) {
+    return;
+  }
+
+  CacheHeader header = { CACHE_MAGIC, uint32_t(shelves.size()), uint32_t(glyphs.size()) };
+
+  Cache::write(cache, [&](FILE *file) {
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(shelves.data(), sizeof(Shelf), shelves.size(), file) == shelves.size();
+
+    for (auto g = glyphs.begin(); written && g != glyphs.end(); g++) {
+      written = fwrite(&*g, sizeof(Glyph), 1, file) == 1;
+    }
+
+    return written && fwrite(pixels.data(), 1, pixels.size(), file) == pixels.size();
+  });
+}
+
+void Font::renumberShelves(int from, int delta) {
+  for (auto & g : glyphs) {
+    if (g.shelf >= from) {
+      g.shelf += delta;
+    }
+  }
+}
+
+bool Font::allocate(int width, int height, ivec2 & position, int & shelf) {
+  if (width > ATLAS_SIZE) {
+    return false;
+  }
+
+  /* The first shelf it fits on without wasting too much height */
+  for (size_t i = 0; i < shelves.size(); i++) {
+    Shelf & s = shelves[i];
+
+    if (height <= s.height && height * 2 >= s.height && s.x + width <= ATLAS_SIZE) {
+      position = ivec2(s.x, s.y);
+      shelf = i;
+      s.x += width;
+      return true;
+    }
+  }
+
+  /* An empty one that's too tall gets split; what's left of it stays
+   * empty for others */
+  for (size_t i = 0; i < shelves.size(); i++) {
+    if (shelves[i].x == 0 && shelves[i].height >= height) {
+      Shelf rest = { shelves[i].y + height, shelves[i].height - height, 0 };
+      shelves[i].height = height;
+      shelves[i].x = width;
+
+      if (rest.height > 0) {
+        shelves.insert(shelves.begin() + i + 1, rest);
+        renumberShelves(i + 1, 1);
+      }
+
+      position = ivec2(0, shelves[i].y);
+      shelf = i;
+      return true;
+    }
+  }
+
+  /* A new one on top of the others */
+  int top = shelves.empty() ? 0 : shelves.back().y + shelves.back().height;
+
+  if (top + height > ATLAS_SIZE) {
+    return false;
+  }
+
+  shelves.push_back({ top, height, width });
+  position = ivec2(0, top);
+  shelf = shelves.size() - 1;
+  return true;
+}
+
+bool Font::evict() {
+  /* Shelves with glyphs this call needs stay */
+  vector<bool> busy(shelves.size(), false);
+  for (auto & g : glyphs) {
+    if (g.shelf >= 0 && g.used == renders) {
+      busy[g.shelf] = true;
+    }
+  }
+
+  /* The least recently used glyph on any other */
+  auto victim = glyphs.rbegin();
+  while (victim != glyphs.rend() && (victim->shelf < 0 || busy[victim->shelf])) {
+    victim++;
+  }
+
+  if (victim == glyphs.rend()) {
+    return false;
+  }
+
+  int shelf = victim->shelf;
+
+  for (auto g = glyphs.begin(); g != glyphs.end(); ) {
+    if (g->shelf == shelf) {
+      lookup.erase(glyphKey(g->codepoint, g->pixelSize));
+      g = glyphs.erase(g);
+    } else {
+      g++;
+    }
+  }
+
+  shelves[shelf].x = 0;
+
+  /* Clear it, or what's left of the old glyphs would bleed into the
+   * edges of new ones */
+  uint8_t *rows = &pixels[shelves[shelf].y * ATLAS_SIZE];
+  memset(rows, 0, shelves[shelf].height * ATLAS_SIZE);
+
+  GLState::bindTexture(atlas);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, shelves[shelf].y, ATLAS_SIZE, shelves[shelf].height, GL_RED, GL_UNSIGNED_BYTE, rows);
+
+  /* Empty neighbours become one, so the space can go to glyphs of any
+   * height; at the top, it goes back to making new shelves */
+  for (int i = shelves.size() - 1; i > 0; i--) {
+    if (shelves[i].x == 0 && shelves[i - 1].x == 0) {
+      shelves[i - 1].height += shelves[i].height;
+      shelves.erase(shelves.begin() + i);
+      renumberShelves(i + 1, -1);
+    }
+  }
+
+  if (!shelves.empty() && shelves.back().x == 0) {
+    shelves.pop_back();
+  }
+
+  return true;
+}
+
+vector<uint8_t> Font::distanceField(const FT_Bitmap & bitmap, ivec2 & size) {
+  Trace::Scope scope("distanceField", "load");
+
+  int width = size.x + 2 * SDF_SPREAD;
+  int height = size.y + 2 * SDF_SPREAD;
+
+  vector<float> coverage(width * height, 0.0f);
+  for (int y = 0; y < size.y; y++) {
+    const uint8_t *row = bitmap.buffer + y * bitmap.pitch;
+
+    for (int x = 0; x < size.x; x++) {
+      coverage[(y + SDF_SPREAD) * width + x + SDF_SPREAD] = row[x] / 255.0f;
+    }
+  }
+
+  vector<float> outside = distances(coverage, false, width, height);
+  vector<float> inside = distances(coverage, true, width, height);
+
+  /* Positive inside; the edge ends up at 0.5, with SDF_SPREAD pixels
+   * either way to 0 and 1 */
+  vector<uint8_t> field(width * height);
+  for (size_t i = 0; i < field.size(); i++) {
+    float distance = sqrt(inside[i]) - sqrt(outside[i]);
+    field[i] = uint8_t(clamp(128.0f + distance * 127.0f / SDF_SPREAD, 0.0f, 255.0f));
+  }
+
+  size = ivec2(width, height);
+  return field;
+}
+
+const Glyph * Font::glyph(uint32_t codepoint, GLuint pixelSize) {
+  auto found = lookup.find(glyphKey(codepoint, pixelSize));
+
+  if (found != lookup.end()) {
+    glyphs.splice(glyphs.begin(), glyphs, found->second);
+    found->second->used = renders;
+    return &*found->second;
+  }
+
+  Trace::Scope scope("rasterize", "load");
+
+  if (face == nullptr && !openFace()) {
+    fprintf(stderr, "Failed to load font '%s'.\n", path.c_str());
+    return nullptr;
+  }
+
+  /* Load character glyph */
+  if (faceSize != pixelSize) {
+    FT_Set_Pixel_Sizes(face, 0, pixelSize);
+    faceSize = pixelSize;
+  }
+
+  if (FT_Load_Char(face, codepoint, FT_LOAD_RENDER)) {
+    fprintf(stderr, "Failed to load glyph U+%04X.\n", codepoint);
+    return nullptr;
+  }
+
+  FT_GlyphSlot slot = face->glyph;
+
+  Glyph g = {
+    codepoint,
+    pixelSize,
+    ivec2(0, 0),
+    ivec2(slot->bitmap.width, slot->bitmap.rows),
+    ivec2(slot->bitmap_left, slot->bitmap_top),
+    (GLuint) slot->advance.x,
+    -1,
+    renders
+  };
+
+  const uint8_t *bitmap = slot->bitmap.buffer;
+  vector<uint8_t> field;
+
+  if (mode == SDF && g.size.x > 0 && g.size.y > 0) {
+    field = distanceField(slot->bitmap, g.size);
+    bitmap = field.data();
+
+    /* The field reaches past the glyph on every side */
+    g.bearing += ivec2(-SDF_SPREAD, SDF_SPREAD);
+  }
+
+  /* Find it a place in the atlas, with a pixel to spare on two sides so
+   * filtering doesn't pick up the neighbours */
+  if (g.size.x > 0 && g.size.y > 0) {
+    while (!allocate(g.size.x + 1, g.size.y + 1, g.position, g.shelf)) {
+      if (!evict()) {
+        atlasFull = true;
+        return nullptr;
+      }
+    }
+
+    GLState::bindTexture(atlas);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, g.position.x, g.position.y, g.size.x, g.size.y, GL_RED, GL_UNSIGNED_BYTE, bitmap);
+
+    for (int y = 0; y < g.size.y; y++) {
+      memcpy(&pixels[(g.position.y + y) * ATLAS_SIZE + g.position.x], bitmap + y * g.size.x, g.size.x);
+    }
+  }
+
+  dirty = true;
+
+  glyphs.push_front(g);
+  lookup[glyphKey(codepoint, pixelSize)] = glyphs.begin();
+
+  return &glyphs.front();
+}
+
+void Font::render(const string & text, vec2 position, vec4 color, float scale, GLuint size) {
+  GLuint pixelSize = size == 0 ? defaultSize : size;
+
+  /* Every size is drawn from the same fields */
+  if (mode == SDF) {
+    scale *= float(pixelSize) / SDF_SIZE;
+    pixelSize = SDF_SIZE;
+  }
+
+  /* Everything this draws is protected from eviction until it's done */
+  renders++;
+
+  /* Look every glyph up first; rasterizing one can upload to the atlas */
+  vector<const Glyph *> line;
+  line.reserve(text.size());
+  size_t quads = 0;
+
+  for (auto c = text.cbegin(); c != text.cend(); ) {
+    if (const Glyph * g = glyph(decodeUtf8(c, text.cend()), pixelSize)) {
+      line.push_back(g);
+      quads += g->shelf >= 0;
+    }
+  }
+
+  /* Said once a call, not once a glyph */
+  if (atlasFull) {
+    fprintf(stderr, "Not all of the text fits in the font atlas at once: '%s'\n", text.c_str());
+    atlasFull = false;
+  }
+
+  if (quads == 0) {
+    return;
+  }
+
   /* Activate corresponding shader */
   shader.use();
 
   shader.setUniform("textColor", color);
-  shader.setUniform("projection", ortho(0.0f, (float)SCREEN_WIDTH, (float)SCREEN_HEIGHT, 0.0f));
 
-  glActiveTexture(GL_TEXTURE0);
-  glBindVertexArray(vao);
+  GLState::bindVertexArray(vao);
+  GLState::bindTexture(atlas);
 
-  /* Iterate through all characters */
-  for (auto c = text.begin(); c != text.end(); c++) {
-    Character ch = characters[*c];
+  /* Write every quad at once, six vertices of four floats each */
+  const GLsizeiptr vertexSize = 4 * sizeof(GLfloat);
+  GLintptr offset;
+  auto *vertices = static_cast<GLfloat *>(stream.map(quads * 6 * vertexSize, vertexSize, offset));
 
-    GLfloat xpos = position.x + ch.bearing.x * scale;
-    GLfloat ypos = position.y - ch.bearing.y * scale;
+  if (vertices == nullptr) {
+    return;
+  }
 
-    GLfloat w = ch.size.x * scale;
-    GLfloat h = ch.size.y * scale;
+  const GLfloat texel = 1.0f / ATLAS_SIZE;
 
-    /* Update VBO for each character */
-    GLfloat vertices[24] = {
-      xpos,     ypos + h,   0.0, 1.0,            
-      xpos,     ypos,       0.0, 0.0,
-      xpos + w, ypos,       1.0, 0.0,
+  for (const Glyph * g : line) {
+    /* Spaces and such only move the pen */
+    if (g->shelf < 0) {
+      position.x += (g->advance >> 6) * scale;
+      continue;
+    }
 
-      xpos,     ypos + h,   0.0, 1.0,
-      xpos + w, ypos,       1.0, 0.0,
-      xpos + w, ypos + h,   1.0, 1.0,          
-    };
+    GLfloat xpos = position.x + g->bearing.x * scale;
+    GLfloat ypos = position.y - g->bearing.y * scale;
 
-    /* Render glyph texture over quad */
-    glBindTexture(GL_TEXTURE_2D, ch.textureID);
+    GLfloat w = g->size.x * scale;
+    GLfloat h = g->size.y * scale;
 
-    /* Update content of VBO memory */
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices); 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    GLfloat u0 = g->position.x * texel, u1 = (g->position.x + g->size.x) * texel;
+    GLfloat v0 = g->position.y * texel, v1 = (g->position.y + g->size.y) * texel;
+
+    GLfloat quad[24] = {
+      xpos,     ypos + h,   u0, v1,
+      xpos,     ypos,       u0, v0,
+      xpos + w, ypos,       u1, v0,
+
+      xpos,     ypos + h,   u0, v1,
+      xpos + w, ypos,       u1, v0,
+      xpos + w, ypos + h,   u1, v1,
+    };
 
-    /* Render quad */
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    memcpy(vertices, quad, sizeof(quad));
+    vertices += 24;
 
-    position.x += (ch.advance >> 6) * scale;
+    position.x += (g->advance >> 6) * scale;
   }
 
-  shader.disuse();
+  stream.unmap();
 
-  glBindVertexArray(0);
-  glBindTexture(GL_TEXTURE_2D, 0);
+  /* One atlas, so it's all one draw */
+  GLState::drawArrays(GL_TRIANGLES, offset / vertexSize, quads * 6);
 }
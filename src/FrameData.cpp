@@ -0,0 +1,23 @@
+#include <FrameData.h>
+
+#include <cstring>
+
+#include <Shader.h>
+
+void bindFrameData(StreamBuffer & stream, const FrameData & data) {
+  static GLint alignment = 0;
+  if (alignment == 0) {
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  }
+
+  GLintptr offset;
+  void *memory = stream.map(sizeof(data), alignment, offset);
+  if (memory == nullptr) {
+    return;
+  }
+
+  memcpy(memory, &data, sizeof(data));
+  stream.unmap();
+
+  glBindBufferRange(GL_UNIFORM_BUFFER, Shader::FRAME_BINDING, stream.buffer(), offset, sizeof(data));
+}
@@ -0,0 +1,172 @@
+#include <GLState.h>
+
+namespace {
+  /* Never a valid name, so it never matches what's asked for */
+  const GLuint UNKNOWN = ~GLuint(0);
+  const GLuint UNITS = 16;
+
+  struct State {
+    GLuint program;
+    GLuint vao;
+    GLuint activeUnit;
+    GLuint textures[UNITS];
+
+    /* 0 and 1 for off and on */
+    GLuint blend;
+    GLenum blendSource, blendDestination;
+  };
+
+  State state;
+  GLState::Counters stats;
+
+  bool initialized = false;
+
+  void init() {
+    if (!initialized) {
+      GLState::invalidate();
+    }
+  }
+
+  /* True if `value` already holds `wanted`; otherwise it takes it and the
+   * caller has to issue the call */
+  bool same(GLuint & value, GLuint wanted) {
+    if (value == wanted) {
+      stats.skipped++;
+      return true;
+    }
+
+    value = wanted;
+    stats.issued++;
+    return false;
+  }
+
+  void activeTexture(GLuint unit) {
+    if (!same(state.activeUnit, unit)) {
+      glActiveTexture(GL_TEXTURE0 + unit);
+    }
+  }
+}
+
+namespace GLState {
+  void useProgram(GLuint program) {
+    init();
+    if (!same(state.program, program)) {
+      glUseProgram(program);
+    }
+  }
+
+  void bindVertexArray(GLuint vao) {
+    init();
+    if (!same(state.vao, vao)) {
+      glBindVertexArray(vao);
+    }
+  }
+
+  void bindTexture(GLuint texture, GLuint unit) {
+    init();
+
+    /* Units we don't track always go through */
+    if (unit >= UNITS) {
+      state.activeUnit = UNKNOWN;
+      glActiveTexture(GL_TEXTURE0 + unit);
+      glBindTexture(GL_TEXTURE_2D, texture);
+      stats.issued += 2;
+      return;
+    }
+
+    /* The unit only has to be switched to if the binding changes */
+    if (state.textures[unit] == texture) {
+      stats.skipped++;
+      return;
+    }
+
+    activeTexture(unit);
+    state.textures[unit] = texture;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    stats.issued++;
+  }
+
+  void setBlend(bool enabled) {
+    init();
+    if (!same(state.blend, enabled)) {
+      if (enabled) {
+        glEnable(GL_BLEND);
+      } else {
+        glDisable(GL_BLEND);
+      }
+    }
+  }
+
+  void blendFunc(GLenum source, GLenum destination) {
+    init();
+    if (state.blendSource == source && state.blendDestination == destination) {
+      stats.skipped++;
+      return;
+    }
+
+    state.blendSource = source;
+    state.blendDestination = destination;
+    glBlendFunc(source, destination);
+    stats.issued++;
+  }
+
+  void drawArrays(GLenum mode, GLint first, GLsizei count) {
+    stats.draws++;
+    glDrawArrays(mode, first, count);
+  }
+
+  void drawElements(GLenum mode, GLsizei count, GLenum type, const void *indices) {
+    stats.draws++;
+    glDrawElements(mode, count, type, indices);
+  }
+
+  void deleteTextures(GLsizei count, const GLuint *textures) {
+    init();
+
+    /* Deleting a bound texture binds 0 in its place on every unit */
+    for (GLsizei i = 0; i < count; i++) {
+      for (auto & bound : state.textures) {
+        if (bound == textures[i]) {
+          bound = 0;
+        }
+      }
+    }
+
+    glDeleteTextures(count, textures);
+  }
+
+  void deleteVertexArrays(GLsizei count, const GLuint *vaos) {
+    init();
+
+    for (GLsizei i = 0; i < count; i++) {
+      if (state.vao == vaos[i]) {
+        state.vao = 0;
+      }
+    }
+
+    glDeleteVertexArrays(count, vaos);
+  }
+
+  void invalidate() {
+    initialized = true;
+
+    state.program = UNKNOWN;
+    state.vao = UNKNOWN;
+    state.activeUnit = UNKNOWN;
+    for (auto & texture : state.textures) {
+      texture = UNKNOWN;
+    }
+
+    state.blend = UNKNOWN;
+    state.blendSource = UNKNOWN;
+    state.blendDestination = UNKNOWN;
+  }
+
+  const Counters & counters() {
+    return stats;
+  }
+
+  void resetCounters() {
+    stats = Counters();
+  }
+}
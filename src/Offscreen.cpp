@@ -0,0 +1,210 @@
+#include <Offscreen.h>
+
+#include <cstdint>
+#include <cstring>
+
+#include <stdexcept>
+#include <vector>
+
+#include <SOIL.h>
+
+#ifdef ROGUE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+struct Offscreen::Egl {
+  EGLDisplay display;
+  EGLSurface surface;
+  EGLContext context;
+};
+
+namespace {
+  bool hasExtension(const char *extensions, const char *name) {
+    if (extensions == nullptr) {
+      return false;
+    }
+
+    size_t length = strlen(name);
+    for (const char *at = strstr(extensions, name); at != nullptr; at = strstr(at + length, name)) {
+      if ((at == extensions || at[-1] == ' ') && (at[length] == ' ' || at[length] == '\0')) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  EGLDisplay openDisplay() {
+    /* Surfaceless needs no display server, or even a GPU */
+    const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+    if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+      auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+      if (getPlatformDisplay != nullptr) {
+        EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+
+        if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr)) {
+          return display;
+        }
+      }
+    }
+
+    EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr)) {
+      return display;
+    }
+
+    return EGL_NO_DISPLAY;
+  }
+}
+
+Offscreen::Offscreen(int w, int h)
+  : egl(new Egl { EGL_NO_DISPLAY, EGL_NO_SURFACE, EGL_NO_CONTEXT })
+  , width(w)
+  , height(h)
+  , framebuffer(0)
+  , color(0)
+  , depth(0)
+{
+  egl->display = openDisplay();
+  if (egl->display == EGL_NO_DISPLAY) {
+    throw std::runtime_error("Failed to open an EGL display.");
+  }
+
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    eglTerminate(egl->display);
+    throw std::runtime_error("EGL can't do desktop OpenGL here.");
+  }
+
+  const EGLint contextAttributes[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3,
+    EGL_CONTEXT_MINOR_VERSION, 3,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE
+  };
+
+  /* All drawing goes into the framebuffer object, so there's no need for
+   * a surface if the context can do without; otherwise a 1x1 pbuffer
+   * stands in */
+  const char *extensions = eglQueryString(egl->display, EGL_EXTENSIONS);
+
+  if (hasExtension(extensions, "EGL_KHR_no_config_context") && hasExtension(extensions, "EGL_KHR_surfaceless_context")) {
+    egl->context = eglCreateContext(egl->display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttributes);
+  }
+
+  if (egl->context == EGL_NO_CONTEXT) {
+    const EGLint configAttributes[] = {
+      EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+      EGL_NONE
+    };
+    const EGLint pbufferAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+
+    EGLConfig config;
+    EGLint configs = 0;
+
+    if (eglChooseConfig(egl->display, configAttributes, &config, 1, &configs) && configs > 0) {
+      egl->surface = eglCreatePbufferSurface(egl->display, config, pbufferAttributes);
+      egl->context = eglCreateContext(egl->display, config, EGL_NO_CONTEXT, contextAttributes);
+    }
+  }
+
+  if (egl->context == EGL_NO_CONTEXT || !eglMakeCurrent(egl->display, egl->surface, egl->surface, egl->context)) {
+    eglTerminate(egl->display);
+    throw std::runtime_error("Failed to create an offscreen OpenGL 3.3 context.");
+  }
+}
+
+Offscreen::~Offscreen() {
+  if (framebuffer != 0) {
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &color);
+    glDeleteRenderbuffers(1, &depth);
+  }
+
+  eglMakeCurrent(egl->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(egl->display, egl->context);
+  if (egl->surface != EGL_NO_SURFACE) {
+    eglDestroySurface(egl->display, egl->surface);
+  }
+  eglTerminate(egl->display);
+}
+#else
+struct Offscreen::Egl { };
+
+Offscreen::Offscreen(int w, int h)
+  : width(w)
+  , height(h)
+  , framebuffer(0)
+  , color(0)
+  , depth(0)
+{
+  throw std::runtime_error("This build can't render offscreen, it was built without EGL.");
+}
+
+Offscreen::~Offscreen() { }
+#endif
+
+void Offscreen::bind() {
+  if (framebuffer == 0) {
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &color);
+    glGenRenderbuffers(1, &depth);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, color);
+      glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+      glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      throw std::runtime_error("The offscreen framebuffer is not complete.");
+    }
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glViewport(0, 0, width, height);
+}
+
+bool Offscreen::save(const std::string & path) const {
+  if (framebuffer == 0) {
+    return false;
+  }
+
+  /* Alpha isn't kept: after blending it says nothing about what's seen */
+  std::vector<uint8_t> pixels(size_t(width) * height * 3);
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+  /* GL reads bottom up, images go top down */
+  size_t row = size_t(width) * 3;
+  std::vector<uint8_t> swap(row);
+  for (int y = 0; y < height / 2; y++) {
+    uint8_t *top = &pixels[y * row];
+    uint8_t *bottom = &pixels[(height - 1 - y) * row];
+
+    memcpy(swap.data(), top, row);
+    memcpy(top, bottom, row);
+    memcpy(bottom, swap.data(), row);
+  }
+
+  std::string extension = path.substr(path.rfind('.') == std::string::npos ? path.size() : path.rfind('.'));
+
+  int type;
+  if (extension == ".bmp") {
+    type = SOIL_SAVE_TYPE_BMP;
+  } else if (extension == ".dds") {
+    type = SOIL_SAVE_TYPE_DDS;
+  } else {
+    type = SOIL_SAVE_TYPE_TGA;
+  }
+
+  return SOIL_save_image(path.c_str(), type, width, height, 3, pixels.data()) != 0;
+}
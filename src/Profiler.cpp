@@ -0,0 +1,259 @@
+#include <Profiler.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <Font.h>
+
+namespace {
+  /* Frames the statistics go over */
+  size_t window = 256;
+  /* GPU queries per pass in flight; results are read this many frames late
+   * at worst */
+  const size_t QUERIES = 4;
+
+  typedef std::chrono::steady_clock Clock;
+
+  struct Stat {
+    const char *name;
+    /* Nesting depth, for indenting */
+    int depth;
+    bool gpu;
+
+    /* Milliseconds, in a ring */
+    std::vector<double> samples;
+    size_t next;
+
+    /* This frame's total so far, for CPU scopes */
+    double current;
+    bool hit;
+
+    /* For GPU passes */
+    GLuint queries[QUERIES];
+    bool pending[QUERIES];
+    size_t query;
+    /* Has a result been thrown away yet; see collect() */
+    bool warm;
+
+    void add(double ms) {
+      if (samples.size() < window) {
+        samples.push_back(ms);
+      } else {
+        samples[next] = ms;
+      }
+      next = (next + 1) % window;
+    }
+  };
+
+  std::vector<Stat> stats;
+
+  /* Open CPU scopes, innermost last */
+  std::vector<std::pair<size_t, Clock::time_point>> open;
+  /* The GPU pass whose query is running */
+  size_t gpuOpen = size_t(-1);
+
+  bool shown = false;
+
+  Stat & find(const char *name, bool gpu) {
+    for (auto & stat : stats) {
+      if (stat.gpu == gpu && strcmp(stat.name, name) == 0) {
+        return stat;
+      }
+    }
+
+    Stat stat = {};
+    stat.name = name;
+    stat.depth = gpu ? 0 : open.size();
+    stat.gpu = gpu;
+
+    if (gpu) {
+      glGenQueries(QUERIES, stat.queries);
+    }
+
+    stats.push_back(stat);
+    return stats.back();
+  }
+
+  /* Reads back whichever of `stat`'s queries are done */
+  void collect(Stat & stat) {
+    for (size_t i = 0; i < QUERIES; i++) {
+      if (!stat.pending[i]) {
+        continue;
+      }
+
+      GLuint available = GL_FALSE;
+      glGetQueryObjectuiv(stat.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+
+      if (available) {
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(stat.queries[i], GL_QUERY_RESULT, &nanoseconds);
+        stat.pending[i] = false;
+
+        /* Some drivers (llvmpipe, for one) time the very first query from
+         * when the context was made */
+        if (stat.warm) {
+          stat.add(nanoseconds / 1e6);
+        }
+        stat.warm = true;
+      }
+    }
+  }
+
+  Profiler::Summary summary(const Stat & stat) {
+    auto sorted = stat.samples;
+    std::sort(sorted.begin(), sorted.end());
+
+    double sum = 0.0;
+    for (double sample : sorted) {
+      sum += sample;
+    }
+
+    return {
+      sorted.front(),
+      sum / sorted.size(),
+      sorted[std::min(sorted.size() - 1, size_t(sorted.size() * 0.99))],
+      sorted.size()
+    };
+  }
+}
+
+namespace Profiler {
+  void beginFrame() {
+    for (auto & stat : stats) {
+      if (stat.gpu) {
+        collect(stat);
+      }
+    }
+  }
+
+  void endFrame() {
+    for (auto & stat : stats) {
+      if (stat.hit) {
+        stat.add(stat.current);
+        stat.current = 0.0;
+        stat.hit = false;
+      }
+    }
+  }
+
+  Scope::Scope(const char *name)
+    : trace(name, "frame")
+  {
+    size_t index = &find(name, false) - stats.data();
+    open.push_back({ index, Clock::now() });
+  }
+
+  Scope::~Scope() {
+    auto end = Clock::now();
+    Stat & stat = stats[open.back().first];
+
+    stat.current += std::chrono::duration<double, std::milli>(end - open.back().second).count();
+    stat.hit = true;
+
+    open.pop_back();
+  }
+
+  GpuScope::GpuScope(const char *name) {
+    /* One at a time */
+    if (gpuOpen != size_t(-1)) {
+      return;
+    }
+
+    Stat & stat = find(name, true);
+
+    /* All of this pass' queries are still in flight; skip a sample rather
+     * than wait */
+    if (stat.pending[stat.query]) {
+      return;
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, stat.queries[stat.query]);
+    gpuOpen = &stat - stats.data();
+  }
+
+  GpuScope::~GpuScope() {
+    if (gpuOpen == size_t(-1)) {
+      return;
+    }
+
+    Stat & stat = stats[gpuOpen];
+    glEndQuery(GL_TIME_ELAPSED);
+
+    stat.pending[stat.query] = true;
+    stat.query = (stat.query + 1) % QUERIES;
+    gpuOpen = size_t(-1);
+  }
+
+  void setWindow(size_t frames) {
+    window = std::max(frames, size_t(1));
+
+    for (auto & stat : stats) {
+      stat.samples.clear();
+      stat.next = 0;
+    }
+  }
+
+  bool summarize(const char *name, Summary & result) {
+    for (auto & stat : stats) {
+      if (strcmp(stat.name, name) == 0 && !stat.samples.empty()) {
+        result = summary(stat);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  bool visible() {
+    return shown;
+  }
+
+  void toggle() {
+    shown = !shown;
+  }
+
+  void render(Font & font, vec2 position) {
+    if (!shown) {
+      return;
+    }
+
+    const vec4 color(1.0f, 1.0f, 0.6f, 1.0f);
+    const float lineHeight = 10.0f;
+
+    font.render("ms             min    avg    p99", position, color);
+
+    /* CPU scopes first, GPU passes after */
+    std::vector<const Stat *> order;
+    for (auto & stat : stats) {
+      if (!stat.gpu) {
+        order.push_back(&stat);
+      }
+    }
+    for (auto & stat : stats) {
+      if (stat.gpu) {
+        order.push_back(&stat);
+      }
+    }
+
+    for (auto stat : order) {
+      if (stat->samples.empty()) {
+        continue;
+      }
+
+      Summary numbers = summary(*stat);
+
+      std::string label = std::string(stat->depth * 2, ' ') + (stat->gpu ? "gpu " : "") + stat->name;
+
+      char line[96];
+      snprintf(line, sizeof(line), "%-14.14s %6.2f %6.2f %6.2f", label.c_str(), numbers.min, numbers.average, numbers.p99);
+
+      position.y += lineHeight;
+      font.render(line, position, color);
+    }
+  }
+}
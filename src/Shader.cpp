@@ -1,45 +1,136 @@
 #include <Shader.h>
 
+#include <cstdio>
+#include <cstdint>
+
 #include <iostream>
 #include <string>
-#include <sstream>
-#include <fstream>
-#include <streambuf>
+#include <vector>
+#include <map>
+#include <memory>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 using namespace glm;
 
-static std::string read_file(const char *path) {
-  using namespace std;
+#include <Cache.h>
+#include <Trace.h>
+
+/* Linked programs are kept here, one file per pair of sources and driver */
+static const char *CACHE_DIRECTORY = "shader-cache";
+
+/* Identifies a header, so leftovers from older builds are left alone */
+static const uint32_t CACHE_MAGIC = 0x42475352;
+
+/* Where the binary for these sources goes, or nothing if the driver can't
+ * hand out program binaries. A binary only works on the driver that made
+ * it, so that's part of the key. */
+static std::string cache_path(const std::string & vert, const std::string & frag) {
+  if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) {
+    return "";
+  }
+
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  if (formats == 0) {
+    return "";
+  }
+
+  uint64_t h = Cache::OFFSET;
+  for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+    h = Cache::hash(h, reinterpret_cast<const char *>(glGetString(name)));
+  }
+  h = Cache::hash(h, vert);
+  h = Cache::hash(h, std::string(1, '\0'));
+  h = Cache::hash(h, frag);
+
+  return Cache::path(CACHE_DIRECTORY, h);
+}
+
+/* The program cached at `path`, or 0 if there's none or the driver won't
+ * take it anymore */
+static GLuint load_binary(const std::string & path) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return 0;
+  }
+
+  uint32_t header[2];
+  std::vector<char> binary;
+
+  bool read = fread(header, sizeof(header), 1, file) == 1 && header[0] == CACHE_MAGIC;
+  if (read) {
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file) - long(sizeof(header));
+    fseek(file, sizeof(header), SEEK_SET);
+
+    read = size > 0;
+    if (read) {
+      binary.resize(size);
+      read = fread(binary.data(), 1, size, file) == size_t(size);
+    }
+  }
+
+  fclose(file);
+
+  if (!read) {
+    return 0;
+  }
+
+  GLuint program_id = glCreateProgram();
+  glProgramBinary(program_id, header[1], binary.data(), binary.size());
+
+  GLint result = GL_FALSE;
+  glGetProgramiv(program_id, GL_LINK_STATUS, &result);
 
-  stringstream stream;
+  if (result == GL_FALSE) {
+    glDeleteProgram(program_id);
+    return 0;
+  }
 
-  ifstream file;
-  file.exceptions(ifstream::badbit);
+  return program_id;
+}
 
-  try {
-    file.open(path);
-    stream << file.rdbuf();
-    file.close();
-  } catch(ifstream::failure e) {
-    cerr << "Couldn't read file '" << path << "'." << endl;
+static void save_binary(GLuint program_id, const std::string & path) {
+  GLint length = 0;
+  glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length == 0) {
+    return;
   }
 
-  return stream.str();
+  std::vector<char> binary(length);
+  GLenum format;
+  glGetProgramBinary(program_id, length, nullptr, &format, binary.data());
+
+  uint32_t header[2] = { CACHE_MAGIC, format };
+  Cache::write(path, [&](FILE *file) {
+    return fwrite(header, sizeof(header), 1, file) == 1 && fwrite(binary.data(), 1, binary.size(), file) == binary.size();
+  });
+}
+
+/* Point the shared per-frame block at its buffer; this isn't part of a
+ * program binary, so it's done for cached programs too */
+static void bind_frame_block(GLuint program_id) {
+  GLuint frame = glGetUniformBlockIndex(program_id, "Frame");
+  if (frame != GL_INVALID_INDEX) {
+    glUniformBlockBinding(program_id, frame, Shader::FRAME_BINDING);
+  }
 }
 
-GLuint Shader::create_shader(GLenum type, const char *path) {
-  /* Read the shader */
-  auto contents = read_file(path);
+GLuint Shader::create_shader(GLenum type, const std::string & contents) {
   auto src = contents.c_str();
 
-  /* Create the shader */
+  /* Create the shader; whether it compiled is only asked in finish(), so
+   * the driver can get on with it in the meantime */
   GLuint shader_id = glCreateShader(type);
 
   glShaderSource(shader_id, 1, &src, nullptr);
   glCompileShader(shader_id);
 
+  return shader_id;
+}
+
+void Shader::check_shader(GLuint shader_id, const std::string & path) {
   /* Check for errors */
   GLint result = GL_FALSE;
   int info_log_length = 0;
@@ -58,33 +149,72 @@ GLuint Shader::create_shader(GLenum type, const char *path) {
 
     free(error_message);
   }
-
-  return shader_id;
 }
 
-GLuint Shader::create_program(const char *vertpath, const char *fragpath) {
+Shader::Shader(ShaderSourceId vs, ShaderSourceId fs)
+  : vertpath(SHADER_NAMES[vs])
+  , fragpath(SHADER_NAMES[fs])
+  , vert_shader(0)
+  , frag_shader(0)
+  , pending(false)
+{
+  Trace::Scope scope("compile", "load");
+
+  /* Built in, includes and defines and all */
+  std::string vert = SHADER_SOURCES[vs];
+  std::string frag = SHADER_SOURCES[fs];
+
+  /* Skip compiling altogether if the driver linked these before */
+  cache = cache_path(vert, frag);
+  if (!cache.empty()) {
+    id = load_binary(cache);
+
+    if (id != 0) {
+      bind_frame_block(id);
+      return;
+    }
+  }
+
   /* Create shaders */
-  GLuint vert_shader = create_shader(GL_VERTEX_SHADER, vertpath);
-  GLuint frag_shader = create_shader(GL_FRAGMENT_SHADER, fragpath);
+  vert_shader = create_shader(GL_VERTEX_SHADER, vert);
+  frag_shader = create_shader(GL_FRAGMENT_SHADER, frag);
 
   /* Link the program */
-  GLuint program_id = glCreateProgram();
-  glAttachShader(program_id, vert_shader);
-  glAttachShader(program_id, frag_shader);
-  glLinkProgram(program_id);
+  id = glCreateProgram();
+  if (!cache.empty()) {
+    glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+  glAttachShader(id, vert_shader);
+  glAttachShader(id, frag_shader);
+  glLinkProgram(id);
+
+  pending = true;
+}
+
+void Shader::finish() {
+  if (!pending) {
+    return;
+  }
+
+  pending = false;
+
+  Trace::Scope scope("link", "load");
+
+  check_shader(vert_shader, vertpath);
+  check_shader(frag_shader, fragpath);
 
   /* Check for errors */
   GLint result = GL_FALSE;
   int info_log_length = 0;
 
-  glGetProgramiv(program_id, GL_LINK_STATUS, &result);
-  glGetProgramiv(program_id, GL_INFO_LOG_LENGTH, &info_log_length);
+  glGetProgramiv(id, GL_LINK_STATUS, &result);
+  glGetProgramiv(id, GL_INFO_LOG_LENGTH, &info_log_length);
 
   if (info_log_length > 1) {
     using namespace std;
 
     char *error_message = (char *) calloc(info_log_length + 1, 1);
-    glGetProgramInfoLog(program_id, info_log_length, nullptr, error_message);
+    glGetProgramInfoLog(id, info_log_length, nullptr, error_message);
 
     cerr << "Problem when linking shaders '" << vertpath << "', '" << fragpath << "':" << endl;
     cerr << error_message << endl;
@@ -92,14 +222,56 @@ GLuint Shader::create_program(const char *vertpath, const char *fragpath) {
     free(error_message);
   }
 
+  bind_frame_block(id);
+
+  /* Save it for next time */
+  if (!cache.empty() && result == GL_TRUE) {
+    save_binary(id, cache);
+  }
+
   /* Clean up */
-  glDetachShader(program_id, vert_shader);
-  glDetachShader(program_id, frag_shader);
+  glDetachShader(id, vert_shader);
+  glDetachShader(id, frag_shader);
 
   glDeleteShader(vert_shader);
   glDeleteShader(frag_shader);
+}
 
-  return program_id;
+/* Every program there is, by sources */
+static std::map<std::pair<ShaderSourceId, ShaderSourceId>, std::unique_ptr<Shader>> & registry() {
+  static std::map<std::pair<ShaderSourceId, ShaderSourceId>, std::unique_ptr<Shader>> shaders;
+  return shaders;
+}
+
+static Shader & find_or_start(ShaderSourceId vert, ShaderSourceId frag) {
+  static bool threads = false;
+  if (!threads) {
+    threads = true;
+
+    /* Let the driver compile on as many threads as it likes */
+    if (GLEW_KHR_parallel_shader_compile) {
+      glMaxShaderCompilerThreadsKHR(0xffffffff);
+    } else if (GLEW_ARB_parallel_shader_compile) {
+      glMaxShaderCompilerThreadsARB(0xffffffff);
+    }
+  }
+
+  auto & shader = registry()[{ vert, frag }];
+  if (!shader) {
+    shader.reset(new Shader(vert, frag));
+  }
+
+  return *shader;
+}
+
+void preloadShader(ShaderSourceId vert, ShaderSourceId frag) {
+  find_or_start(vert, frag);
+}
+
+Shader & getShader(ShaderSourceId vert, ShaderSourceId frag) {
+  Shader & shader = find_or_start(vert, frag);
+  shader.finish();
+  return shader;
 }
 
 /* OpenGL primitives */
@@ -0,0 +1,113 @@
+#include <StreamBuffer.h>
+
+namespace {
+  /* The maps never touch GL_ARRAY_BUFFER, so whatever is bound there for
+   * the VAO being set up stays bound */
+  const GLenum TARGET = GL_COPY_WRITE_BUFFER;
+
+  const GLbitfield PERSISTENT_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+}
+
+StreamBuffer::StreamBuffer(GLsizeiptr s, size_t frames)
+  : segmentSize(s)
+  , fences(frames, nullptr)
+  , segment(0)
+  , head(0)
+  , persistent(nullptr)
+{
+  GLsizeiptr size = segmentSize * frames;
+
+  glGenBuffers(1, &vbo);
+  glBindBuffer(TARGET, vbo);
+    if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+      glBufferStorage(TARGET, size, nullptr, PERSISTENT_FLAGS);
+      persistent = static_cast<uint8_t *>(glMapBufferRange(TARGET, 0, size, PERSISTENT_FLAGS));
+    }
+
+    /* Orphaning it is */
+    if (persistent == nullptr) {
+      glDeleteBuffers(1, &vbo);
+      glGenBuffers(1, &vbo);
+      glBindBuffer(TARGET, vbo);
+      glBufferData(TARGET, size, nullptr, GL_STREAM_DRAW);
+    }
+  glBindBuffer(TARGET, 0);
+}
+
+StreamBuffer::~StreamBuffer() {
+  for (auto fence : fences) {
+    if (fence != nullptr) {
+      glDeleteSync(fence);
+    }
+  }
+
+  /* Deleting a buffer unmaps it */
+  glDeleteBuffers(1, &vbo);
+}
+
+void StreamBuffer::nextSegment() {
+  fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  segment = (segment + 1) % fences.size();
+  head = segment * segmentSize;
+
+  /* With enough frames in flight this has long passed */
+  GLsync fence = fences[segment];
+  if (fence != nullptr) {
+    while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(fence);
+    fences[segment] = nullptr;
+  }
+}
+
+void *StreamBuffer::map(GLsizeiptr size, GLsizeiptr alignment, GLintptr & offset) {
+  if (size <= 0 || size > segmentSize) {
+    return nullptr;
+  }
+
+  offset = (head + alignment - 1) / alignment * alignment;
+
+  if (persistent != nullptr) {
+    /* Spill into the next segment if this one's full */
+    if (offset + size > GLintptr(segment + 1) * segmentSize) {
+      nextSegment();
+      offset = (head + alignment - 1) / alignment * alignment;
+    }
+
+    head = offset + size;
+    return persistent + offset;
+  }
+
+  glBindBuffer(TARGET, vbo);
+    GLsizeiptr capacity = segmentSize * fences.size();
+
+    /* Out of room: let the driver keep the old storage around for as long
+     * as it's drawn from and start over in fresh memory */
+    if (offset + size > capacity) {
+      glBufferData(TARGET, capacity, nullptr, GL_STREAM_DRAW);
+      offset = 0;
+    }
+
+    /* Nothing drawn so far reads the range, so there's nothing to wait for */
+    void *pointer = glMapBufferRange(TARGET, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+  glBindBuffer(TARGET, 0);
+
+  head = offset + size;
+  return pointer;
+}
+
+void StreamBuffer::unmap() {
+  /* Coherent mappings are seen by the GPU as they're written */
+  if (persistent != nullptr) {
+    return;
+  }
+
+  glBindBuffer(TARGET, vbo);
+    glUnmapBuffer(TARGET);
+  glBindBuffer(TARGET, 0);
+}
+
+void StreamBuffer::endFrame() {
+  if (persistent != nullptr) {
+    nextSegment();
+  }
+}
@@ -0,0 +1,135 @@
+#include <Texture.h>
+
+#include <cstdio>
+#include <cstdint>
+
+#include <vector>
+
+#include <SOIL.h>
+
+#include <GLState.h>
+#include <Trace.h>
+
+/* The build bakes res/tiles.png to <baked dir>/res/tiles.dds (see
+ * CMakeLists.txt) */
+static std::string baked_path(const std::string & path) {
+  return ROGUE_BAKED_DIR + path.substr(0, path.rfind('.')) + ".dds";
+}
+
+namespace {
+  /* Both only ever grow, so decoding a whole batch of images allocates
+   * nothing per image once the biggest one has gone through */
+  std::vector<uint8_t> fileData;
+  /* Pixel unpack buffer the images are decoded straight into */
+  GLuint unpackBuffer = 0;
+  GLsizeiptr unpackSize = 0;
+
+  bool readFile(const std::string & path) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+      return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    bool read = size > 0;
+    if (read) {
+      fileData.resize(size);
+      read = fread(fileData.data(), 1, size, file) == size_t(size);
+    }
+
+    fclose(file);
+    return read;
+  }
+
+  /* Decodes the file in `fileData` into the unpack buffer and uploads it to
+   * the bound texture; false if it can't be decoded or the buffer can't be
+   * mapped */
+  bool decodeIntoUnpackBuffer(int & w, int & h) {
+    Trace::Scope scope("decode", "load");
+
+    int channels;
+    if (!SOIL_image_info_from_memory(fileData.data(), fileData.size(), &w, &h, &channels)) {
+      return false;
+    }
+
+    GLsizeiptr size = GLsizeiptr(w) * h * 4;
+
+    if (unpackBuffer == 0) {
+      glGenBuffers(1, &unpackBuffer);
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuffer);
+      if (size > unpackSize) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        unpackSize = size;
+      }
+
+      /* Invalidating lets the driver hand out fresh memory instead of
+       * waiting for the previous upload out of it to finish */
+      void *pixels = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+      bool decoded = pixels != nullptr && SOIL_load_image_from_memory_into(fileData.data(), fileData.size(),
+          static_cast<uint8_t *>(pixels), size, &w, &h, &channels, SOIL_LOAD_RGBA);
+
+      /* Unmapping fails if the contents got lost meanwhile */
+      if (pixels != nullptr && glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_FALSE) {
+        decoded = false;
+      }
+
+      if (decoded) {
+        /* With an unpack buffer bound the pointer is an offset into it */
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+      }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    return decoded;
+  }
+}
+
+void loadTexture(GLuint texture, const std::string & path, int * width, int * height) {
+  Trace::Scope scope("loadTexture", "load");
+
+  int w = 0, h = 0;
+
+  /* Prefer the baked texture, nothing has to be decoded for it */
+  bool baked = SOIL_direct_load_DDS(baked_path(path).c_str(), texture, SOIL_FLAG_TEXTURE_REPEATS, 0) != 0;
+
+  /* SOIL binds textures by itself */
+  GLState::invalidate();
+
+  GLState::bindTexture(texture);
+    if (baked) {
+      glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &w);
+      glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &h);
+    } else if (!readFile(path)) {
+      fprintf(stderr, "Failed to read texture '%s'\n", path.c_str());
+    } else if (!decodeIntoUnpackBuffer(w, h)) {
+      /* Fall back to decoding into memory of our own if the unpack buffer
+       * couldn't be used */
+      Trace::Scope scope("decode", "load");
+
+      uint8_t *image = SOIL_load_image_from_memory(fileData.data(), fileData.size(), &w, &h, 0, SOIL_LOAD_RGBA);
+
+      if (image == nullptr) {
+        fprintf(stderr, "Failed to load texture '%s': %s\n", path.c_str(), SOIL_last_result());
+      }
+
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+
+      SOIL_free_image_data(image);
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  GLState::bindTexture(0);
+
+  if (width != nullptr) {
+    *width = w;
+  }
+
+  if (height != nullptr) {
+    *height = h;
+  }
+}
@@ -0,0 +1,160 @@
+#include <Trace.h>
+
+#include <cstdio>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+namespace {
+  typedef std::chrono::steady_clock Clock;
+
+  struct Event {
+    const char *name;
+    const char *category;
+    /* Nanoseconds since `epoch` */
+    uint64_t begin, duration;
+  };
+
+  const size_t CHUNK_EVENTS = 4096;
+
+  /* Only the thread it belongs to writes events, each one before
+   * publishing it through `count`; a full chunk gets a `next` */
+  struct Chunk {
+    Event events[CHUNK_EVENTS];
+    std::atomic<size_t> count;
+    std::atomic<Chunk *> next;
+  };
+
+  struct ThreadBuffer {
+    int id;
+    /* The recording thread's */
+    Chunk *tail;
+    /* The writer's: the oldest chunk and how much of it is written out */
+    Chunk *head;
+    size_t read;
+  };
+
+  std::atomic<bool> on(false);
+  const Clock::time_point epoch = Clock::now();
+
+  /* Every thread that ever recorded anything; the buffers are kept after
+   * their threads end so nothing they recorded gets lost */
+  std::mutex threadsMutex;
+  std::vector<ThreadBuffer *> threads;
+
+  uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch).count();
+  }
+
+  ThreadBuffer & local() {
+    thread_local ThreadBuffer *buffer = nullptr;
+
+    if (buffer == nullptr) {
+      Chunk *chunk = new Chunk();
+
+      std::lock_guard<std::mutex> lock(threadsMutex);
+      buffer = new ThreadBuffer { int(threads.size()) + 1, chunk, chunk, 0 };
+      threads.push_back(buffer);
+    }
+
+    return *buffer;
+  }
+
+  void record(const char *name, const char *category, uint64_t begin, uint64_t end) {
+    ThreadBuffer & buffer = local();
+
+    Chunk *chunk = buffer.tail;
+    size_t count = chunk->count.load(std::memory_order_relaxed);
+
+    if (count == CHUNK_EVENTS) {
+      Chunk *fresh = new Chunk();
+      chunk->next.store(fresh, std::memory_order_release);
+      buffer.tail = chunk = fresh;
+      count = 0;
+    }
+
+    chunk->events[count] = { name, category, begin, end - begin };
+    chunk->count.store(count + 1, std::memory_order_release);
+  }
+
+  void writeEvents(FILE *file, int thread, const Chunk *chunk, size_t from, size_t to, bool & first) {
+    for (size_t i = from; i < to; i++) {
+      const Event & event = chunk->events[i];
+
+      fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+          first ? "" : ",", event.name, event.category, event.begin / 1e3, event.duration / 1e3, thread);
+      first = false;
+    }
+  }
+}
+
+namespace Trace {
+  void start() {
+    on.store(true, std::memory_order_relaxed);
+  }
+
+  void stop() {
+    on.store(false, std::memory_order_relaxed);
+  }
+
+  bool recording() {
+    return on.load(std::memory_order_relaxed);
+  }
+
+  bool write(const std::string & path) {
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+      return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    bool first = true;
+
+    std::lock_guard<std::mutex> lock(threadsMutex);
+
+    for (ThreadBuffer *buffer : threads) {
+      while (true) {
+        Chunk *chunk = buffer->head;
+        Chunk *next = chunk->next.load(std::memory_order_acquire);
+
+        /* A chunk with a next one is full for good and can go once it's
+         * written out; the last one is still being recorded into */
+        size_t count = chunk->count.load(std::memory_order_acquire);
+        writeEvents(file, buffer->id, chunk, buffer->read, count, first);
+        buffer->read = count;
+
+        if (next == nullptr) {
+          break;
+        }
+
+        delete chunk;
+        buffer->head = next;
+        buffer->read = 0;
+      }
+    }
+
+    fprintf(file, "\n]}\n");
+
+    bool written = !ferror(file);
+    return fclose(file) == 0 && written;
+  }
+
+  Scope::Scope(const char *n, const char *c)
+    : name(n)
+    , category(c)
+    , begin(0)
+    , active(recording())
+  {
+    if (active) {
+      begin = now();
+    }
+  }
+
+  Scope::~Scope() {
+    if (active) {
+      record(name, category, begin, now());
+    }
+  }
+}
@@ -5,19 +5,23 @@
   */
 
 #include <cstdio>
+#include <cstdlib>
 #include <cstdint>
+#include <cstring>
 
 #include <iostream>
 #include <string>
 #include <vector>
 #include <queue>
+#include <random>
+#include <algorithm>
 #include <stdexcept>
+#include <chrono>
 using namespace std;
 
 #define GLEW_STATIC
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
-#include <SOIL.h>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -29,10 +33,39 @@ using namespace glm;
 
 #include <Shader.h>
 #include <Font.h>
+#include <Texture.h>
+#include <Atlas.h>
+#include <StreamBuffer.h>
+#include <GLState.h>
+#include <FrameData.h>
+#include <Profiler.h>
+#include <Trace.h>
+#include <Offscreen.h>
 
 const int SCREEN_WIDTH  = 640;
 const int SCREEN_HEIGHT = 480;
 
+/* Seconds since startup; GLFW's timer would need GLFW, which offscreen
+ * runs do without */
+const auto START_TIME = std::chrono::steady_clock::now();
+
+double now() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - START_TIME).count();
+}
+
+/* Nothing in the game moves by itself, so frames are only drawn when
+ * something asks for it */
+class Redraw {
+  public:
+    static bool needed;
+
+    static void request() {
+      needed = true;
+    }
+};
+
+bool Redraw::needed = true;
+
 class GraphicsContext {
   private:
     Shader & shader;
@@ -59,49 +92,84 @@ class GraphicsContext {
       shader.disuse();
     }
 
+    /* Uploads what stays the same for everything drawn this frame */
+    void updateFrame(StreamBuffer & frames, float time) {
+      bindFrameData(frames, {
+        projection,
+        view,
+        tileSize,
+        ortho(0.0f, (float)SCREEN_WIDTH, (float)SCREEN_HEIGHT, 0.0f),
+        time
+      });
+    }
+
     void updateContext() {
       shader.setUniform("model", model);
-      shader.setUniform("view", view);
-      shader.setUniform("tileSize", tileSize);
-      shader.setUniform("projection", projection);
     }
 };
 
 class Appearance {
   public:
     GLuint texture;
+    /* The image's part of `texture`, in texture coordinates; all of it
+     * unless the image came out of an atlas */
+    AtlasRegion region;
 
     GLuint vao, vbo, ebo;
     vector<GLfloat> vertices;
     vector<GLuint> elements;
 
+  private:
+    /* Atlas pages are shared, so those aren't ours to delete */
+    bool ownsTexture;
+
   public:
-    Appearance() {
-      glGenTextures(1, &texture);
+    Appearance()
+      : texture(0)
+      , region { 0, 0.0f, 0.0f, 1.0f, 1.0f }
+      , ownsTexture(false)
+    {
       glGenVertexArrays(1, &vao);
       glGenBuffers(1, &vbo);
       glGenBuffers(1, &ebo);
     }
 
     virtual ~Appearance() {
-      glDeleteTextures(1, &texture);
-      glDeleteVertexArrays(1, &vao);
+      if (ownsTexture) {
+        GLState::deleteTextures(1, &texture);
+      }
+      GLState::deleteVertexArrays(1, &vao);
       glDeleteBuffers(1, &vbo);
       glDeleteBuffers(1, &ebo);
     }
 
     void loadTexture(const string & path) {
-      glBindTexture(GL_TEXTURE_2D, texture);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      /* Packed images share their atlas' texture, so whatever is drawn
+       * from the same page needs only the one bind */
+      if (findAtlasRegion(path, region)) {
+        texture = region.texture;
+        return;
+      }
 
-        int width, height;
-        uint8_t *image = SOIL_load_image(path.c_str(), &width, &height, 0, SOIL_LOAD_RGBA);
+      if (!ownsTexture) {
+        glGenTextures(1, &texture);
+        ownsTexture = true;
+      }
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+      ::loadTexture(texture, path);
+      region = { texture, 0.0f, 0.0f, 1.0f, 1.0f };
+    }
 
-        SOIL_free_image_data(image);
-      glBindTexture(GL_TEXTURE_2D, 0);
+    /* Moves the texture coordinates, given over the whole image, into the
+     * image's region and uploads the vertices into `vbo`, leaving it bound */
+    void uploadVertices() {
+      for (size_t i = 0; i + 3 < vertices.size(); i += 4) {
+        vertices[i + 2] = region.x + vertices[i + 2] * region.w;
+        vertices[i + 3] = region.y + vertices[i + 3] * region.h;
+      }
+
+      glBindBuffer(GL_ARRAY_BUFFER, vbo);
+      glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
     }
 };
 
@@ -113,14 +181,14 @@ class Window {
     vec2 size;
     vec2 border;
 
-    Shader shader;
+    Shader & shader;
 
   public:
     Window(const vec2 & p, const vec2 & s, const vec2 & b)
       : position(p)
       , size(s)
       , border(b)
-      , shader("res/ui.vert", "res/ui.frag")
+      , shader(getShader(SHADER_UI_VERT, SHADER_UI_FRAG))
     {
       appearance.loadTexture("res/gui2.png");
 
@@ -160,9 +228,8 @@ class Window {
         }
       }
 
-      glBindVertexArray(appearance.vao);
-        glBindBuffer(GL_ARRAY_BUFFER, appearance.vbo);
-        glBufferData(GL_ARRAY_BUFFER, appearance.vertices.size() * sizeof(GLfloat), appearance.vertices.data(), GL_STATIC_DRAW);
+      GLState::bindVertexArray(appearance.vao);
+        appearance.uploadVertices();
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, appearance.ebo);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, appearance.elements.size() * sizeof(GLuint), appearance.elements.data(), GL_STATIC_DRAW);
@@ -174,25 +241,19 @@ class Window {
         /* UV attribute */
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)(2 * sizeof(GLfloat)));
         glEnableVertexAttribArray(1);
-      glBindVertexArray(0);
+      GLState::bindVertexArray(0);
     }
 
     void render() {
       shader.use();
 
-      shader.setUniform("projection", ortho(0.0f, (float)SCREEN_WIDTH, (float) SCREEN_HEIGHT, 0.0f));
       shader.setUniform("position", position);
       shader.setUniform("size", size);
 
-      glBindVertexArray(appearance.vao);
-      glBindTexture(GL_TEXTURE_2D, appearance.texture);
-
-      glDrawElements(GL_TRIANGLES, appearance.elements.size(), GL_UNSIGNED_INT, 0);
+      GLState::bindVertexArray(appearance.vao);
+      GLState::bindTexture(appearance.texture);
 
-      glBindTexture(GL_TEXTURE_2D, 0);
-      glBindVertexArray(0);
-
-      shader.disuse();
+      GLState::drawElements(GL_TRIANGLES, appearance.elements.size(), GL_UNSIGNED_INT, 0);
     }
 };
 
@@ -229,6 +290,7 @@ class LogWindow : public Window {
 
     void log(std::string message) {
       messages.insert(messages.begin(), message);
+      Redraw::request();
     }
 };
 
@@ -269,9 +331,8 @@ class Item {
       };
 
       /* Generate the VAO */
-      glBindVertexArray(appearance.vao);
-        glBindBuffer(GL_ARRAY_BUFFER, appearance.vbo);
-        glBufferData(GL_ARRAY_BUFFER, appearance.vertices.size() * sizeof(GLfloat), appearance.vertices.data(), GL_STATIC_DRAW);
+      GLState::bindVertexArray(appearance.vao);
+        appearance.uploadVertices();
 
         /* Position */
         glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)0);
@@ -280,7 +341,7 @@ class Item {
         /* Texture coordinates */
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)(2 * sizeof(GLfloat)));
         glEnableVertexAttribArray(1);
-      glBindVertexArray(0);
+      GLState::bindVertexArray(0);
     }
 };
 
@@ -405,9 +466,8 @@ class Obelisk : public Actor {
       };
 
       /* Generate the VAO */
-      glBindVertexArray(appearance.vao);
-        glBindBuffer(GL_ARRAY_BUFFER, appearance.vbo);
-        glBufferData(GL_ARRAY_BUFFER, appearance.vertices.size() * sizeof(GLfloat), appearance.vertices.data(), GL_STATIC_DRAW);
+      GLState::bindVertexArray(appearance.vao);
+        appearance.uploadVertices();
 
         /* Position attribute */
         glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)0);
@@ -416,7 +476,7 @@ class Obelisk : public Actor {
         /* Color attribute */
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)(2 * sizeof(GLfloat)));
         glEnableVertexAttribArray(1);
-      glBindVertexArray(0);
+      GLState::bindVertexArray(0);
     }
 
     void interact(Actor &) override {
@@ -428,13 +488,10 @@ class Obelisk : public Actor {
       context.model *= translate(vec3(position.x, position.y, 0));
       context.updateContext();
 
-      glBindVertexArray(appearance.vao);
-      glBindTexture(GL_TEXTURE_2D, appearance.texture);
+      GLState::bindVertexArray(appearance.vao);
+      GLState::bindTexture(appearance.texture);
 
-      glDrawArrays(GL_TRIANGLES, 0, appearance.vertices.size());
-
-      glBindTexture(GL_TEXTURE_2D, 0);
-      glBindVertexArray(0);
+      GLState::drawArrays(GL_TRIANGLES, 0, appearance.vertices.size());
     }
 };
 
@@ -459,13 +516,10 @@ class DroppedItem : public Actor {
       context.model *= translate(vec3(position.x, position.y, 0));
       context.updateContext();
 
-      glBindVertexArray(appearance.vao);
-      glBindTexture(GL_TEXTURE_2D, appearance.texture);
-
-      glDrawArrays(GL_TRIANGLES, 0, 6);
+      GLState::bindVertexArray(appearance.vao);
+      GLState::bindTexture(appearance.texture);
 
-      glBindTexture(GL_TEXTURE_2D, 0);
-      glBindVertexArray(0);
+      GLState::drawArrays(GL_TRIANGLES, 0, 6);
     }
 };
 
@@ -495,9 +549,8 @@ class Chest : public OrientedActor {
       }
 
       /* Generate the VAO */
-      glBindVertexArray(appearance.vao);
-        glBindBuffer(GL_ARRAY_BUFFER, appearance.vbo);
-        glBufferData(GL_ARRAY_BUFFER, appearance.vertices.size() * sizeof(GLfloat), appearance.vertices.data(), GL_STATIC_DRAW);
+      GLState::bindVertexArray(appearance.vao);
+        appearance.uploadVertices();
 
         /* Position attribute */
         glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)0);
@@ -506,7 +559,7 @@ class Chest : public OrientedActor {
         /* Color attribute */
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)(2 * sizeof(GLfloat)));
         glEnableVertexAttribArray(1);
-      glBindVertexArray(0);
+      GLState::bindVertexArray(0);
     }
 
     void interact(Actor & other) override {
@@ -521,13 +574,10 @@ class Chest : public OrientedActor {
       context.model *= translate(vec3(position.x, position.y, 0));
       context.updateContext();
 
-      glBindVertexArray(appearance.vao);
-      glBindTexture(GL_TEXTURE_2D, appearance.texture);
+      GLState::bindVertexArray(appearance.vao);
+      GLState::bindTexture(appearance.texture);
 
-      glDrawArrays(GL_TRIANGLES, orientation * 6, 6);
-
-      glBindTexture(GL_TEXTURE_2D, 0);
-      glBindVertexArray(0);
+      GLState::drawArrays(GL_TRIANGLES, orientation * 6, 6);
     }
 };
 
@@ -553,9 +603,8 @@ class Player : public OrientedActor {
       }
 
       /* Generate the VAO */
-      glBindVertexArray(appearance.vao);
-        glBindBuffer(GL_ARRAY_BUFFER, appearance.vbo);
-        glBufferData(GL_ARRAY_BUFFER, appearance.vertices.size() * sizeof(GLfloat), appearance.vertices.data(), GL_STATIC_DRAW);
+      GLState::bindVertexArray(appearance.vao);
+        appearance.uploadVertices();
 
         /* Position */
         glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)0);
@@ -564,7 +613,7 @@ class Player : public OrientedActor {
         /* Texture coordinates */
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)(2 * sizeof(GLfloat)));
         glEnableVertexAttribArray(1);
-      glBindVertexArray(0);
+      GLState::bindVertexArray(0);
     }
 
     void interact(Actor & e) override {
@@ -576,13 +625,10 @@ class Player : public OrientedActor {
       context.model *= translate(vec3(position.x, position.y, 0));
       context.updateContext();
 
-      glBindVertexArray(appearance.vao);
-      glBindTexture(GL_TEXTURE_2D, appearance.texture);
-
-      glDrawArrays(GL_TRIANGLES, orientation * 6, 6);
+      GLState::bindVertexArray(appearance.vao);
+      GLState::bindTexture(appearance.texture);
 
-      glBindTexture(GL_TEXTURE_2D, 0);
-      glBindVertexArray(0);
+      GLState::drawArrays(GL_TRIANGLES, orientation * 6, 6);
     }
 };
 
@@ -604,23 +650,11 @@ class TileSet {
       : width(w), height(h)
     {
       glGenTextures(1, &texture);
-
-      glBindTexture(GL_TEXTURE_2D, texture);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-        uint8_t *image = SOIL_load_image(path.c_str(), &textureWidth, &textureHeight, 0, SOIL_LOAD_RGBA);
-
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, textureWidth, textureHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-
-        SOIL_free_image_data(image);
-
-        glGenerateMipmap(GL_TEXTURE_2D);
-      glBindTexture(GL_TEXTURE_2D, 0);
+      loadTexture(texture, path, &textureWidth, &textureHeight);
     }
 
     ~TileSet() {
-      glDeleteTextures(1, &texture);
+      GLState::deleteTextures(1, &texture);
     }
 
     Rect tileRect(const Tile & tile) const {
@@ -649,14 +683,27 @@ class Map : public Observer {
 
     GLuint vao, vbo;
     vector<GLfloat> vertices;
-    Shader s;
+    Shader & s;
+
+    /* The tiles are written into `stream` whenever they're drawn, the
+     * pass's FrameData into `frames` */
+    StreamBuffer & stream;
+    StreamBuffer & frames;
+    GLuint tileVao;
+
+    /* The tiles changed since they were last drawn into `texture`; set
+     * this (and request a redraw) after changing any */
+    bool tilesDirty;
 
-    Map(uint32_t w, uint32_t h, const TileSet & t)
+    Map(uint32_t w, uint32_t h, const TileSet & t, StreamBuffer & sb, StreamBuffer & fb)
       : width(w)
       , height(h)
       , tileSet(t)
       , map { new Tile [w * h] }
-      , s("res/simple.vsh", "res/simple.fsh")
+      , s(getShader(SHADER_SIMPLE_VSH, SHADER_SIMPLE_FSH))
+      , stream(sb)
+      , frames(fb)
+      , tilesDirty(true)
     {
       /* Generate the map */
       for (uint32_t y = 0; y < height; y++) {
@@ -695,7 +742,7 @@ class Map : public Observer {
       glGenVertexArrays(1, &vao);
       glGenBuffers(1, &vbo);
 
-      glBindVertexArray(vao);
+      GLState::bindVertexArray(vao);
 
       glBindBuffer(GL_ARRAY_BUFFER, vbo);
       glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
@@ -708,7 +755,24 @@ class Map : public Observer {
       glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)(2 * sizeof(GLfloat)));
       glEnableVertexAttribArray(1);
 
-      glBindVertexArray(0);
+      GLState::bindVertexArray(0);
+
+      /* The tiles' VAO */
+      glGenVertexArrays(1, &tileVao);
+
+      GLState::bindVertexArray(tileVao);
+
+      glBindBuffer(GL_ARRAY_BUFFER, stream.buffer());
+
+      /* Position attribute */
+      glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)0);
+      glEnableVertexAttribArray(0);
+
+      /* Color attribute */
+      glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)(2 * sizeof(GLfloat)));
+      glEnableVertexAttribArray(1);
+
+      GLState::bindVertexArray(0);
 
       /* Prepare the framebuffer */
       glGenFramebuffers(1, &framebuffer);
@@ -722,27 +786,40 @@ class Map : public Observer {
       //   delete a;
       // }
 
-      glDeleteVertexArrays(1, &vao);
+      GLState::deleteVertexArrays(1, &vao);
       glDeleteBuffers(1, &vbo);
+      GLState::deleteVertexArrays(1, &tileVao);
 
       glDeleteFramebuffers(1, &framebuffer);
-      glDeleteTextures(1, &texture);
+      GLState::deleteTextures(1, &texture);
     }
 
+    /* Draws the tiles into `texture`, if they changed since last time */
     void renderMap() {
+      if (!tilesDirty) {
+        return;
+      }
+
+      tilesDirty = false;
+
+      /* Put back whatever was being drawn into after; offscreen, that's
+       * not the default framebuffer */
       int v[4];
       glGetIntegerv(GL_VIEWPORT, v);
 
+      GLint target;
+      glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target);
+
       glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
 
-      glBindTexture(GL_TEXTURE_2D, texture);
+      GLState::bindTexture(texture);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width * 16, height * 16, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
-      glBindTexture(GL_TEXTURE_2D, 0);
+      GLState::bindTexture(0);
 
       glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
 
@@ -757,45 +834,7 @@ class Map : public Observer {
       if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
         printf("ERROR::FRAMEBUFFER:: Framebuffer is not complete!\n");
       }
-      glBindFramebuffer(GL_FRAMEBUFFER, 0);  
-
-      GLuint vao, vbo;
-      std::vector<GLfloat> vertices;
-
-      for (GLfloat y = 0; y < height; y++) {
-        for (GLfloat x = 0; x < width; x++) {
-          auto rect = tileSet.tileRect(get(x, y));
-
-          vertices.insert(vertices.end(), {
-              (x + 0), (y + 0), rect.x,          rect.y,
-              (x + 1), (y + 1), rect.x + rect.w, rect.y + rect.h,
-              (x + 0), (y + 1), rect.x,          rect.y + rect.h,
-
-              (x + 1), (y + 1), rect.x + rect.w, rect.y + rect.h,
-              (x + 0), (y + 0), rect.x,          rect.y,
-              (x + 1), (y + 0), rect.x + rect.w, rect.y,
-          });
-        }
-      }
-
-      /* Generate the VAO */
-      glGenVertexArrays(1, &vao);
-      glGenBuffers(1, &vbo);
-
-      glBindVertexArray(vao);
-
-      glBindBuffer(GL_ARRAY_BUFFER, vbo);
-      glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
-
-      /* Position attribute */
-      glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)0);
-      glEnableVertexAttribArray(0);
-
-      /* Color attribute */
-      glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)(2 * sizeof(GLfloat)));
-      glEnableVertexAttribArray(1);
-
-      glBindVertexArray(0);
+      glBindFramebuffer(GL_FRAMEBUFFER, target);
 
       /* Render to the framebuffer */
       glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
@@ -803,25 +842,64 @@ class Map : public Observer {
 
       s.use();
 
+      /* The whole map fills the framebuffer, one unit per tile */
+      bindFrameData(frames, {
+        ortho(0.0f, (float) width, (float) height, 0.0f),
+        mat4(),
+        mat4(),
+        ortho(0.0f, (float)SCREEN_WIDTH, (float)SCREEN_HEIGHT, 0.0f),
+        (float) now()
+      });
       s.setUniform("model", mat4());
-      s.setUniform("projection", ortho(0.0f, (float) width, (float) height, 0.0f));
-      s.setUniform("view", mat4());
-      s.setUniform("tileSize", mat4());
 
       glClearColor(0.0f, 1.0f, 0.0f, 0.0f);
       glClear(GL_COLOR_BUFFER_BIT);
 
-      glBindVertexArray(vao);      
-      glBindTexture(GL_TEXTURE_2D, tileSet.texture);
+      GLState::bindVertexArray(tileVao);
+      GLState::bindTexture(tileSet.texture);
 
-      glDrawArrays(GL_TRIANGLES, 0, vertices.size());
+      /* Write the tiles straight into the stream buffer, six vertices of
+       * four floats each, as many rows at a time as fit in one map */
+      const GLsizeiptr vertexSize = 4 * sizeof(GLfloat);
+      const GLsizeiptr rowSize = width * 6 * vertexSize;
+      uint32_t rows = std::min<GLsizeiptr>(height, stream.capacity() / rowSize);
 
-      s.disuse();
+      for (uint32_t first = 0; first < height; first += rows) {
+        uint32_t last = std::min(height, first + rows);
 
-      glBindTexture(GL_TEXTURE_2D, 0);
-      glBindVertexArray(0);
+        GLintptr offset;
+        auto *vertices = rows == 0 ? nullptr : static_cast<GLfloat *>(stream.map((last - first) * rowSize, vertexSize, offset));
 
-      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (vertices == nullptr) {
+          fprintf(stderr, "Failed to map vertices for %ux%u tiles.\n", width, height);
+          break;
+        }
+
+        for (GLfloat y = first; y < last; y++) {
+          for (GLfloat x = 0; x < width; x++) {
+            auto rect = tileSet.tileRect(get(x, y));
+
+            GLfloat tile[24] = {
+                (x + 0), (y + 0), rect.x,          rect.y,
+                (x + 1), (y + 1), rect.x + rect.w, rect.y + rect.h,
+                (x + 0), (y + 1), rect.x,          rect.y + rect.h,
+
+                (x + 1), (y + 1), rect.x + rect.w, rect.y + rect.h,
+                (x + 0), (y + 0), rect.x,          rect.y,
+                (x + 1), (y + 0), rect.x + rect.w, rect.y,
+            };
+
+            memcpy(vertices, tile, sizeof(tile));
+            vertices += 24;
+          }
+        }
+
+        stream.unmap();
+
+        GLState::drawArrays(GL_TRIANGLES, offset / vertexSize, (last - first) * width * 6);
+      }
+
+      glBindFramebuffer(GL_FRAMEBUFFER, target);
 
       glViewport(v[0], v[1], v[2], v[3]);
     }
@@ -837,13 +915,10 @@ class Map : public Observer {
     void render(GraphicsContext context) const {
       context.updateContext();
 
-      glBindVertexArray(vao);      
-      glBindTexture(GL_TEXTURE_2D, texture);
-
-      glDrawArrays(GL_TRIANGLES, 0, vertices.size());
+      GLState::bindVertexArray(vao);      
+      GLState::bindTexture(texture);
 
-      glBindTexture(GL_TEXTURE_2D, 0);
-      glBindVertexArray(0);
+      GLState::drawArrays(GL_TRIANGLES, 0, vertices.size());
     }
 
     void renderEntities(GraphicsContext context) {
@@ -887,6 +962,8 @@ class Map : public Observer {
 
     void onNotify(Subject & a, uint32_t event) override {
       if (event == Actor::EVENT_IMPLOSION) {
+        Redraw::request();
+
         for (auto it = entities.begin(); it != entities.end(); it++) {
           if (&(*it)->events == &a) {
             Logger::log("Entity just died.");
@@ -900,40 +977,91 @@ class Map : public Observer {
 
 class Camera {
   private:
+    /* Where it was a step ago, for drawing in between steps */
+    vec2 previous;
     vec2 position;
     const Actor &target;
 
   public:
     Camera(const Actor & e)
-      : position(e.position)
+      : previous(e.position)
+      , position(e.position)
       , target(e)
     { }
 
-    void updatePosition(float delta) {
-      position += delta * (target.position - position);
+    /* Eases towards the target by one simulation step */
+    void step(float delta) {
+      previous = position;
+
+      vec2 distance = target.position - position;
+
+      /* Close enough not to show, so it stops animating */
+      if (abs(distance.x) < 0.001f && abs(distance.y) < 0.001f) {
+        position = target.position;
+      } else {
+        position += delta * distance;
+      }
+    }
+
+    /* Still on its way, or was during the last step */
+    bool moving() const {
+      return position != target.position || previous != position;
     }
 
-    mat4 viewMatrix() const {
-      return translate(vec3(-position.x, -position.y, 0));
+    /* The view `alpha` of the way from the last step to the current one */
+    mat4 viewMatrix(float alpha) const {
+      vec2 p = previous + alpha * (position - previous);
+      return translate(vec3(-p.x, -p.y, 0));
     }
 };
 
-class FPSCounter {
+/* Runs the simulation in fixed steps however fast frames are drawn, so
+ * it behaves the same at any refresh rate and a slow frame doesn't slow
+ * it down */
+class SimulationClock {
   private:
     double lastTime;
-    int frames;
+    /* Time passed that hasn't been simulated yet */
+    double accumulator;
 
   public:
-    FPSCounter()
-      : lastTime { glfwGetTime() }
-      , frames(0)
+    /* 60 steps a second */
+    static constexpr double STEP = 1.0 / 60.0;
+    /* Most steps taken to catch up at once; after a longer hitch the
+     * simulation just falls behind instead of taking ever longer frames */
+    static const int MAX_STEPS = 5;
+
+    SimulationClock()
+      : lastTime { now() }
+      , accumulator(0.0)
     { }
 
-    double delta() {
-      double now = glfwGetTime();
-      double d = now - lastTime;
-      lastTime = now;
-      return d;
+    /* How many steps to run for the time that passed since last asked */
+    int advance() {
+      double time = now();
+      accumulator += time - lastTime;
+      lastTime = time;
+
+      int steps = static_cast<int>(accumulator / STEP);
+      if (steps > MAX_STEPS) {
+        steps = MAX_STEPS;
+        accumulator = steps * STEP;
+      }
+
+      accumulator -= steps * STEP;
+      return steps;
+    }
+
+    /* How far the frame is between the last step and the next, 0 to 1 */
+    float alpha() const {
+      return static_cast<float>(accumulator / STEP);
+    }
+
+    /* Forgets the time since last asked, e.g. spent waiting for input
+     * with nothing to simulate */
+    void reset() {
+      lastTime = now();
+      accumulator = 0.0;
     }
 };
 
@@ -997,55 +1125,355 @@ class OrientedActorController {
     }
 };
 
+/* A scripted run for measuring frames the same way every time: a world
+ * of a given size and crowd, the player walking laps around it, log
+ * messages coming in at a steady rate and no vsync. Frames are stepped
+ * one simulation step each, so every run draws exactly the same frames.
+ *
+ * Headless, it runs offscreen: `rogue --offscreen --bench` */
+class Benchmark {
+  public:
+    struct Options {
+      bool enabled = false;
+      uint32_t frames = 1000;
+      /* Frames drawn before measuring, for everything to settle */
+      uint32_t warmup = 60;
+      uint32_t width = 64, height = 64;
+      uint32_t actors = 200;
+      /* A log message every this many frames; 0 for none */
+      uint32_t logEvery = 10;
+      /* Also write the results here as JSON, if set */
+      std::string json;
+    };
+
+    /* Frames between the player's steps */
+    static const uint32_t STEP_FRAMES = 8;
+
+  private:
+    Options options;
+    std::vector<double> frameTimes;
+
+    static double percentile(const std::vector<double> & sorted, double p) {
+      return sorted[std::min(sorted.size() - 1, size_t(sorted.size() * p))];
+    }
+
+  public:
+    Benchmark(const Options & o)
+      : options(o)
+    {
+      frameTimes.reserve(options.frames);
+    }
+
+    /* Puts the actors on free tiles, the same ones every run */
+    void populate(Map & map) const {
+      std::mt19937 random(1234);
+
+      for (uint32_t i = 0, tries = 0; i < options.actors && tries < options.actors * 16; tries++) {
+        uint32_t x = 1 + random() % (map.width - 2);
+        uint32_t y = 2 + random() % (map.height - 3);
+
+        if (!map.passable(vec2(x, y))) {
+          continue;
+        }
+
+        switch (i++ % 3) {
+          case 0: map.addActor(new Obelisk { x, y }); break;
+          case 1: map.addActor(new Chest { x, y, S }); break;
+          case 2: map.addActor(new DroppedItem { x, y, new Item { "sword" } }); break;
+        }
+      }
+    }
+
+    /* The key the script presses on `frame`, if any; laps around the
+     * inside of the walls */
+    int key(uint32_t frame) const {
+      if (frame % STEP_FRAMES != 0) {
+        return 0;
+      }
+
+      uint32_t side = std::min(options.width, options.height) - 4;
+      uint32_t step = (frame / STEP_FRAMES) % (side * 4);
+
+      static const int KEYS[] = { GLFW_KEY_RIGHT, GLFW_KEY_DOWN, GLFW_KEY_LEFT, GLFW_KEY_UP };
+      return KEYS[step / side];
+    }
+
+    /* Whether `frame` is still warming up */
+    bool warmingUp(uint32_t frame) const {
+      return frame < options.warmup;
+    }
+
+    bool done(uint32_t frame) const {
+      return frame >= options.warmup + options.frames;
+    }
+
+    void record(uint32_t frame, double ms) {
+      if (!warmingUp(frame)) {
+        frameTimes.push_back(ms);
+      }
+    }
+
+    /* Prints the results, and writes them as JSON if asked to */
+    void report(const GLState::Counters & calls, const Font & font) const {
+      if (frameTimes.empty()) {
+        fprintf(stderr, "No frames were measured.\n");
+        return;
+      }
+
+      auto sorted = frameTimes;
+      std::sort(sorted.begin(), sorted.end());
+
+      double sum = 0.0;
+      for (double time : sorted) {
+        sum += time;
+      }
+
+      double frames = sorted.size();
+
+      printf("Benchmark: %zu frames, %ux%u map, %u actors, a message every %u frames\n",
+          sorted.size(), options.width, options.height, options.actors, options.logEvery);
+      printf("  frame ms    avg %7.3f  p50 %7.3f  p90 %7.3f  p99 %7.3f  max %7.3f\n",
+          sum / frames, percentile(sorted, 0.5), percentile(sorted, 0.9), percentile(sorted, 0.99), sorted.back());
+      printf("  per frame   %.1f draw calls, %.1f state changes (%.1f kept from the driver)\n",
+          calls.draws / frames, calls.issued / frames, calls.skipped / frames);
+      printf("  text        %s, %zu glyphs in %d atlas rows\n",
+          font.getMode() == Font::SDF ? "distance fields" : "bitmaps", font.glyphCount(), font.atlasRows());
+
+      /* The map pass only draws anything when the tiles change, so it's
+       * mostly empty */
+      static const char *PASSES[] = { "map", "scene", "ui" };
+
+      std::string gpu;
+      for (const char *pass : PASSES) {
+        Profiler::Summary summary;
+        if (!Profiler::summarize(pass, summary)) {
+          continue;
+        }
+
+        printf("  gpu %-6s  avg %7.3f  min %7.3f  p99 %7.3f  (%zu frames)\n",
+            pass, summary.average, summary.min, summary.p99, summary.samples);
+
+        char entry[160];
+        snprintf(entry, sizeof(entry), "%s\"%s\":{\"avg\":%.4f,\"min\":%.4f,\"p99\":%.4f,\"frames\":%zu}",
+            gpu.empty() ? "" : ",", pass, summary.average, summary.min, summary.p99, summary.samples);
+        gpu += entry;
+      }
+
+      if (options.json.empty()) {
+        return;
+      }
+
+      FILE *file = fopen(options.json.c_str(), "w");
+      if (file == nullptr) {
+        fprintf(stderr, "Failed to write '%s'.\n", options.json.c_str());
+        return;
+      }
+
+      fprintf(file, "{\"frames\":%zu,\"map\":[%u,%u],\"actors\":%u,\"logEvery\":%u,\n", sorted.size(), options.width, options.height, options.actors, options.logEvery);
+      fprintf(file, " \"frameMs\":{\"avg\":%.4f,\"p50\":%.4f,\"p90\":%.4f,\"p99\":%.4f,\"max\":%.4f},\n",
+          sum / frames, percentile(sorted, 0.5), percentile(sorted, 0.9), percentile(sorted, 0.99), sorted.back());
+      fprintf(file, " \"drawCallsPerFrame\":%.2f,\"stateChangesPerFrame\":%.2f,\n", calls.draws / frames, calls.issued / frames);
+      fprintf(file, " \"text\":{\"sdf\":%s,\"glyphs\":%zu,\"atlasRows\":%d},\n",
+          font.getMode() == Font::SDF ? "true" : "false", font.glyphCount(), font.atlasRows());
+      fprintf(file, " \"gpuMs\":{%s}}\n", gpu.c_str());
+
+      fclose(file);
+    }
+};
+
+struct Options {
+  /* Draw into a framebuffer with no window (see Offscreen.h): the
+   * benchmark with --bench, a single frame otherwise */
+  bool offscreen = false;
+  /* Where to save the last frame drawn offscreen */
+  std::string screenshot;
+  /* Draw text from distance fields, one set of glyphs for every size */
+  bool sdfText = false;
+
+  Benchmark::Options benchmark;
+};
+
+/* False, after saying why, for anything it doesn't understand */
+bool parseOptions(int argc, char **argv, Options & options) {
+  Benchmark::Options & bench = options.benchmark;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+    if (arg == "--bench") {
+      bench.enabled = true;
+      continue;
+    }
+
+    if (arg == "--offscreen") {
+      options.offscreen = true;
+      continue;
+    }
+
+    if (arg == "--sdf-text") {
+      options.sdfText = true;
+      continue;
+    }
+
+    static const char *VALUED[] = { "--screenshot", "--frames", "--warmup", "--map", "--actors", "--log-every", "--json" };
+
+    if (std::find(std::begin(VALUED), std::end(VALUED), arg) == std::end(VALUED) || value == nullptr) {
+      fprintf(stderr, "Usage: %s [--offscreen [--screenshot image]] [--sdf-text] [--bench [--frames N] [--warmup N] [--map WxH] [--actors N] [--log-every N] [--json path]]\n", argv[0]);
+      return false;
+    }
+
+    i++;
+
+    if (arg == "--screenshot") {
+      options.screenshot = value;
+    } else if (arg == "--frames") {
+      bench.frames = std::max(1, atoi(value));
+    } else if (arg == "--warmup") {
+      bench.warmup = std::max(0, atoi(value));
+    } else if (arg == "--map") {
+      unsigned w, h;
+      if (sscanf(value, "%ux%u", &w, &h) != 2 || w < 10 || h < 10 || w > 256 || h > 256) {
+        fprintf(stderr, "Map sizes go from 10x10 to 256x256.\n");
+        return false;
+      }
+      bench.width = w;
+      bench.height = h;
+    } else if (arg == "--actors") {
+      bench.actors = std::max(0, atoi(value));
+    } else if (arg == "--log-every") {
+      bench.logEvery = std::max(0, atoi(value));
+    } else if (arg == "--json") {
+      bench.json = value;
+    }
+  }
+
+  if (!options.screenshot.empty() && !options.offscreen) {
+    fprintf(stderr, "Screenshots are only taken offscreen.\n");
+    return false;
+  }
+
+  return true;
+}
+
 std::queue<int> keys;
 
+/* Longest the idle loop sleeps for, in seconds */
+const double IDLE_TIMEOUT = 0.5;
+
+/* Where the trace goes; ROGUE_TRACE=<path> also starts recording one
+ * right away, F4 starts and stops one */
+std::string tracePath = "trace.json";
+
+void writeTrace() {
+  if (Trace::write(tracePath)) {
+    printf("Trace written to %s\n", tracePath.c_str());
+    Logger::log("Trace written to " + tracePath);
+  } else {
+    fprintf(stderr, "Failed to write trace '%s'.\n", tracePath.c_str());
+  }
+}
+
+void toggleTrace() {
+  if (Trace::recording()) {
+    Trace::stop();
+    writeTrace();
+  } else {
+    Trace::start();
+    Logger::log("Recording trace");
+  }
+}
+
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
   if (action == GLFW_PRESS) {
     keys.push(key);
   }
 }
 
-int main() {
-  /* Initialize GLFW */
-  glfwInit();
+int main(int argc, char **argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    return 1;
+  }
 
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-  glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+  const Benchmark::Options & benchmark = options.benchmark;
 
-  /* VSync on */
-  glfwSwapInterval(1);
+  /* Start recording first, so startup is in the trace; it's one scope,
+   * up to the first frame */
+  if (const char *path = getenv("ROGUE_TRACE")) {
+    tracePath = path;
+    Trace::start();
+  }
+  std::unique_ptr<Trace::Scope> startup(new Trace::Scope("startup", "load"));
 
-  /* Create the window */
-  GLFWwindow* window = glfwCreateWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Rogue", nullptr, nullptr);
+  GLFWwindow *window = nullptr;
+  std::unique_ptr<Offscreen> offscreen;
 
-  glfwSetKeyCallback(window, key_callback);
+  if (options.offscreen) {
+    try {
+      offscreen.reset(new Offscreen(SCREEN_WIDTH, SCREEN_HEIGHT));
+    } catch (const std::runtime_error & e) {
+      fprintf(stderr, "%s\n", e.what());
+      return -1;
+    }
+  } else {
+    /* Initialize GLFW */
+    glfwInit();
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+
+    /* Create the window */
+    window = glfwCreateWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Rogue", nullptr, nullptr);
+
+    if (window == nullptr) {
+      fprintf(stderr, "Failed to create GLFW window.\n");
+      glfwTerminate();
+      return -1;
+    }
 
-  if (window == nullptr) {
-    fprintf(stderr, "Failed to create GLFW window.\n");
-    glfwTerminate();
-    return -1;
-  }
+    glfwSetKeyCallback(window, key_callback);
+
+    glfwMakeContextCurrent(window);
 
-  glfwMakeContextCurrent(window);
+    /* VSync on, except when measuring; this needs the context current */
+    glfwSwapInterval(benchmark.enabled ? 0 : 1);
 
-  /* Initialize GLEW */
+    /* The window's contents were lost, e.g. when it was uncovered */
+    glfwSetWindowRefreshCallback(window, [](GLFWwindow *) {
+      Redraw::request();
+    });
+  }
+
+  /* Initialize GLEW; a GLEW built for GLX loads everything fine in an
+   * EGL context, it just can't find a GLX display to go with it */
   glewExperimental = GL_TRUE;
-  if (glewInit() != GLEW_OK) {
+  GLenum glew = glewInit();
+  if (glew != GLEW_OK && !(offscreen && glew == GLEW_ERROR_NO_GLX_DISPLAY)) {
     printf("Failed to initialize GLEW.\n");
     return -1;
   }
 
   /* Set the viewport */
-  int width, height;
-  glfwGetFramebufferSize(window, &width, &height);
-  glViewport(0, 0, width, height);
+  if (offscreen) {
+    offscreen->bind();
+  } else {
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    glViewport(0, 0, width, height);
+  }
 
   /* Enable transparency */
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  GLState::setBlend(true);
+  GLState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  /* Get every program compiling at once, while the textures load */
+  preloadShader(SHADER_SIMPLE_VSH, SHADER_SIMPLE_FSH);
+  preloadShader(SHADER_UI_VERT, SHADER_UI_FRAG);
+  preloadShader(SHADER_TEXT_VERT, options.sdfText ? SHADER_TEXT_FRAG_SDF : SHADER_TEXT_FRAG);
 
   /* Initialize FreeType */
   FT_Library ft;
@@ -1056,8 +1484,14 @@ int main() {
   }
 
   /* Data */
+  /* Vertices that change every frame go through here */
+  StreamBuffer stream;
+  /* and what's drawn with for a whole pass through a ring of its own, so
+   * none of those can wrap over it */
+  StreamBuffer frames(FRAME_DATA_SEGMENT_SIZE);
+
   TileSet t("res/tiles.png");
-  Map m(20, 20, t);
+  Map m(benchmark.enabled ? benchmark.width : 20, benchmark.enabled ? benchmark.height : 20, t, stream, frames);
 
   Player player { 1, 2 };
   OrientedActorController pc { player, m };
@@ -1067,7 +1501,7 @@ int main() {
   Camera c { player };
 
   /* Shader & matrices */
-  Shader program("res/simple.vsh", "res/simple.fsh");
+  Shader & program = getShader(SHADER_SIMPLE_VSH, SHADER_SIMPLE_FSH);
   
   mat4 projection = ortho(0.0f, (float)SCREEN_WIDTH, (float)SCREEN_HEIGHT, 0.0f);
   mat4 center = translate(vec3(SCREEN_WIDTH / 64, SCREEN_HEIGHT / 64, 0));
@@ -1080,45 +1514,193 @@ int main() {
     mat4()
   };
 
-  Font font(ft, "res/Denjuu-World.ttf");
+  Font font(ft, "res/Denjuu-World.ttf", stream, 8, options.sdfText ? Font::SDF : Font::BITMAP);
 
   LogWindow l(vec2(12, SCREEN_HEIGHT - 12 - 144), vec2(396, 144), 9, font);
   Logger::window = &l;
 
-  FPSCounter fps;
-  while(!glfwWindowShouldClose(window)) {
-    glfwPollEvents();
+  /* Everything up to the first frame, shaders being most of it */
+  startup.reset();
 
-    /* Update camera */
-    while (!keys.empty()) {
-      pc.handleKey(keys.front());
-      keys.pop();
+  /* Draws a frame `alpha` of the way from the last step to the next */
+  auto drawFrame = [&](float alpha) {
+    /* Pick up the GPU times that are in by now */
+    Profiler::beginFrame();
+
+    /* Render the scene */
+    {
+      Profiler::Scope scope("render");
+
+      {
+        Profiler::Scope scope("renderMap");
+        Profiler::GpuScope pass("map");
+        m.renderMap();
+      }
+
+      {
+        Profiler::GpuScope pass("scene");
+
+        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        context.use();
+
+        context.view = center * c.viewMatrix(alpha);
+        context.updateFrame(frames, now());
+        context.updateContext();
+
+        m.render(context);
+
+        {
+          Profiler::Scope scope("renderEntities");
+          m.renderEntities(context);
+        }
+
+        context.disuse();
+      }
+
+      {
+        Profiler::Scope scope("LogWindow");
+        Profiler::GpuScope pass("ui");
+        l.render();
+      }
     }
 
-    c.updatePosition(fps.delta());
+    /* F3; not timed itself */
+    Profiler::render(font, vec2(8, 14));
 
-    /* Render the scene */
-    m.renderMap();
+    /* Offscreen, flushing stands in for swapping, so the frames don't
+     * just pile up */
+    {
+      Profiler::Scope scope("swap");
+
+      if (window != nullptr) {
+        glfwSwapBuffers(window);
+      } else {
+        glFlush();
+      }
+    }
+
+    stream.endFrame();
+    frames.endFrame();
+    Profiler::endFrame();
+  };
+
+  if (benchmark.enabled) {
+    Benchmark bench(benchmark);
+    bench.populate(m);
+
+    for (uint32_t frame = 0; !bench.done(frame) && !(window != nullptr && glfwWindowShouldClose(window)); frame++) {
+      /* Count from the first measured frame on */
+      if (frame == benchmark.warmup) {
+        Profiler::setWindow(benchmark.frames);
+        GLState::resetCounters();
+      }
+
+      double start = now();
+
+      if (window != nullptr) {
+        glfwPollEvents();
+      }
+
+      {
+        Profiler::Scope scope("input");
 
-    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
+        if (int key = bench.key(frame)) {
+          pc.handleKey(key);
+        }
+
+        if (benchmark.logEvery != 0 && frame % benchmark.logEvery == 0) {
+          Logger::log("Frame " + std::to_string(frame));
+        }
+      }
+
+      {
+        Profiler::Scope scope("simulation");
+        c.step(SimulationClock::STEP);
+      }
+
+      drawFrame(0.0f);
+
+      bench.record(frame, (now() - start) * 1000.0);
+    }
+
+    bench.report(GLState::counters(), font);
+  }
+
+  SimulationClock clock;
+  bool animating = true;
+  /* Offscreen there's no input to wait for; a frame of the world as it
+   * starts out is all there is to draw */
+  if (offscreen && !benchmark.enabled) {
+    drawFrame(0.0f);
+  }
+
+  while(window != nullptr && !benchmark.enabled && !glfwWindowShouldClose(window)) {
+    /* Only the camera moves by itself; while it doesn't, sleep until
+     * there's input */
+    if (animating) {
+      glfwPollEvents();
+    } else {
+      Trace::Scope scope("wait", "frame");
+      glfwWaitEventsTimeout(IDLE_TIMEOUT);
+      clock.reset();
+    }
+
+    /* Update camera */
+    {
+      Profiler::Scope scope("input");
+
+      while (!keys.empty()) {
+        if (keys.front() == GLFW_KEY_F3) {
+          Profiler::toggle();
+        } else if (keys.front() == GLFW_KEY_F4) {
+          toggleTrace();
+        } else {
+          pc.handleKey(keys.front());
+        }
 
-    context.use();
+        keys.pop();
+        Redraw::request();
+      }
+    }
 
-    context.view = center * c.viewMatrix();
-    context.updateContext();
+    /* Catch the simulation up with the clock */
+    {
+      Profiler::Scope scope("simulation");
 
-    m.render(context);
-    m.renderEntities(context);
+      for (int steps = clock.advance(); steps > 0; steps--) {
+        c.step(SimulationClock::STEP);
+      }
+    }
 
-    context.disuse();
+    animating = c.moving();
+
+    if (!animating && !Redraw::needed) {
+      continue;
+    }
 
-    l.render();
+    Redraw::needed = false;
 
-    glfwSwapBuffers(window);
+    drawFrame(clock.alpha());
+  }
+
+  if (Trace::recording()) {
+    writeTrace();
+  }
+
+  if (!options.screenshot.empty()) {
+    if (offscreen->save(options.screenshot)) {
+      printf("Screenshot saved to %s\n", options.screenshot.c_str());
+    } else {
+      fprintf(stderr, "Failed to save screenshot '%s'.\n", options.screenshot.c_str());
+    }
   }
 
   /* Cleanup */
-  glfwTerminate();
+  if (window != nullptr) {
+    glfwTerminate();
+  }
+
   return 0;
 }
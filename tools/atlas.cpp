@@ -0,0 +1,223 @@
+/** Atlas packer
+  *
+  * Packs images into as few atlas pages as it can, so everything drawn
+  * from them can share one texture. Every image gets a one pixel border
+  * copied from its own edge, so sampling right at the edge of a region
+  * never picks up a neighbour. The pages are written as TGA next to the
+  * table, which lists for every image the page it's on (by file name,
+  * next to the table) and its rectangle in pixels:
+  *
+  *   page <page image> <width> <height>
+  *   <image> <x> <y> <width> <height>
+  *   ...
+  *
+  * Images are named exactly as they were given on the command line, which
+  * is how the game looks them up (see inc/Atlas.h).
+  *
+  * Usage: atlas <output table> <input images...>
+  */
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <SOIL.h>
+
+namespace {
+  /* Largest page there is; everything GL 3.3 has to support */
+  const int MAX_SIZE = 2048;
+  const int BORDER = 1;
+
+  struct Image {
+    string path;
+    int width, height;
+    uint8_t *pixels;
+
+    /* Where it went, border included */
+    int page = -1;
+    int x, y;
+  };
+
+  struct Page {
+    int width, height;
+  };
+
+  /* Shelf packs as many of `images` (tallest first) as fit into a page of
+   * the given size; true if all of them did */
+  bool pack(vector<Image *> & images, int page, int width, int height) {
+    int x = 0, y = 0, shelf = 0;
+    bool all = true;
+
+    for (auto *image : images) {
+      int w = image->width + 2 * BORDER;
+      int h = image->height + 2 * BORDER;
+
+      if (x + w > width) {
+        x = 0;
+        y += shelf;
+        shelf = 0;
+      }
+
+      if (w > width || y + h > height) {
+        image->page = -1;
+        all = false;
+        continue;
+      }
+
+      image->page = page;
+      image->x = x;
+      image->y = y;
+
+      x += w;
+      shelf = max(shelf, h);
+    }
+
+    return all;
+  }
+
+  /* Copies `image` to its place on `pixels`, a page `width` wide, and
+   * extends its edges out into the border */
+  void blit(const Image & image, vector<uint8_t> & pixels, int width) {
+    for (int y = -BORDER; y < image.height + BORDER; y++) {
+      int sy = min(max(y, 0), image.height - 1);
+
+      for (int x = -BORDER; x < image.width + BORDER; x++) {
+        int sx = min(max(x, 0), image.width - 1);
+
+        const uint8_t *from = image.pixels + (sy * image.width + sx) * 4;
+        uint8_t *to = &pixels[((image.y + BORDER + y) * width + image.x + BORDER + x) * 4];
+        memcpy(to, from, 4);
+      }
+    }
+  }
+
+  int powerOfTwo(int n) {
+    int p = 1;
+    while (p < n) {
+      p *= 2;
+    }
+    return p;
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <output table> <input images...>\n", argv[0]);
+    return 1;
+  }
+
+  string table = argv[1];
+  string base = table.substr(0, table.rfind('.'));
+
+  /* Decode everything */
+  vector<Image> images;
+  for (int i = 2; i < argc; i++) {
+    Image image;
+    image.path = argv[i];
+    image.pixels = SOIL_load_image(argv[i], &image.width, &image.height, 0, SOIL_LOAD_RGBA);
+
+    if (image.pixels == nullptr) {
+      fprintf(stderr, "Failed to load '%s': %s\n", argv[i], SOIL_last_result());
+      return 1;
+    }
+
+    if (image.width + 2 * BORDER > MAX_SIZE || image.height + 2 * BORDER > MAX_SIZE) {
+      fprintf(stderr, "'%s' doesn't fit on a %dx%d page.\n", argv[i], MAX_SIZE, MAX_SIZE);
+      return 1;
+    }
+
+    images.push_back(image);
+  }
+
+  /* Tallest first keeps the shelves full */
+  vector<Image *> left;
+  for (auto & image : images) {
+    left.push_back(&image);
+  }
+  stable_sort(left.begin(), left.end(), [](const Image *a, const Image *b) {
+    return a->height != b->height ? a->height > b->height : a->width > b->width;
+  });
+
+  /* Fill pages, each the smallest power of two square-ish size everything
+   * left fits on, until it's all packed */
+  vector<Page> pages;
+  while (!left.empty()) {
+    int area = 0, widest = 0, tallest = 0;
+    for (auto *image : left) {
+      area += (image->width + 2 * BORDER) * (image->height + 2 * BORDER);
+      widest = max(widest, image->width + 2 * BORDER);
+      tallest = max(tallest, image->height + 2 * BORDER);
+    }
+
+    int width = powerOfTwo(widest);
+    int height = powerOfTwo(tallest);
+    while (width * height < area) {
+      if (width <= height) {
+        width *= 2;
+      } else {
+        height *= 2;
+      }
+    }
+    width = min(width, MAX_SIZE);
+    height = min(height, MAX_SIZE);
+
+    int page = pages.size();
+    while (!pack(left, page, width, height) && (width < MAX_SIZE || height < MAX_SIZE)) {
+      if (width <= height && width < MAX_SIZE) {
+        width *= 2;
+      } else {
+        height *= 2;
+      }
+    }
+
+    pages.push_back({ width, height });
+    left.erase(remove_if(left.begin(), left.end(), [](const Image *image) {
+      return image->page != -1;
+    }), left.end());
+  }
+
+  /* Write the pages and the table */
+  FILE *file = fopen(table.c_str(), "w");
+  if (file == nullptr) {
+    fprintf(stderr, "Failed to write '%s'.\n", table.c_str());
+    return 1;
+  }
+
+  for (size_t p = 0; p < pages.size(); p++) {
+    vector<uint8_t> pixels(pages[p].width * pages[p].height * 4, 0);
+    for (auto & image : images) {
+      if (image.page == int(p)) {
+        blit(image, pixels, pages[p].width);
+      }
+    }
+
+    string path = base + to_string(p) + ".tga";
+    if (!SOIL_save_image(path.c_str(), SOIL_SAVE_TYPE_TGA, pages[p].width, pages[p].height, 4, pixels.data())) {
+      fprintf(stderr, "Failed to write '%s'.\n", path.c_str());
+      fclose(file);
+      return 1;
+    }
+
+    /* Wherever the table goes, the pages go with it */
+    string name = path.substr(path.find_last_of("/\\") + 1);
+    fprintf(file, "page %s %d %d\n", name.c_str(), pages[p].width, pages[p].height);
+    for (auto & image : images) {
+      if (image.page == int(p)) {
+        fprintf(file, "%s %d %d %d %d\n", image.path.c_str(), image.x + BORDER, image.y + BORDER, image.width, image.height);
+      }
+    }
+  }
+
+  fclose(file);
+
+  for (auto & image : images) {
+    SOIL_free_image_data(image.pixels);
+  }
+
+  return 0;
+}
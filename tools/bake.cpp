@@ -0,0 +1,41 @@
+/** Texture baker
+  *
+  * Compresses an image to DXT5 and writes it out as a DDS file together
+  * with its whole MIPmap chain, so the game can upload it as-is instead
+  * of decoding the original at startup.
+  *
+  * Usage: bake <input image> <output dds>
+  */
+
+#include <cstdio>
+#include <cstdint>
+
+#include <SOIL.h>
+#include <image_DXT.h>
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <input image> <output dds>\n", argv[0]);
+    return 1;
+  }
+
+  /* Decode the original */
+  int width, height;
+  uint8_t *image = SOIL_load_image(argv[1], &width, &height, 0, SOIL_LOAD_RGBA);
+
+  if (image == nullptr) {
+    fprintf(stderr, "Failed to load '%s': %s\n", argv[1], SOIL_last_result());
+    return 1;
+  }
+
+  /* Compress it along with the MIPmaps */
+  int result = save_image_as_DDS_with_MIPmaps(argv[2], width, height, 4, image);
+  SOIL_free_image_data(image);
+
+  if (!result) {
+    fprintf(stderr, "Failed to write '%s'.\n", argv[2]);
+    return 1;
+  }
+
+  return 0;
+}
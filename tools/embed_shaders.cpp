@@ -0,0 +1,187 @@
+/** Shader embedder
+  *
+  * Preprocesses GLSL sources and writes them out as a header of string
+  * tables, so the game compiles its shaders without reading a single file
+  * and every variant is spelled out at build time:
+  *
+  * - `#include "file"` lines are replaced with that file, looked up next
+  *   to the file including it; a file is only ever included once.
+  * - A source given as `path:NAME=value,OTHER` is a variant of `path` with
+  *   `#define NAME value` and `#define OTHER` right after its #version.
+  *
+  * Every source gets an id named after its file and defines, so
+  * res/text.frag:SDF becomes SHADER_TEXT_FRAG_SDF, with its source in
+  * SHADER_SOURCES and its name in SHADER_NAMES.
+  *
+  * Usage: embed_shaders <output header> <sources...>
+  */
+
+#include <cctype>
+#include <cstdio>
+
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+namespace {
+  string directoryOf(const string & path) {
+    size_t slash = path.rfind('/');
+    return slash == string::npos ? "" : path.substr(0, slash + 1);
+  }
+
+  bool readFile(const string & path, string & contents) {
+    ifstream file(path);
+    if (!file) {
+      return false;
+    }
+
+    stringstream stream;
+    stream << file.rdbuf();
+    contents = stream.str();
+    return true;
+  }
+
+  /* Appends `path` to `out` with its #includes resolved; false (after
+   * saying why) if anything couldn't be read */
+  bool preprocess(const string & path, set<string> & included, string & out) {
+    if (!included.insert(path).second) {
+      return true;
+    }
+
+    string contents;
+    if (!readFile(path, contents)) {
+      cerr << "Couldn't read '" << path << "'." << endl;
+      return false;
+    }
+
+    istringstream lines(contents);
+    string line;
+    while (getline(lines, line)) {
+      size_t start = line.find_first_not_of(" \t");
+
+      if (start != string::npos && line.compare(start, 8, "#include") == 0) {
+        size_t open = line.find('"', start);
+        size_t close = open == string::npos ? open : line.find('"', open + 1);
+
+        if (close == string::npos) {
+          cerr << path << ": malformed include: " << line << endl;
+          return false;
+        }
+
+        if (!preprocess(directoryOf(path) + line.substr(open + 1, close - open - 1), included, out)) {
+          return false;
+        }
+      } else {
+        out += line + '\n';
+      }
+    }
+
+    return true;
+  }
+
+  /* res/text.frag:SDF -> TEXT_FRAG_SDF */
+  string idOf(const string & spec) {
+    string name = spec.substr(spec.rfind('/') == string::npos ? 0 : spec.rfind('/') + 1);
+    string id;
+
+    for (char c : name) {
+      id += isalnum((unsigned char) c) ? toupper((unsigned char) c) : '_';
+    }
+
+    return id;
+  }
+
+  /* `#define` lines for "NAME=value,OTHER" */
+  string defineLines(const string & defines) {
+    string lines;
+    istringstream list(defines);
+    string define;
+
+    while (getline(list, define, ',')) {
+      if (define.empty()) {
+        continue;
+      }
+
+      size_t equals = define.find('=');
+      if (equals == string::npos) {
+        lines += "#define " + define + "\n";
+      } else {
+        lines += "#define " + define.substr(0, equals) + " " + define.substr(equals + 1) + "\n";
+      }
+    }
+
+    return lines;
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <output header> <sources...>\n", argv[0]);
+    return 1;
+  }
+
+  vector<string> ids, names, sources;
+
+  for (int i = 2; i < argc; i++) {
+    string spec = argv[i];
+    size_t colon = spec.find(':');
+    string path = spec.substr(0, colon);
+
+    string source;
+    set<string> included;
+    if (!preprocess(path, included, source)) {
+      return 1;
+    }
+
+    /* The defines go right after the #version line, which has to come first */
+    if (colon != string::npos) {
+      size_t line = source.find('\n');
+      source.insert(line == string::npos ? source.size() : line + 1, defineLines(spec.substr(colon + 1)));
+    }
+
+    if (source.find(")glsl\"") != string::npos) {
+      cerr << "'" << path << "' can't be embedded as a raw string." << endl;
+      return 1;
+    }
+
+    ids.push_back("SHADER_" + idOf(spec));
+    names.push_back(spec);
+    sources.push_back(source);
+  }
+
+  ostringstream out;
+  out << "/* Generated by tools/embed_shaders.cpp, don't edit */\n"
+      << "#pragma once\n\n"
+      << "enum ShaderSourceId {\n";
+  for (auto & id : ids) {
+    out << "  " << id << ",\n";
+  }
+  out << "  SHADER_SOURCE_COUNT\n};\n\n";
+
+  out << "/* What each source was made from, for messages and cache keys */\n"
+      << "constexpr const char *SHADER_NAMES[] = {\n";
+  for (auto & name : names) {
+    out << "  \"" << name << "\",\n";
+  }
+  out << "};\n\n";
+
+  out << "constexpr const char *SHADER_SOURCES[] = {\n";
+  for (auto & source : sources) {
+    out << "  R\"glsl(" << source << ")glsl\",\n";
+  }
+  out << "};\n";
+
+  ofstream file(argv[1]);
+  file << out.str();
+
+  if (!file) {
+    fprintf(stderr, "Failed to write '%s'.\n", argv[1]);
+    return 1;
+  }
+
+  return 0;
+}